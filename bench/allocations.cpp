@@ -0,0 +1,51 @@
+#include "allocations.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace science::libndtp {
+
+static std::atomic<uint64_t> n_allocations{0};
+
+uint64_t allocation_count() {
+  return n_allocations.load(std::memory_order_relaxed);
+}
+
+}  // namespace science::libndtp
+
+// Replacements for the global allocation functions. The array and nothrow forms of the standard
+// library forward to these, so they count every `new` and every standard container allocation.
+void* operator new(std::size_t size) {
+  science::libndtp::n_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  science::libndtp::n_allocations.fetch_add(1, std::memory_order_relaxed);
+  auto align = static_cast<std::size_t>(alignment);
+  // aligned_alloc wants a whole number of alignments
+  if (void* p = std::aligned_alloc(align, ((size ? size : 1) + align - 1) / align * align)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+
+namespace science::libndtp {
+
+// Heap allocations made so far by any thread, counted by the benchmark binary's operator new.
+uint64_t allocation_count();
+
+/**
+ * AllocationCounter reports the heap allocations made during its lifetime as the benchmark's
+ * `allocs` counter, averaged per iteration. Construct it right before the benchmark loop.
+ */
+class AllocationCounter {
+ public:
+  explicit AllocationCounter(benchmark::State& state) : state_(state), start_(allocation_count()) {}
+
+  ~AllocationCounter() {
+    double allocations = allocation_count() - start_;
+    state_.counters["allocs"] = benchmark::Counter(allocations, benchmark::Counter::kAvgIterations);
+  }
+
+  AllocationCounter(const AllocationCounter&) = delete;
+  AllocationCounter& operator=(const AllocationCounter&) = delete;
+
+ private:
+  benchmark::State& state_;
+  uint64_t start_;
+};
+
+}  // namespace science::libndtp
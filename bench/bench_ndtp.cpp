@@ -0,0 +1,426 @@
+#include <benchmark/benchmark.h>
+#include <science/libndtp/codec.h>
+#include <science/libndtp/matrix.h>
+#include <science/libndtp/ndtp.h>
+#include <science/libndtp/pipeline.h>
+#include <science/libndtp/simd.h>
+#include <science/libndtp/stream.h>
+#include <science/libndtp/types.h>
+#include "allocations.h"
+
+#include <atomic>
+#include <thread>
+
+namespace science::libndtp {
+
+static NDTPPayloadBroadband make_broadband_payload(size_t n_channels, size_t n_samples, uint8_t bit_width) {
+  NDTPPayloadBroadband payload{.is_signed = false, .bit_width = bit_width, .sample_rate = 30000};
+  for (size_t c = 0; c < n_channels; c++) {
+    std::vector<uint64_t> samples(n_samples);
+    for (size_t i = 0; i < n_samples; i++) {
+      samples[i] = (c * 31 + i * 7) & ((1ULL << bit_width) - 1);
+    }
+    payload.channels.push_back({.channel_id = static_cast<uint32_t>(c), .channel_data = samples});
+  }
+  return payload;
+}
+
+// Decode cost of a broadband payload as the channel count grows; should be O(n). Narrow sample
+// types move a quarter of the bytes of uint64_t.
+template <typename T>
+static void BM_BroadbandUnpackChannels(benchmark::State& state) {
+  size_t n_channels = state.range(0);
+  auto packed = make_broadband_payload(n_channels, 32, 12).pack();
+
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    auto unpacked = GenericNDTPPayloadBroadband<T>::unpack(packed.data(), packed.size());
+    benchmark::DoNotOptimize(unpacked);
+  }
+  state.SetComplexityN(n_channels);
+  state.SetBytesProcessed(state.iterations() * packed.size());
+  state.SetItemsProcessed(state.iterations() * n_channels * 32);
+}
+BENCHMARK_TEMPLATE(BM_BroadbandUnpackChannels, uint64_t)->RangeMultiplier(4)->Range(1, 1024)->Complexity(benchmark::oN);
+BENCHMARK_TEMPLATE(BM_BroadbandUnpackChannels, int16_t)->RangeMultiplier(4)->Range(1, 1024)->Complexity(benchmark::oN);
+
+// Encode and decode of a 12-bit broadband payload across channel and sample counts.
+static void BM_BroadbandPayload(benchmark::State& state, bool pack) {
+  size_t n_channels = state.range(0);
+  size_t n_samples = state.range(1);
+  auto payload = make_broadband_payload(n_channels, n_samples, 12);
+  auto packed = payload.pack();
+
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    if (pack) {
+      benchmark::DoNotOptimize(payload.pack_into(packed.data(), packed.size()));
+      benchmark::ClobberMemory();
+    } else {
+      benchmark::DoNotOptimize(NDTPPayloadBroadband::unpack(packed.data(), packed.size()));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * packed.size());
+  state.SetItemsProcessed(state.iterations() * n_channels * n_samples);
+}
+BENCHMARK_CAPTURE(BM_BroadbandPayload, pack, true)->ArgsProduct({{1, 16, 256}, {1, 16, 256}});
+BENCHMARK_CAPTURE(BM_BroadbandPayload, unpack, false)->ArgsProduct({{1, 16, 256}, {1, 16, 256}});
+
+// The same payloads decoded into a reused dense matrix instead of per-channel vectors.
+static void BM_BroadbandUnpackMatrix(benchmark::State& state, bool sample_major) {
+  size_t n_channels = state.range(0);
+  auto packed = make_broadband_payload(n_channels, 32, 12).pack();
+  std::vector<int16_t> samples(n_channels * 32);
+  std::vector<uint32_t> channel_ids(n_channels);
+  BroadbandSampleMatrix<int16_t> matrix{
+    .samples = samples.data(),
+    .max_channels = n_channels,
+    .max_samples = 32,
+    .channel_ids = channel_ids.data(),
+    .layout = sample_major ? BroadbandSampleMatrix<int16_t>::Layout::kSampleMajor
+                           : BroadbandSampleMatrix<int16_t>::Layout::kChannelMajor
+  };
+
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    auto info = matrix.unpack_payload(packed.data(), packed.size());
+    benchmark::DoNotOptimize(info);
+    benchmark::DoNotOptimize(samples.data());
+  }
+  state.SetBytesProcessed(state.iterations() * packed.size());
+  state.SetItemsProcessed(state.iterations() * n_channels * 32);
+}
+BENCHMARK_CAPTURE(BM_BroadbandUnpackMatrix, channel_major, false)->RangeMultiplier(4)->Range(1, 1024);
+BENCHMARK_CAPTURE(BM_BroadbandUnpackMatrix, sample_major, true)->RangeMultiplier(4)->Range(1, 1024);
+
+// Plain and delta encoded payloads of a slowly changing 16-bit signal, 256 samples on each of 64
+// channels; the bytes counter reports the encoded size, so the ratio shows the compression.
+static void BM_BroadbandDelta(benchmark::State& state, bool delta, bool pack) {
+  NDTPPayloadBroadband plain{.is_signed = true, .bit_width = 16, .sample_rate = 30000};
+  for (uint32_t c = 0; c < 64; c++) {
+    std::vector<uint64_t> samples(256);
+    for (size_t i = 0; i < samples.size(); i++) {
+      samples[i] = static_cast<uint64_t>(static_cast<int64_t>(((i + c) * 37) % 200) - 100 + (i * 7919 % 16));
+    }
+    plain.channels.push_back({.channel_id = c, .channel_data = samples});
+  }
+  NDTPPayloadBroadbandDelta compressed{
+    .is_signed = plain.is_signed, .bit_width = plain.bit_width, .sample_rate = plain.sample_rate, .channels = plain.channels
+  };
+  auto packed = delta ? compressed.pack() : plain.pack();
+  ByteArray buffer(plain.encoded_size() + 64);
+
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    if (pack) {
+      benchmark::DoNotOptimize(delta ? compressed.pack_into(buffer.data(), buffer.size()) : plain.pack_into(buffer.data(), buffer.size()));
+    } else if (delta) {
+      benchmark::DoNotOptimize(NDTPPayloadBroadbandDelta::unpack(packed.data(), packed.size()));
+    } else {
+      benchmark::DoNotOptimize(NDTPPayloadBroadband::unpack(packed.data(), packed.size()));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * packed.size());
+  state.SetItemsProcessed(state.iterations() * 64 * 256);
+}
+BENCHMARK_CAPTURE(BM_BroadbandDelta, plain_pack, false, true);
+BENCHMARK_CAPTURE(BM_BroadbandDelta, delta_pack, true, true);
+BENCHMARK_CAPTURE(BM_BroadbandDelta, plain_unpack, false, false);
+BENCHMARK_CAPTURE(BM_BroadbandDelta, delta_unpack, true, false);
+
+// Spiketrain payloads of `range(0)` bins of which 1 in `range(1)` is non-zero, dense and sparse.
+static void BM_Spiketrain(benchmark::State& state, bool sparse, bool pack) {
+  std::vector<uint8_t> spike_counts(state.range(0));
+  for (size_t i = 0; i < spike_counts.size(); i += state.range(1)) {
+    spike_counts[i] = 1 + i % 3;
+  }
+  NDTPPayloadSpiketrain dense_payload{.bin_size_ms = 1, .spike_counts = spike_counts};
+  NDTPPayloadSpiketrainSparse sparse_payload{.bin_size_ms = 1, .spike_counts = spike_counts};
+  auto packed = sparse ? sparse_payload.pack() : dense_payload.pack();
+
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    if (pack) {
+      benchmark::DoNotOptimize(
+        sparse ? sparse_payload.pack_into(packed.data(), packed.size()) : dense_payload.pack_into(packed.data(), packed.size())
+      );
+      benchmark::ClobberMemory();
+    } else if (sparse) {
+      benchmark::DoNotOptimize(NDTPPayloadSpiketrainSparse::unpack(packed.data(), packed.size()));
+    } else {
+      benchmark::DoNotOptimize(NDTPPayloadSpiketrain::unpack(packed.data(), packed.size()));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * packed.size());
+  state.SetItemsProcessed(state.iterations() * spike_counts.size());
+}
+BENCHMARK_CAPTURE(BM_Spiketrain, dense_pack, false, true)->ArgsProduct({{64, 512, 4096}, {2, 16, 128}});
+BENCHMARK_CAPTURE(BM_Spiketrain, sparse_pack, true, true)->ArgsProduct({{64, 512, 4096}, {2, 16, 128}});
+BENCHMARK_CAPTURE(BM_Spiketrain, dense_unpack, false, false)->ArgsProduct({{64, 512, 4096}, {2, 16, 128}});
+BENCHMARK_CAPTURE(BM_Spiketrain, sparse_unpack, true, false)->ArgsProduct({{64, 512, 4096}, {2, 16, 128}});
+
+// Dense spiketrain encode and decode of 4096 bins, with the instruction set as the argument.
+static void BM_SpiketrainNibbles(benchmark::State& state, bool pack) {
+  simd::ScopedIsa restore_isa;
+  if (!simd::set_isa(static_cast<simd::Isa>(state.range(0)))) {
+    state.SkipWithError("instruction set not supported");
+    return;
+  }
+  NDTPPayloadSpiketrain payload{.bin_size_ms = 1, .spike_counts = std::vector<uint8_t>(4096)};
+  for (size_t i = 0; i < payload.spike_counts.size(); i++) {
+    payload.spike_counts[i] = i * 7 % 20;
+  }
+  auto packed = payload.pack();
+
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    if (pack) {
+      benchmark::DoNotOptimize(payload.pack_into(packed.data(), packed.size()));
+    } else {
+      benchmark::DoNotOptimize(NDTPPayloadSpiketrain::unpack(packed.data(), packed.size()));
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * payload.spike_counts.size());
+}
+BENCHMARK_CAPTURE(BM_SpiketrainNibbles, pack, true)->Arg(0)->Arg(1)->Arg(2);
+BENCHMARK_CAPTURE(BM_SpiketrainNibbles, unpack, false)->Arg(0)->Arg(1)->Arg(2);
+
+// Sample codec throughput per bit width, with the instruction set given as the second argument.
+static void BM_SampleCodecIsa(benchmark::State& state, bool pack) {
+  uint8_t bit_width = state.range(0);
+  auto isa = static_cast<simd::Isa>(state.range(1));
+  simd::ScopedIsa restore_isa;
+  if (!simd::set_isa(isa)) {
+    state.SkipWithError("instruction set not supported");
+    return;
+  }
+
+  std::vector<int32_t> values(4096);
+  for (size_t i = 0; i < values.size(); i++) {
+    values[i] = static_cast<int32_t>(i * 2654435761u) >> (32 - bit_width);
+  }
+  ByteArray packed;
+  to_bytes(values, bit_width, packed, 0, true);
+  std::vector<int32_t> unpacked(values.size());
+
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    if (pack) {
+      packed.clear();
+      to_bytes(values, bit_width, packed, 0, true);
+      benchmark::DoNotOptimize(packed.data());
+    } else {
+      BitReader(packed.data(), packed.size()).read(unpacked.data(), unpacked.size(), bit_width, true);
+      benchmark::DoNotOptimize(unpacked.data());
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * packed.size());
+  state.SetItemsProcessed(state.iterations() * values.size());
+}
+BENCHMARK_CAPTURE(BM_SampleCodecIsa, pack, true)->ArgsProduct({{10, 12, 16, 24}, {0, 1, 2}});
+BENCHMARK_CAPTURE(BM_SampleCodecIsa, unpack, false)->ArgsProduct({{10, 12, 16, 24}, {0, 1, 2}});
+
+// Per-packet encode cost of a fixed 32 channel x 16 sample, 12-bit stream.
+static void BM_BroadbandMessagePack(benchmark::State& state) {
+  NDTPMessage message{
+      .header = NDTPHeader{.data_type = synapse::DataType::kBroadband, .timestamp = 1, .seq_number = 0},
+      .payload = make_broadband_payload(32, 16, 12)
+  };
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    message.header.seq_number++;
+    auto packed = message.pack();
+    benchmark::DoNotOptimize(packed.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BroadbandMessagePack);
+
+// Same stream encoded into a reused send buffer, with no allocation per packet.
+static void BM_BroadbandMessagePackInto(benchmark::State& state) {
+  NDTPMessage message{
+      .header = NDTPHeader{.data_type = synapse::DataType::kBroadband, .timestamp = 1, .seq_number = 0},
+      .payload = make_broadband_payload(32, 16, 12)
+  };
+  ByteArray buffer(message.encoded_size());
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    message.header.seq_number++;
+    size_t written = message.pack_into(buffer.data(), buffer.size());
+    benchmark::DoNotOptimize(written);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BroadbandMessagePackInto);
+
+static ElectricalBroadbandData make_broadband_block(size_t n_channels, size_t n_samples) {
+  ElectricalBroadbandData data{.is_signed = false, .bit_width = 16, .sample_rate = 30000, .t0 = 0};
+  for (auto& channel : make_broadband_payload(n_channels, n_samples, 16).channels) {
+    data.channels.push_back({.channel_id = channel.channel_id, .channel_data = std::move(channel.channel_data)});
+  }
+  return data;
+}
+
+// Packing a block of `range(0)` channels x `range(1)` samples (1500 is 50 ms at 30 kHz) into a
+// list of vectors vs. into a reused PacketBatch.
+static void BM_ElectricalBroadbandPack(benchmark::State& state, bool use_batch) {
+  size_t n_channels = state.range(0);
+  size_t n_samples = state.range(1);
+  auto data = make_broadband_block(n_channels, n_samples);
+  PacketBatch batch;
+  data.pack(0, batch);
+  size_t packed_bytes = batch.bytes();
+
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    if (use_batch) {
+      batch.clear();
+      data.pack(0, batch);
+      benchmark::DoNotOptimize(batch.data());
+    } else {
+      auto packets = data.pack(0);
+      benchmark::DoNotOptimize(packets.data());
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * packed_bytes);
+  state.SetItemsProcessed(state.iterations() * n_channels * n_samples);
+}
+BENCHMARK_CAPTURE(BM_ElectricalBroadbandPack, vectors, false)->ArgsProduct({{32, 256, 1024}, {30, 1500}});
+BENCHMARK_CAPTURE(BM_ElectricalBroadbandPack, batch, true)->ArgsProduct({{32, 256, 1024}, {30, 1500}});
+
+// Re-streaming a 50 ms block of 4096 channels with the encoding spread over threads.
+static void BM_ElectricalBroadbandPackParallel(benchmark::State& state) {
+  auto data = make_broadband_block(4096, 1500);
+  PacketBatch batch;
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    batch.clear();
+    data.pack_parallel(0, batch, state.range(0));
+    benchmark::DoNotOptimize(batch.data());
+  }
+  state.SetItemsProcessed(state.iterations() * 4096 * 1500);
+}
+BENCHMARK(BM_ElectricalBroadbandPackParallel)->Arg(1)->Arg(2)->Arg(4)->UseRealTime();
+
+static void BM_FixedBroadbandCodecPack(benchmark::State& state) {
+  std::vector<uint32_t> channel_ids(32);
+  for (uint32_t c = 0; c < channel_ids.size(); c++) {
+    channel_ids[c] = c;
+  }
+  FixedBroadbandCodec<12, false, uint16_t> codec(channel_ids, 16, 30000);
+  std::vector<uint16_t> samples(codec.samples_per_packet());
+  for (size_t i = 0; i < samples.size(); i++) {
+    samples[i] = (i * 7) & 0xFFF;
+  }
+  ByteArray packet(codec.packet_size());
+  uint16_t seq_number = 0;
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    codec.pack(1, seq_number++, samples.data(), packet.data(), packet.size());
+    benchmark::DoNotOptimize(packet.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FixedBroadbandCodecPack);
+
+static void BM_Crc16(benchmark::State& state) {
+  ByteArray data(state.range(0));
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<uint8_t>(i * 31);
+  }
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(crc16(data.data(), data.size()));
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_Crc16)->Arg(16)->Arg(64)->Arg(512)->Arg(1400)->Arg(9000);
+
+// Decoding a 64 datagram receive batch one unpack() at a time and with unpack_batch.
+static void BM_UnpackBatch(benchmark::State& state, bool batched) {
+  PacketBatch batch;
+  make_broadband_block(256, 300).pack(0, batch);
+  size_t n = std::min<size_t>(batch.size(), 64);
+  std::vector<ByteSpan> spans;
+  for (size_t i = 0; i < n; i++) {
+    spans.push_back(batch[i]);
+  }
+  std::vector<NDTPMessage> messages(n);
+  std::vector<NDTPUnpackStatus> statuses(n);
+
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    if (batched) {
+      benchmark::DoNotOptimize(NDTPMessage::unpack_batch(spans.data(), n, messages.data(), statuses.data()));
+    } else {
+      for (size_t i = 0; i < n; i++) {
+        messages[i] = NDTPMessage::unpack(spans[i].data, spans[i].size);
+      }
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * (spans.back().end() - spans.front().begin()));
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK_CAPTURE(BM_UnpackBatch, loop, false);
+BENCHMARK_CAPTURE(BM_UnpackBatch, batched, true);
+
+// Per-datagram cost of sequence tracking, with pairs of packets swapped to exercise the reorder window.
+static void BM_StreamDecoderPush(benchmark::State& state) {
+  NDTPMessage message{
+      .header = NDTPHeader{.data_type = synapse::DataType::kBroadband, .timestamp = 1, .seq_number = 0},
+      .payload = make_broadband_payload(32, 16, 12)
+  };
+  std::vector<ByteArray> datagrams;
+  for (uint16_t seq = 0; seq < 1024; seq++) {
+    message.header.seq_number = seq ^ 1;
+    datagrams.push_back(message.pack());
+  }
+  NDTPStreamDecoder decoder(state.range(0));
+  size_t delivered = 0;
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    decoder.reset();
+    for (const auto& datagram : datagrams) {
+      decoder.push(datagram.data(), datagram.size(), [&](const NDTPStreamPacket&) { delivered++; });
+    }
+  }
+  benchmark::DoNotOptimize(delivered);
+  state.SetItemsProcessed(state.iterations() * datagrams.size());
+}
+BENCHMARK(BM_StreamDecoderPush)->Arg(0)->Arg(64);
+
+// Decode throughput of the pipeline as workers are added, for the packets of a 50 ms block of 256 channels.
+// One pipeline runs throughout; each iteration submits the block and waits until all of it is delivered.
+static void BM_DecodePipeline(benchmark::State& state) {
+  auto block = make_broadband_block(256, 1500);
+  PacketBatch batch;
+  std::atomic<size_t> delivered{0};
+  NDTPDecodePipeline pipeline(
+    [&](NDTPMessage&&) { delivered.fetch_add(1, std::memory_order_relaxed); },
+    NDTPPipelineOptions{.n_workers = static_cast<size_t>(state.range(0))}
+  );
+  size_t seq_number = 0;
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    // every block goes out with new sequence numbers, or the pipeline would discard it as late
+    state.PauseTiming();
+    batch.clear();
+    seq_number += block.pack(seq_number, batch);
+    state.ResumeTiming();
+
+    for (size_t i = 0; i < batch.size(); i++) {
+      pipeline.submit(batch[i].data, batch[i].size);
+    }
+    while (delivered.load(std::memory_order_relaxed) < seq_number) {
+      std::this_thread::yield();
+    }
+  }
+  pipeline.stop();
+  state.SetItemsProcessed(state.iterations() * batch.size());
+}
+BENCHMARK(BM_DecodePipeline)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+
+}  // namespace science::libndtp
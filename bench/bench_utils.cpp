@@ -0,0 +1,94 @@
+#include <benchmark/benchmark.h>
+#include <science/libndtp/ndtp.h>
+#include <science/libndtp/utils.h>
+#include "allocations.h"
+
+namespace science::libndtp {
+
+// 4096 values that use the full range of `bit_width` bits, sign extended when `is_signed`.
+template <typename T>
+static std::vector<T> make_values(uint8_t bit_width, bool is_signed) {
+  std::vector<T> values(4096);
+  for (size_t i = 0; i < values.size(); i++) {
+    uint64_t value = i * 0x9E3779B97F4A7C15ULL;
+    if (is_signed) {
+      values[i] = static_cast<T>(static_cast<int64_t>(value) >> (64 - bit_width));
+    } else {
+      values[i] = static_cast<T>(value >> (64 - bit_width));
+    }
+  }
+  return values;
+}
+
+// to_bytes into a reused buffer, per bit width and signedness; the tuple it returns holds a copy
+// of the buffer, which shows up in the allocation count.
+static void BM_ToBytes(benchmark::State& state) {
+  uint8_t bit_width = state.range(0);
+  bool is_signed = state.range(1);
+  auto values = make_values<int64_t>(bit_width, is_signed);
+  ByteArray packed;
+  packed.reserve(values.size() * 8);
+
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    packed.clear();
+    auto result = to_bytes(values, bit_width, packed, 0, is_signed);
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetBytesProcessed(state.iterations() * packed.size());
+  state.SetItemsProcessed(state.iterations() * values.size());
+}
+BENCHMARK(BM_ToBytes)->ArgsProduct({{1, 4, 8, 10, 12, 16, 24, 32, 64}, {0, 1}});
+
+// to_ints reading the same buffers back in place.
+static void BM_ToInts(benchmark::State& state) {
+  uint8_t bit_width = state.range(0);
+  bool is_signed = state.range(1);
+  auto values = make_values<int64_t>(bit_width, is_signed);
+  ByteArray packed;
+  to_bytes(values, bit_width, packed, 0, is_signed);
+
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    auto result = to_ints<int64_t>(packed.data(), packed.size(), bit_width, values.size(), 0, is_signed);
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetBytesProcessed(state.iterations() * packed.size());
+  state.SetItemsProcessed(state.iterations() * values.size());
+}
+BENCHMARK(BM_ToInts)->ArgsProduct({{1, 4, 8, 10, 12, 16, 24, 32, 64}, {0, 1}});
+
+static void BM_HeaderPack(benchmark::State& state, bool into_buffer) {
+  NDTPHeader header{.data_type = synapse::DataType::kBroadband, .timestamp = 1234567890123, .seq_number = 0};
+  uint8_t buffer[NDTPHeader::NDTP_HEADER_SIZE];
+
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    header.seq_number++;
+    if (into_buffer) {
+      benchmark::DoNotOptimize(header.pack_into(buffer, sizeof(buffer)));
+      benchmark::ClobberMemory();
+    } else {
+      auto packed = header.pack();
+      benchmark::DoNotOptimize(packed.data());
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * NDTPHeader::NDTP_HEADER_SIZE);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_HeaderPack, vector, false);
+BENCHMARK_CAPTURE(BM_HeaderPack, into_buffer, true);
+
+static void BM_HeaderUnpack(benchmark::State& state) {
+  auto packed = NDTPHeader{.data_type = synapse::DataType::kBroadband, .timestamp = 1234567890123, .seq_number = 7}.pack();
+
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(NDTPHeader::unpack(packed.data(), packed.size()));
+  }
+  state.SetBytesProcessed(state.iterations() * packed.size());
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HeaderUnpack);
+
+}  // namespace science::libndtp
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include "science/libndtp/ndtp.h"
+#include "science/libndtp/types.h"
+
+namespace science::libndtp {
+
+/**
+ * BroadbandBlock holds a fixed number of samples for every channel of a BroadbandAssembler,
+ * stored channel-major: `samples[c * samples_per_channel + i]` is sample i of channel c. Samples
+ * that were never received are zero, with `present` marking the ones that were.
+ */
+struct BroadbandBlock {
+  uint64_t index = 0;      // blocks since the assembler's origin
+  uint64_t timestamp = 0;  // of the first sample
+  size_t samples_per_channel = 0;
+  std::vector<uint64_t> samples;
+  std::vector<uint8_t> present;
+  std::vector<size_t> received;  // samples received per channel
+  size_t total_received = 0;
+
+  bool complete() const { return total_received == samples.size(); }
+  bool channel_complete(size_t c) const { return received[c] == samples_per_channel; }
+  const uint64_t* channel(size_t c) const { return samples.data() + c * samples_per_channel; }
+};
+
+/**
+ * BroadbandAssembler places the samples of decoded broadband messages into fixed-duration blocks
+ * covering a known set of channels, and emits the blocks in order.
+ *
+ * A message's position is derived from its timestamp relative to the first message pushed (the
+ * origin) at the configured sample rate, so packets may arrive out of order or be missing. Up to
+ * `max_pending_blocks` blocks are filled at a time; a block is emitted as soon as it is complete,
+ * or incomplete once samples arrive for a block past the pending range. Samples for blocks that
+ * were already emitted are counted as late and dropped, and samples for unknown channels are
+ * ignored. A timestamp far past the pending range (a device reset or a corrupt timestamp) flushes
+ * the pending blocks and moves the range to it, counting the blocks in between as skipped instead
+ * of emitting each of them. All buffers are allocated up front and reused.
+ */
+class BroadbandAssembler {
+ public:
+  BroadbandAssembler(
+    const std::vector<uint32_t>& channel_ids, uint32_t sample_rate, size_t samples_per_block, size_t max_pending_blocks = 2
+  );
+
+  // Places the samples of a broadband message; calls `emit(const BroadbandBlock&)` for each block finished.
+  template <typename F>
+  void push(const NDTPMessage& message, F&& emit) {
+    if (const auto* delta = std::get_if<NDTPPayloadBroadbandDelta>(&message.payload)) {
+      push_channels(message.header.timestamp, *delta, emit);
+    } else {
+      push_channels(message.header.timestamp, std::get<NDTPPayloadBroadband>(message.payload), emit);
+    }
+  }
+
+  template <typename F>
+  void push(const ElectricalBroadbandData& data, F&& emit) {
+    check_sample_rate(data.sample_rate);
+    for (const auto& channel : data.channels) {
+      place(data.t0, channel.channel_id, channel.channel_data.data(), channel.channel_data.size(), emit);
+    }
+    emit_complete(emit);
+  }
+
+  // Emits every pending block that has received any samples, complete or not.
+  template <typename F>
+  void flush(F&& emit) {
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+      if (pending_block(first_).total_received > 0) {
+        emit_first(emit);
+      } else {
+        recycle_first();
+      }
+    }
+  }
+
+  const std::vector<uint32_t>& channel_ids() const { return channel_ids_; }
+  size_t samples_per_block() const { return samples_per_block_; }
+
+  // Samples dropped because their block had already been emitted.
+  uint64_t late_samples() const { return late_samples_; }
+
+  // Samples ignored because their channel is not assembled.
+  uint64_t ignored_samples() const { return ignored_samples_; }
+
+  // Samples, over all channels, of the blocks jumped over after a timestamp gap; never emitted.
+  uint64_t skipped_samples() const { return skipped_samples_; }
+
+ private:
+  BroadbandBlock& pending_block(uint64_t index) { return blocks_[index % blocks_.size()]; }
+
+  void check_sample_rate(uint32_t sample_rate) const {
+    if (sample_rate != sample_rate_) {
+      throw std::invalid_argument(
+        "sample rate " + std::to_string(sample_rate) + " does not match the assembler's " + std::to_string(sample_rate_)
+      );
+    }
+  }
+
+  // Places the channels of a broadband payload in either encoding.
+  template <typename Payload, typename F>
+  void push_channels(uint64_t timestamp, const Payload& payload, F& emit) {
+    check_sample_rate(payload.sample_rate);
+    for (const auto& channel : payload.channels) {
+      place(timestamp, channel.channel_id, channel.channel_data.data(), channel.channel_data.size(), emit);
+    }
+    emit_complete(emit);
+  }
+
+  // Sample index of `timestamp` relative to the origin, or -1 if it precedes the origin.
+  int64_t sample_index(uint64_t timestamp);
+
+  // Copies a run of samples for one channel into the pending blocks it covers.
+  template <typename F>
+  void place(uint64_t timestamp, uint32_t channel_id, const uint64_t* data, size_t size, F& emit) {
+    auto it = channel_index_.find(channel_id);
+    if (it == channel_index_.end()) {
+      ignored_samples_ += size;
+      return;
+    }
+    int64_t start = sample_index(timestamp);
+    if (start < 0) {
+      late_samples_ += size;
+      return;
+    }
+
+    uint64_t pos = start;
+    while (size > 0) {
+      uint64_t index = pos / samples_per_block_;
+      size_t offset = pos % samples_per_block_;
+      size_t n = std::min(size, samples_per_block_ - offset);
+      if (index < first_) {
+        late_samples_ += n;
+      } else {
+        if (index - first_ >= 2 * blocks_.size()) {
+          flush(emit);
+          skip_to(index + 1 - blocks_.size());
+        }
+        while (index >= first_ + blocks_.size()) {
+          emit_first(emit);
+        }
+        fill(pending_block(index), it->second, offset, data, n);
+      }
+      data += n;
+      size -= n;
+      pos += n;
+    }
+  }
+
+  void fill(BroadbandBlock& block, size_t channel, size_t offset, const uint64_t* data, size_t size);
+
+  template <typename F>
+  void emit_complete(F& emit) {
+    while (pending_block(first_).complete()) {
+      emit_first(emit);
+    }
+  }
+
+  template <typename F>
+  void emit_first(F& emit) {
+    emit(static_cast<const BroadbandBlock&>(pending_block(first_)));
+    recycle_first();
+  }
+
+  // Clears the oldest pending block and reuses it for the block after the newest one.
+  void recycle_first();
+
+  // Moves the (empty) pending range forward to start at block `first`.
+  void skip_to(uint64_t first);
+
+  std::vector<uint32_t> channel_ids_;
+  std::unordered_map<uint32_t, size_t> channel_index_;
+  uint32_t sample_rate_;
+  size_t samples_per_block_;
+
+  std::vector<BroadbandBlock> blocks_;
+  uint64_t first_ = 0;  // index of the oldest pending block
+
+  bool started_ = false;
+  uint64_t origin_ = 0;
+  uint64_t late_samples_ = 0;
+  uint64_t ignored_samples_ = 0;
+  uint64_t skipped_samples_ = 0;
+};
+
+}  // namespace science::libndtp
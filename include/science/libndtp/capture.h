@@ -0,0 +1,177 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "science/libndtp/utils.h"
+
+namespace science::libndtp {
+
+/**
+ * NDTP capture files record raw NDTP datagrams as they were received, for replay and debugging.
+ * All integers are big-endian, like the NDTP header:
+ *
+ *   file header  "NDTPCAP" and a format version byte, the index interval (4 bytes), 4 reserved
+ *   records      receive time in ns since the Unix epoch (8 bytes), datagram size (4 bytes), datagram
+ *   index        entries of NDTP timestamp (8 bytes), record offset (8 bytes), data type, 7 reserved
+ *   trailer      index offset (8 bytes), index entry count (8 bytes), "NDTPIDX" and a version byte
+ *
+ * Records follow each other with no padding. The index is sparse: every stream (NDTP data type)
+ * gets an entry for its first record, every `index_interval`th record after that and its last
+ * record, sorted by stream and then by file position. Datagrams too short to hold an NDTP header
+ * are recorded but not indexed. The index and trailer are written when the capture is closed.
+ */
+struct NDTPCaptureRecord {
+  uint64_t offset = 0;           // position of the record in the file
+  uint64_t receive_time_ns = 0;
+  ByteSpan datagram;             // points into the reader's mapping
+};
+
+struct NDTPCaptureIndexEntry {
+  uint64_t timestamp;  // NDTP header timestamp of the record
+  uint64_t offset;     // position of the record in the file
+  uint8_t data_type;   // stream_data_type() of the record
+};
+
+/**
+ * NDTPCaptureIndexBuilder collects the index entries of a capture as its records are appended.
+ */
+class NDTPCaptureIndexBuilder {
+ public:
+  explicit NDTPCaptureIndexBuilder(uint32_t interval) : interval_(interval) {}
+
+  void add(const uint8_t* datagram, size_t size, uint64_t offset);
+
+  // Adds the last record of each stream and returns the entries in index order.
+  std::vector<NDTPCaptureIndexEntry> finish();
+
+ private:
+  uint32_t interval_;
+  std::array<uint64_t, 256> counts_{};
+  std::array<NDTPCaptureIndexEntry, 256> last_{};
+  std::vector<NDTPCaptureIndexEntry> entries_;
+};
+
+struct NDTPCaptureOptions {
+  size_t buffer_bytes = 4 << 20;  // staged in memory and written out in chunks of this size
+  bool direct_io = false;         // bypass the page cache with O_DIRECT where supported
+  uint32_t index_interval = 64;   // records of a stream between index entries
+};
+
+/**
+ * NDTPCaptureWriter appends datagrams to a new capture file.
+ *
+ * Records are staged in one aligned buffer and written a whole buffer at a time, so a busy
+ * receiver pays for a write syscall every few megabytes. With `direct_io` the file is opened with
+ * O_DIRECT when the platform and file system support it, and with ordinary buffered writes
+ * otherwise. File errors throw std::runtime_error.
+ *
+ * close() writes the index and trailer. A file that was never closed (e.g. after a crash) can
+ * still be read, up to the last complete record that reached the disk.
+ */
+class NDTPCaptureWriter {
+ public:
+  // Creates `path`, replacing any existing file.
+  explicit NDTPCaptureWriter(const std::string& path, NDTPCaptureOptions options = {});
+  ~NDTPCaptureWriter();
+
+  NDTPCaptureWriter(const NDTPCaptureWriter&) = delete;
+  NDTPCaptureWriter& operator=(const NDTPCaptureWriter&) = delete;
+
+  // Records one datagram received at `receive_time_ns` (ns since the Unix epoch).
+  void write(const uint8_t* data, size_t size, uint64_t receive_time_ns);
+
+  // Records one datagram stamped with the current system time.
+  void write(const uint8_t* data, size_t size);
+
+  // Flushes the records and writes the index and trailer. Called by the destructor if needed,
+  // which swallows errors, so call it explicitly to see them.
+  void close();
+
+  uint64_t records() const { return records_; }
+
+  // Bytes of file header and records so far, flushed or not.
+  uint64_t bytes() const { return flushed_ + fill_; }
+
+  // Whether the file ended up opened with O_DIRECT.
+  bool direct_io() const { return direct_io_; }
+
+ private:
+  void append(const uint8_t* data, size_t size);
+  void flush_buffer();
+  void write_fully(const uint8_t* data, size_t size);
+
+  int fd_ = -1;
+  std::string path_;
+  bool direct_io_ = false;
+  uint32_t index_interval_;
+  std::unique_ptr<uint8_t, void (*)(void*)> buffer_;
+  size_t buffer_size_;
+  size_t fill_ = 0;
+  uint64_t flushed_ = 0;
+  uint64_t records_ = 0;
+  NDTPCaptureIndexBuilder index_;
+};
+
+/**
+ * NDTPCaptureReader maps a capture file into memory and hands out its datagrams in place.
+ *
+ * Opening a closed capture reads only the file header and the index, so seeking into a
+ * multi-hour session is a binary search over the index and a short scan, and replay touches
+ * only the pages it reads. A capture that was never closed is scanned once on open to find its
+ * last complete record and rebuild the index. Malformed files throw std::runtime_error.
+ *
+ * Records are read by position, with begin() as the first one:
+ *
+ *   NDTPCaptureRecord record;
+ *   for (uint64_t pos = reader.seek(timestamp); reader.next(pos, record);) { ... }
+ */
+class NDTPCaptureReader {
+ public:
+  explicit NDTPCaptureReader(const std::string& path);
+  ~NDTPCaptureReader();
+
+  NDTPCaptureReader(const NDTPCaptureReader&) = delete;
+  NDTPCaptureReader& operator=(const NDTPCaptureReader&) = delete;
+
+  // Position of the first record, and the end of the records.
+  uint64_t begin() const { return HEADER_SIZE; }
+  uint64_t end() const { return records_end_; }
+
+  // Reads the record at `pos` and advances `pos` past it; returns false at end().
+  bool next(uint64_t& pos, NDTPCaptureRecord& record) const;
+
+  // Position of the first record of stream `data_type` whose NDTP timestamp is at or after
+  // `timestamp`, or end() if there is none. Assumes timestamps do not decrease within a stream.
+  // The stream includes the compressed encoding of `data_type` (see stream_data_type()).
+  uint64_t seek(uint64_t timestamp, uint8_t data_type) const;
+
+  // Same as seek(timestamp, data_type), for the earliest such record of any stream.
+  uint64_t seek(uint64_t timestamp) const;
+
+  // Whether the file was closed by its writer, with the index stored in it.
+  bool complete() const { return complete_; }
+
+  uint32_t index_interval() const { return index_interval_; }
+  const std::vector<NDTPCaptureIndexEntry>& index() const { return index_; }
+
+  static constexpr size_t HEADER_SIZE = 16;
+  static constexpr size_t RECORD_HEADER_SIZE = 12;
+  static constexpr size_t INDEX_ENTRY_SIZE = 24;
+  static constexpr size_t TRAILER_SIZE = 24;
+
+ private:
+  bool load_index();
+  void rebuild_index();
+
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  uint64_t records_end_ = HEADER_SIZE;
+  uint32_t index_interval_ = 0;
+  bool complete_ = false;
+  std::vector<NDTPCaptureIndexEntry> index_;
+};
+
+}  // namespace science::libndtp
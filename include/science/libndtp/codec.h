@@ -0,0 +1,271 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "science/libndtp/ndtp.h"
+#include "science/libndtp/utils.h"
+
+namespace science::libndtp {
+
+/**
+ * FixedBroadbandCodec encodes and decodes broadband NDTP messages for a stream whose configuration
+ * (bit width, signedness, channel set and samples per channel) is fixed for the whole session.
+ *
+ * The packet layout is computed once: the constructor serializes a template message with all
+ * samples zeroed, so encoding copies the template, patches `timestamp` and `seq_number`, ORs the
+ * samples in at precomputed bit offsets and appends the CRC. Samples are written in groups of
+ * values that end on a byte boundary, with the shifts for each value in a group resolved at
+ * compile time. The output is byte-for-byte identical to NDTPMessage::pack, and NDTPMessage::unpack
+ * reads it back.
+ *
+ * Samples are passed channel-major: `samples[c * samples_per_channel() + i]` is sample i of
+ * channel_ids()[c]. Only the low BitWidth bits of each sample are encoded.
+ */
+template <uint8_t BitWidth, bool Signed, typename SampleT>
+class FixedBroadbandCodec {
+  static_assert(BitWidth >= 1 && BitWidth <= 64, "bit width must be between 1 and 64");
+  static_assert(std::is_integral_v<SampleT>, "samples must be integers");
+
+ public:
+  FixedBroadbandCodec(const std::vector<uint32_t>& channel_ids, uint16_t samples_per_channel, uint32_t sample_rate)
+      : channel_ids_(channel_ids), samples_per_channel_(samples_per_channel) {
+    NDTPPayloadBroadband payload{.is_signed = Signed, .bit_width = BitWidth, .sample_rate = sample_rate};
+    for (auto channel_id : channel_ids) {
+      payload.channels.push_back({.channel_id = channel_id, .channel_data = std::vector<uint64_t>(samples_per_channel)});
+    }
+    NDTPMessage message{
+        .header = NDTPHeader{.data_type = synapse::DataType::kBroadband, .timestamp = 0, .seq_number = 0},
+        .payload = payload
+    };
+    template_ = message.pack();
+
+    size_t bit = (NDTPHeader::NDTP_HEADER_SIZE + PAYLOAD_HEADER_SIZE) * 8;
+    for (size_t c = 0; c < channel_ids.size(); c++) {
+      ChannelLayout layout;
+      layout.header_bit = bit;
+      bit += CHANNEL_HEADER_BITS;
+
+      // single values up to the first byte boundary, then whole groups, then the rest
+      layout.head_bit = bit;
+      layout.head_count = 0;
+      while (layout.head_count < samples_per_channel && (bit + layout.head_count * BitWidth) % 8 > 0) {
+        layout.head_count++;
+      }
+      size_t aligned_bit = bit + layout.head_count * BitWidth;
+      layout.group_byte = aligned_bit / 8;
+      layout.group_count = (samples_per_channel - layout.head_count) / GROUP_SIZE;
+      layout.tail_bit = aligned_bit + layout.group_count * GROUP_SIZE * BitWidth;
+      layout.tail_count = samples_per_channel - layout.head_count - layout.group_count * GROUP_SIZE;
+
+      layouts_.push_back(layout);
+      bit += samples_per_channel * BitWidth;
+    }
+  }
+
+  const std::vector<uint32_t>& channel_ids() const { return channel_ids_; }
+
+  uint16_t samples_per_channel() const { return samples_per_channel_; }
+
+  size_t samples_per_packet() const { return channel_ids_.size() * samples_per_channel_; }
+
+  // Size in bytes of every encoded message, including the header and CRC16.
+  size_t packet_size() const { return template_.size(); }
+
+  // Encodes one message into `dst`, returning the number of bytes written (packet_size()).
+  size_t pack(uint64_t timestamp, uint16_t seq_number, const SampleT* samples, uint8_t* dst, size_t capacity) const {
+    if (capacity < template_.size()) {
+      throw std::runtime_error(
+          "buffer too small for NDTP message (expected " + std::to_string(template_.size()) + ", got " +
+          std::to_string(capacity) + ")"
+      );
+    }
+    std::memcpy(dst, template_.data(), template_.size());
+
+    uint64_t n_timestamp = htonll(timestamp);
+    std::memcpy(dst + TIMESTAMP_OFFSET, &n_timestamp, sizeof(n_timestamp));
+    uint16_t n_seq_number = htons(seq_number);
+    std::memcpy(dst + SEQ_NUMBER_OFFSET, &n_seq_number, sizeof(n_seq_number));
+
+    for (size_t c = 0; c < layouts_.size(); c++) {
+      const ChannelLayout& layout = layouts_[c];
+      const SampleT* values = samples + c * samples_per_channel_;
+
+      for (size_t i = 0; i < layout.head_count; i++) {
+        put_value(dst, layout.head_bit + i * BitWidth, field(*values++));
+      }
+      uint8_t* group = dst + layout.group_byte;
+      for (size_t g = 0; g < layout.group_count; g++) {
+        put_group(group, values, std::make_index_sequence<GROUP_SIZE>());
+        group += GROUP_BYTES;
+        values += GROUP_SIZE;
+      }
+      for (size_t i = 0; i < layout.tail_count; i++) {
+        put_value(dst, layout.tail_bit + i * BitWidth, field(*values++));
+      }
+    }
+
+    crc16_append(dst, template_.size() - 2);
+    return template_.size();
+  }
+
+  ByteArray pack(uint64_t timestamp, uint16_t seq_number, const SampleT* samples) const {
+    ByteArray packet(template_.size());
+    pack(timestamp, seq_number, samples, packet.data(), packet.size());
+    return packet;
+  }
+
+  // Decodes a message with this configuration into `samples`, returning its header. Throws if the
+  // message does not match the configuration or fails CRC verification.
+  NDTPHeader unpack(const uint8_t* data, size_t size, SampleT* samples, bool ignore_crc = false) const {
+    if (size != template_.size()) {
+      throw std::runtime_error(
+          "NDTP message does not match codec layout (expected " + std::to_string(template_.size()) + " bytes, got " +
+          std::to_string(size) + ")"
+      );
+    }
+    size_t crc_offset = size - 2;
+    uint16_t received_crc = data[crc_offset] << 8 | data[crc_offset + 1];
+    if (!ignore_crc && crc16(data, crc_offset) != received_crc) {
+      throw std::runtime_error("CRC verification failed (expected " + std::to_string(received_crc) + ")");
+    }
+
+    auto header = NDTPHeader::unpack(data, NDTPHeader::NDTP_HEADER_SIZE);
+    const uint8_t* fixed = template_.data() + NDTPHeader::NDTP_HEADER_SIZE;
+    if (header.data_type != synapse::DataType::kBroadband ||
+        std::memcmp(data + NDTPHeader::NDTP_HEADER_SIZE, fixed, PAYLOAD_HEADER_SIZE) != 0) {
+      throw std::runtime_error("NDTP message does not match codec configuration");
+    }
+
+    for (size_t c = 0; c < layouts_.size(); c++) {
+      const ChannelLayout& layout = layouts_[c];
+      if (get_value<CHANNEL_HEADER_BITS>(data, layout.header_bit) !=
+          ((static_cast<uint64_t>(channel_ids_[c]) << 16) | samples_per_channel_)) {
+        throw std::runtime_error("NDTP message channel layout does not match codec configuration");
+      }
+
+      SampleT* values = samples + c * samples_per_channel_;
+      for (size_t i = 0; i < layout.head_count; i++) {
+        *values++ = to_sample(get_value<BitWidth>(data, layout.head_bit + i * BitWidth));
+      }
+      const uint8_t* group = data + layout.group_byte;
+      for (size_t g = 0; g < layout.group_count; g++) {
+        get_group(group, values, std::make_index_sequence<GROUP_SIZE>());
+        group += GROUP_BYTES;
+        values += GROUP_SIZE;
+      }
+      for (size_t i = 0; i < layout.tail_count; i++) {
+        *values++ = to_sample(get_value<BitWidth>(data, layout.tail_bit + i * BitWidth));
+      }
+    }
+    return header;
+  }
+
+ private:
+  static constexpr size_t PAYLOAD_HEADER_SIZE = 7;
+  static constexpr uint8_t CHANNEL_HEADER_BITS = 24 + 16;
+  static constexpr size_t TIMESTAMP_OFFSET = 2;
+  static constexpr size_t SEQ_NUMBER_OFFSET = 10;
+  static constexpr uint64_t MASK = BitWidth == 64 ? ~0ULL : (1ULL << BitWidth) - 1;
+
+  static constexpr size_t gcd(size_t a, size_t b) { return b == 0 ? a : gcd(b, a % b); }
+
+  // Values per group, chosen so a group ends on a byte boundary, and the bytes it spans.
+  static constexpr size_t GROUP_SIZE = 8 / gcd(BitWidth, 8);
+  static constexpr size_t GROUP_BYTES = GROUP_SIZE * BitWidth / 8;
+
+  struct ChannelLayout {
+    size_t header_bit;
+    size_t head_bit;
+    size_t head_count;
+    size_t group_byte;
+    size_t group_count;
+    size_t tail_bit;
+    size_t tail_count;
+  };
+
+  static uint64_t field(SampleT sample) { return static_cast<uint64_t>(sample) & MASK; }
+
+  static SampleT to_sample(uint64_t value) {
+    if constexpr (Signed) {
+      return static_cast<SampleT>(static_cast<int64_t>(value << (64 - BitWidth)) >> (64 - BitWidth));
+    } else {
+      return static_cast<SampleT>(value);
+    }
+  }
+
+  // Byte j of a field whose last bit sits `shift` bits before the end of byte j (negative: after it).
+  template <int Shift>
+  static uint8_t byte_of(uint64_t value) {
+    if constexpr (Shift >= 0) {
+      return static_cast<uint8_t>(value << Shift);
+    } else {
+      return static_cast<uint8_t>(value >> -Shift);
+    }
+  }
+
+  template <int Shift>
+  static uint64_t from_byte(uint8_t byte) {
+    if constexpr (Shift >= 0) {
+      return static_cast<uint64_t>(byte) >> Shift;
+    } else {
+      return static_cast<uint64_t>(byte) << -Shift;
+    }
+  }
+
+  static constexpr size_t first_byte(size_t k) { return k * BitWidth / 8; }
+
+  static constexpr size_t byte_span(size_t k) { return (k * BitWidth + BitWidth - 1) / 8 - first_byte(k) + 1; }
+
+  static constexpr int shift_of(size_t k, size_t byte) {
+    return static_cast<int>(8 * byte + 8) - static_cast<int>(k * BitWidth + BitWidth);
+  }
+
+  template <size_t K, size_t... J>
+  static void put_group_value(uint8_t* out, uint64_t value, std::index_sequence<J...>) {
+    ((out[first_byte(K) + J] |= byte_of<shift_of(K, first_byte(K) + J)>(value)), ...);
+  }
+
+  template <size_t... K>
+  static void put_group(uint8_t* out, const SampleT* values, std::index_sequence<K...>) {
+    (put_group_value<K>(out, field(values[K]), std::make_index_sequence<byte_span(K)>()), ...);
+  }
+
+  template <size_t K, size_t... J>
+  static SampleT get_group_value(const uint8_t* in, std::index_sequence<J...>) {
+    return to_sample((from_byte<shift_of(K, first_byte(K) + J)>(in[first_byte(K) + J]) | ...) & MASK);
+  }
+
+  template <size_t... K>
+  static void get_group(const uint8_t* in, SampleT* values, std::index_sequence<K...>) {
+    ((values[K] = get_group_value<K>(in, std::make_index_sequence<byte_span(K)>())), ...);
+  }
+
+  // Single values at an arbitrary bit offset, for the unaligned head and tail of a channel.
+  static void put_value(uint8_t* out, size_t bit, uint64_t value) {
+    for (size_t byte = bit / 8; byte <= (bit + BitWidth - 1) / 8; byte++) {
+      int64_t shift = static_cast<int64_t>(8 * byte + 8) - static_cast<int64_t>(bit + BitWidth);
+      out[byte] |= shift >= 0 ? static_cast<uint8_t>(value << shift) : static_cast<uint8_t>(value >> -shift);
+    }
+  }
+
+  template <uint8_t Width>
+  static uint64_t get_value(const uint8_t* in, size_t bit) {
+    uint64_t value = 0;
+    for (size_t byte = bit / 8; byte <= (bit + Width - 1) / 8; byte++) {
+      int64_t shift = static_cast<int64_t>(8 * byte + 8) - static_cast<int64_t>(bit + Width);
+      value |= shift >= 0 ? static_cast<uint64_t>(in[byte]) >> shift : static_cast<uint64_t>(in[byte]) << -shift;
+    }
+    return Width == 64 ? value : value & ((1ULL << Width) - 1);
+  }
+
+  std::vector<uint32_t> channel_ids_;
+  uint16_t samples_per_channel_;
+  std::vector<ChannelLayout> layouts_;
+  ByteArray template_;
+};
+
+}  // namespace science::libndtp
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace science::libndtp {
+
+/**
+ * Crc16State computes the NDTP CRC16 (CRC-16/ARC: reflected polynomial 0x8005, zero initial value,
+ * no final XOR) incrementally, so an encoder can fold in the header and payload as it writes them.
+ *
+ * Large updates use carry-less multiplication (PCLMULQDQ) when the CPU supports it and slice-by-8
+ * tables otherwise; both give the same result.
+ */
+class Crc16State {
+ public:
+  void update(const uint8_t* data, size_t size);
+
+  uint16_t value() const { return crc_; }
+
+  void reset() { crc_ = 0; }
+
+ private:
+  uint16_t crc_ = 0;
+};
+
+inline uint16_t crc16(const uint8_t* data, size_t size) {
+  Crc16State state;
+  state.update(data, size);
+  return state.value();
+}
+
+// Writes the big-endian CRC16 of the `size` bytes at `data` to the two bytes that follow them,
+// as NDTP messages end, and returns it.
+inline uint16_t crc16_append(uint8_t* data, size_t size) {
+  uint16_t crc = crc16(data, size);
+  data[size] = (crc >> 8) & 0xFF;
+  data[size + 1] = crc & 0xFF;
+  return crc;
+}
+
+// Checks `data` against an expected CRC16.
+inline bool crc16_verify(const uint8_t* data, size_t size, uint16_t crc) {
+  return crc16(data, size) == crc;
+}
+
+// Checks a buffer whose last two bytes hold the big-endian CRC16 of the bytes before them.
+inline bool crc16_verify(const uint8_t* data, size_t size) {
+  if (size < 2) {
+    return false;
+  }
+  return crc16_verify(data, size - 2, static_cast<uint16_t>(data[size - 2] << 8 | data[size - 1]));
+}
+
+}  // namespace science::libndtp
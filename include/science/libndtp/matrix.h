@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include "science/libndtp/crc16.h"
+#include "science/libndtp/ndtp.h"
+#include "science/libndtp/utils.h"
+
+namespace science::libndtp {
+
+/**
+ * What a broadband packet decoded into a BroadbandSampleMatrix contained. Rows [0, n_channels)
+ * of the matrix were written; row i holds sample_counts[i] samples of channel channel_ids[i].
+ */
+struct BroadbandMatrixInfo {
+  NDTPHeader header{};  // set when a whole message was decoded
+  bool is_signed = false;
+  uint8_t bit_width = 0;
+  uint32_t sample_rate = 0;
+  size_t n_channels = 0;
+  size_t n_samples = 0;  // longest run among the channels
+};
+
+/**
+ * BroadbandSampleMatrix decodes broadband packets straight into a caller-owned dense matrix of
+ * samples, with one row per channel in packet order, instead of one vector per channel.
+ *
+ * In channel-major layout a channel's samples are contiguous and rows start `stride` elements
+ * apart (max_samples when 0); in sample-major layout the samples of all channels for one instant
+ * are contiguous and instants start `stride` elements apart (max_channels when 0). The channel id
+ * and sample count of each row go into the `channel_ids` and (optional) `sample_counts` arrays,
+ * which hold max_channels entries. Elements past a row's sample count are left untouched.
+ *
+ * Nothing is allocated, so one matrix can take packet after packet in a receive loop and hand
+ * them to DSP code as is.
+ */
+template <typename T>
+struct BroadbandSampleMatrix {
+  enum class Layout { kChannelMajor, kSampleMajor };
+
+  T* samples;
+  size_t max_channels;
+  size_t max_samples;
+  uint32_t* channel_ids;
+  uint16_t* sample_counts = nullptr;
+  Layout layout = Layout::kChannelMajor;
+  size_t stride = 0;
+
+  T& at(size_t channel, size_t sample) const {
+    return samples[channel * channel_stride() + sample * sample_stride()];
+  }
+
+  // Distance in elements between consecutive channels, and between consecutive samples of a channel.
+  size_t channel_stride() const {
+    return layout == Layout::kChannelMajor ? (stride ? stride : max_samples) : 1;
+  }
+  size_t sample_stride() const {
+    return layout == Layout::kChannelMajor ? 1 : (stride ? stride : max_channels);
+  }
+
+  // Decodes a broadband payload (without the NDTP header and CRC). Throws if it is malformed or
+  // does not fit the matrix.
+  BroadbandMatrixInfo unpack_payload(const uint8_t* data, size_t size) const {
+    if ((layout == Layout::kChannelMajor && stride != 0 && stride < max_samples) ||
+        (layout == Layout::kSampleMajor && stride != 0 && stride < max_channels)) {
+      throw std::invalid_argument("sample matrix stride " + std::to_string(stride) + " is too small for its rows");
+    }
+    if (size < 7) {
+      throw std::runtime_error("Invalid data size for NDTPPayloadBroadband");
+    }
+    BroadbandMatrixInfo info;
+    info.bit_width = data[0] >> 1;
+    info.is_signed = (data[0] & 1) == 1;
+    info.n_channels = (data[1] << 16) | (data[2] << 8) | data[3];
+    info.sample_rate = (data[4] << 16) | (data[5] << 8) | data[6];
+    if (info.bit_width < 1 || info.bit_width > 64) {
+      throw std::runtime_error("invalid bit width for NDTPPayloadBroadband: " + std::to_string(info.bit_width));
+    }
+    check_broadband_sample_type<T>(info.bit_width, info.is_signed);
+    if (info.n_channels > max_channels) {
+      throw std::runtime_error(
+        "broadband payload has " + std::to_string(info.n_channels) + " channels, the sample matrix holds " +
+        std::to_string(max_channels)
+      );
+    }
+
+    BitReader reader(data + 7, size - 7);
+    for (size_t c = 0; c < info.n_channels; ++c) {
+      if (reader.bits_remaining() < 24 + 16) {
+        throw std::runtime_error("insufficient data for channel header in NDTPPayloadBroadband");
+      }
+      channel_ids[c] = reader.read(24);
+      auto n_samples = static_cast<uint16_t>(reader.read(16));
+      if (n_samples > max_samples) {
+        throw std::runtime_error(
+          "broadband channel has " + std::to_string(n_samples) + " samples, the sample matrix holds " +
+          std::to_string(max_samples)
+        );
+      }
+      if (sample_counts) {
+        sample_counts[c] = n_samples;
+      }
+      info.n_samples = std::max<size_t>(info.n_samples, n_samples);
+
+      T* row = samples + c * channel_stride();
+      if (sample_stride() == 1) {
+        reader.read(row, n_samples, info.bit_width, info.is_signed);
+        continue;
+      }
+      // strided rows decode through a small block on the stack so the bulk kernels still apply
+      constexpr size_t BLOCK = 256;
+      T block[BLOCK];
+      for (size_t i = 0; i < n_samples; i += BLOCK) {
+        size_t n = std::min<size_t>(BLOCK, n_samples - i);
+        reader.read(block, n, info.bit_width, info.is_signed);
+        T* dst = row + i * sample_stride();
+        for (size_t j = 0; j < n; ++j) {
+          dst[j * sample_stride()] = block[j];
+        }
+      }
+    }
+    return info;
+  }
+
+  // Decodes a whole broadband NDTP message, verifying its CRC16 unless `ignore_crc`. Only the
+  // plain encoding is decoded; delta broadband (kBroadband | NDTP_DATA_TYPE_COMPRESSED) is
+  // rejected, since it needs full width scratch per channel, and decodes with
+  // ElectricalBroadbandData::unpack instead.
+  BroadbandMatrixInfo unpack(const uint8_t* data, size_t size, bool ignore_crc = false) const {
+    if (size < NDTPHeader::NDTP_HEADER_SIZE + NDTPMessage::NDTP_CRC_SIZE) {
+      throw std::runtime_error("invalid data size for NDTPMessage");
+    }
+    if (!ignore_crc && !crc16_verify(data, size)) {
+      throw std::runtime_error("CRC verification failed");
+    }
+    auto header = NDTPHeader::unpack(data, NDTPHeader::NDTP_HEADER_SIZE);
+    if (header.data_type == (synapse::DataType::kBroadband | NDTP_DATA_TYPE_COMPRESSED)) {
+      throw std::runtime_error("compressed broadband is not supported by BroadbandSampleMatrix");
+    }
+    if (header.data_type != synapse::DataType::kBroadband) {
+      throw std::runtime_error("NDTP message is not broadband data (data type " + std::to_string(header.data_type) + ")");
+    }
+    auto info = unpack_payload(
+      data + NDTPHeader::NDTP_HEADER_SIZE, size - NDTPHeader::NDTP_HEADER_SIZE - NDTPMessage::NDTP_CRC_SIZE
+    );
+    info.header = header;
+    return info;
+  }
+};
+
+}  // namespace science::libndtp
@@ -2,7 +2,10 @@
 #pragma once
 
 #include <cstdint>
+#include <limits>
 #include <stdexcept>
+#include <string>
+#include <type_traits>
 #include <variant>
 #include <vector>
 #include "science/libndtp/utils.h"
@@ -18,6 +21,19 @@ namespace science::libndtp {
 
 static constexpr uint8_t NDTP_VERSION = 0x01;
 
+// NDTP header timestamps count microseconds.
+static constexpr uint64_t NDTP_TIMESTAMP_TICKS_PER_SECOND = 1000000;
+
+// Set in the header data type of a message whose payload uses a compressed encoding, e.g.
+// kBroadband | NDTP_DATA_TYPE_COMPRESSED for NDTPPayloadBroadbandDelta.
+static constexpr uint8_t NDTP_DATA_TYPE_COMPRESSED = 0x80;
+
+// The stream a message of `data_type` belongs to. A compressed encoding is one stream, with one
+// sequence of seq_numbers, together with the plain encoding of the same data type.
+constexpr uint8_t stream_data_type(uint8_t data_type) {
+  return data_type & ~NDTP_DATA_TYPE_COMPRESSED;
+}
+
 /**
  * NDTPHeader represents the header of an NDTP message.
  */
@@ -30,7 +46,12 @@ struct NDTPHeader {
   uint16_t seq_number;
 
   ByteArray pack() const;
+
+  // Serializes the header into `dst`, which must hold at least NDTP_HEADER_SIZE bytes; returns the bytes written.
+  size_t pack_into(uint8_t* dst, size_t cap) const;
+
   static NDTPHeader unpack(const ByteArray& data);
+  static NDTPHeader unpack(const uint8_t* data, size_t size);
 
   bool operator==(const NDTPHeader& other) const {
     return data_type == other.data_type &&
@@ -40,6 +61,21 @@ struct NDTPHeader {
   bool operator!=(const NDTPHeader& other) const { return !(*this == other); }
 };
 
+/**
+ * Throws std::runtime_error unless broadband samples of `bit_width` bits decode into T without
+ * truncation. A signed T spends a bit on the sign, which signed samples bring along.
+ */
+template <typename T>
+void check_broadband_sample_type(uint8_t bit_width, bool is_signed) {
+  int max_bit_width = std::numeric_limits<T>::digits + (is_signed && std::is_signed_v<T> ? 1 : 0);
+  if (bit_width > max_bit_width) {
+    throw std::runtime_error(
+      "NDTPPayloadBroadband samples of " + std::to_string(bit_width) + " bits (" + (is_signed ? "signed" : "unsigned") +
+      ") do not fit a " + std::to_string(sizeof(T) * 8) + "-bit sample type"
+    );
+  }
+}
+
 /**
  * NDTPPayloadBroadband represents broadband payload data.
  */
@@ -64,7 +100,16 @@ struct GenericNDTPPayloadBroadband {
   uint32_t sample_rate;  // 2 bytes
   std::vector<ChannelData> channels;
 
-  static GenericNDTPPayloadBroadband<uint64_t> unpack(const ByteArray& data);
+  // Decodes a payload with samples stored as T, which must be wide enough for the bit width
+  // (including the sign bit for unsigned samples in a signed T). Instantiated for the 8- to 64-bit
+  // integer types; uint64_t keeps signed samples as their two's complement bit pattern.
+  static GenericNDTPPayloadBroadband unpack(const ByteArray& data);
+  static GenericNDTPPayloadBroadband unpack(const uint8_t* data, size_t size);
+
+  // Decodes a payload into `out`, overwriting it in place. The channel and sample vectors keep
+  // their capacity, so decoding packets of the same shape again and again stops allocating. If
+  // decoding throws, `out` is left valid but unspecified.
+  static void unpack_into(const uint8_t* data, size_t size, GenericNDTPPayloadBroadband& out);
 
   bool operator==(const GenericNDTPPayloadBroadband& other) const {
     return is_signed == other.is_signed &&
@@ -75,48 +120,124 @@ struct GenericNDTPPayloadBroadband {
 
   bool operator!=(const GenericNDTPPayloadBroadband& other) const { return !(*this == other); }
 
-  ByteArray pack() const {
-    ByteArray payload;
+  // Exact number of bytes pack() produces: the fixed fields plus the bit-packed channel data.
+  size_t encoded_size() const {
+    size_t bits = 0;
+    for (const auto& c : channels) {
+      bits += 24 + 16 + c.channel_data.size() * bit_width;
+    }
+    return FIXED_SIZE + (bits + 7) / 8;
+  }
 
-    // First byte: bit width and signed flag
-    payload.push_back(((bit_width & 0x7F) << 1) | (is_signed ? 1 : 0));
+  ByteArray pack() const {
+    ByteArray payload(encoded_size());
+    pack_into(payload.data(), payload.size());
+    return payload;
+  }
 
-    // Next three bytes: number of channels
-    uint32_t n_channels = channels.size();
-    payload.push_back((n_channels >> 16) & 0xFF);
-    payload.push_back((n_channels >> 8) & 0xFF);
-    payload.push_back((n_channels) & 0xFF);
+  // Serializes the payload into a caller-owned buffer of `cap` bytes without allocating, and
+  // returns the bytes written (encoded_size()). Throws if the buffer is too small.
+  size_t pack_into(uint8_t* dst, size_t cap) const {
+    size_t size = encoded_size();
+    if (cap < size) {
+      throw std::runtime_error(
+        "insufficient buffer for NDTPPayloadBroadband (expected " + std::to_string(size) +
+        ", got " + std::to_string(cap) + ")"
+      );
+    }
+    if (!channels.empty() && (bit_width < 1 || bit_width > 64)) {
+      throw std::invalid_argument("invalid bit width for NDTPPayloadBroadband: " + std::to_string(bit_width));
+    }
 
-    // Next three bytes: sample rate
-    uint32_t n_sample_rate = sample_rate;
-    payload.push_back((n_sample_rate >> 16) & 0xFF);
-    payload.push_back((n_sample_rate >> 8) & 0xFF);
-    payload.push_back(n_sample_rate & 0xFF);
+    pack_fields(dst, is_signed, bit_width, channels.size(), sample_rate);
 
-    size_t bit_offset = 0;
+    // channel headers and samples form one continuous bit stream
+    BitWriter writer(dst + FIXED_SIZE, size - FIXED_SIZE);
     for (const auto& c : channels) {
-      size_t num_samples = c.channel_data.size();
-      if (num_samples > 0xFFFF) {
-        throw std::runtime_error("number of samples is too large, must be less than 65536");
-      }
+      pack_run(writer, c.channel_id, c.channel_data.data(), c.channel_data.size(), bit_width);
+    }
+    writer.finish();
 
-      auto p_cid = to_bytes<uint32_t>({c.channel_id}, 24, payload, bit_offset);
-      bit_offset = std::get<1>(p_cid);
+    return size;
+  }
 
-      auto p_num_samples = to_bytes<uint16_t>({static_cast<uint16_t>(num_samples)}, 16, payload, bit_offset);
-      bit_offset = std::get<1>(p_num_samples);
+  // Bytes of fixed fields in front of the channel runs.
+  static constexpr size_t FIXED_SIZE = 7;
+
+  // Writes the fixed fields: bit width and signed flag (1 byte), channel count and sample rate
+  // (3 bytes each). Together with pack_run() this is the whole encoding, for encoders that lay
+  // out the channel runs of a payload themselves.
+  static void pack_fields(uint8_t* dst, bool is_signed, uint8_t bit_width, uint32_t n_channels, uint32_t sample_rate) {
+    dst[0] = ((bit_width & 0x7F) << 1) | (is_signed ? 1 : 0);
+    dst[1] = (n_channels >> 16) & 0xFF;
+    dst[2] = (n_channels >> 8) & 0xFF;
+    dst[3] = n_channels & 0xFF;
+    dst[4] = (sample_rate >> 16) & 0xFF;
+    dst[5] = (sample_rate >> 8) & 0xFF;
+    dst[6] = sample_rate & 0xFF;
+  }
 
-      auto p_channel_data = to_bytes<T>(c.channel_data, bit_width, payload, bit_offset, is_signed);
-      bit_offset = std::get<1>(p_channel_data);
+  // Writes one channel run: the 24-bit channel id, the 16-bit sample count and the samples.
+  static void pack_run(BitWriter& writer, uint32_t channel_id, const T* samples, size_t n_samples, uint8_t bit_width) {
+    if (n_samples > 0xFFFF) {
+      throw std::runtime_error("number of samples is too large, must be less than 65536");
     }
-
-    return payload;
+    writer.write(channel_id, 24);
+    writer.write(n_samples, 16);
+    writer.write(samples, n_samples, bit_width);
   }
 
 };
 
 typedef GenericNDTPPayloadBroadband<uint64_t> NDTPPayloadBroadband;
 
+/**
+ * NDTPPayloadBroadbandDelta carries the same samples as NDTPPayloadBroadband in a compressed
+ * encoding for slowly changing signals, sent with data type kBroadband | NDTP_DATA_TYPE_COMPRESSED.
+ *
+ * After the same 7 fixed bytes, each channel stores its 3 byte id, 2 byte sample count and first
+ * sample (a big-endian integer of (bit_width + 7) / 8 bytes), followed by the differences between
+ * consecutive samples. Each difference is wrapped to the bit width and zigzag mapped (0, -1, 1,
+ * -2, ... to 0, 1, 2, 3, ...), and the codes are stored in blocks of BLOCK_SIZE: a width byte just
+ * large enough for the block's largest code, then the codes bit-packed MSB first at that width,
+ * padded to a whole byte. A code is never wider than the samples, and every block starts on a byte
+ * boundary, which lets each width have its own unrolled packing routine.
+ */
+struct NDTPPayloadBroadbandDelta {
+  static constexpr size_t BLOCK_SIZE = 32;
+
+  using ChannelData = NDTPPayloadBroadband::ChannelData;
+
+  bool is_signed;
+  uint8_t bit_width;
+  uint32_t sample_rate;
+  std::vector<ChannelData> channels;  // signed samples are sign extended, as in NDTPPayloadBroadband
+
+  // Exact number of bytes pack() produces.
+  size_t encoded_size() const;
+
+  ByteArray pack() const;
+
+  // Serializes the payload into a caller-owned buffer; returns the bytes written (encoded_size()),
+  // and leaves the rest of the buffer untouched. The exact size is only computed when `cap` could
+  // not hold every block at the full bit width.
+  size_t pack_into(uint8_t* dst, size_t cap) const;
+
+  static NDTPPayloadBroadbandDelta unpack(const ByteArray& data);
+  static NDTPPayloadBroadbandDelta unpack(const uint8_t* data, size_t size);
+
+  // Decodes into `out` in place, keeping its vectors' capacity (see NDTPPayloadBroadband::unpack_into).
+  static void unpack_into(const uint8_t* data, size_t size, NDTPPayloadBroadbandDelta& out);
+
+  bool operator==(const NDTPPayloadBroadbandDelta& other) const {
+    return is_signed == other.is_signed &&
+            bit_width == other.bit_width &&
+            sample_rate == other.sample_rate &&
+            channels == other.channels;
+  }
+  bool operator!=(const NDTPPayloadBroadbandDelta& other) const { return !(*this == other); }
+};
+
 /**
  * NDTPPayloadSpiketrain represents spiketrain payload data.
  */
@@ -126,8 +247,19 @@ struct NDTPPayloadSpiketrain {
   uint8_t bin_size_ms;                // 2 bits
   std::vector<uint8_t> spike_counts;  // 2 bits
 
+  // Exact number of bytes pack() produces.
+  size_t encoded_size() const;
+
   ByteArray pack() const;
+
+  // Serializes the payload into a caller-owned buffer; returns the bytes written (encoded_size()).
+  size_t pack_into(uint8_t* dst, size_t cap) const;
+
   static NDTPPayloadSpiketrain unpack(const ByteArray& data);
+  static NDTPPayloadSpiketrain unpack(const uint8_t* data, size_t size);
+
+  // Decodes into `out` in place, keeping the capacity of its spike counts.
+  static void unpack_into(const uint8_t* data, size_t size, NDTPPayloadSpiketrain& out);
 
   bool operator==(const NDTPPayloadSpiketrain& other) const {
     return spike_counts == other.spike_counts &&
@@ -136,23 +268,113 @@ struct NDTPPayloadSpiketrain {
   bool operator!=(const NDTPPayloadSpiketrain& other) const { return !(*this == other); }
 };
 
+/**
+ * NDTPPayloadSpiketrainSparse carries the same spike counts as NDTPPayloadSpiketrain as a list of
+ * the non-zero bins, sent with data type kSpiketrain | NDTP_DATA_TYPE_COMPRESSED.
+ *
+ * After the 4 byte bin count and the bin size comes a 4 byte entry count, then one bit-packed
+ * entry per non-zero bin in ascending order: the bin index in index_bits() bits followed by the
+ * count in BIT_WIDTH_BINNED_SPIKES bits (clamped, as in the dense encoding). It is smaller than
+ * the dense encoding whenever fewer than about 4 / (index_bits() + 4) of the bins are non-zero.
+ *
+ * The bin count is capped at MAX_BINS: a few bytes of payload can claim any number of empty bins,
+ * and decoding allocates one byte per bin.
+ */
+struct NDTPPayloadSpiketrainSparse {
+  static constexpr uint8_t BIT_WIDTH_BINNED_SPIKES = NDTPPayloadSpiketrain::BIT_WIDTH_BINNED_SPIKES;
+  static constexpr uint32_t MAX_BINS = 1 << 20;
+
+  uint8_t bin_size_ms;
+  std::vector<uint8_t> spike_counts;  // dense, one count per bin
+
+  // Bits used for a bin index in a payload of `n_bins` bins.
+  static uint8_t index_bits(size_t n_bins) {
+    return n_bins <= 2 ? 1 : 64 - __builtin_clzll(n_bins - 1);
+  }
+
+  // Exact number of bytes pack() produces.
+  size_t encoded_size() const;
+
+  ByteArray pack() const;
+
+  // Serializes the payload into a caller-owned buffer; returns the bytes written (encoded_size()).
+  size_t pack_into(uint8_t* dst, size_t cap) const;
+
+  static NDTPPayloadSpiketrainSparse unpack(const ByteArray& data);
+  static NDTPPayloadSpiketrainSparse unpack(const uint8_t* data, size_t size);
+
+  // Decodes into `out` in place, keeping the capacity of its spike counts.
+  static void unpack_into(const uint8_t* data, size_t size, NDTPPayloadSpiketrainSparse& out);
+
+  bool operator==(const NDTPPayloadSpiketrainSparse& other) const {
+    return spike_counts == other.spike_counts &&
+            bin_size_ms == other.bin_size_ms;
+  }
+  bool operator!=(const NDTPPayloadSpiketrainSparse& other) const { return !(*this == other); }
+};
+
+// Outcome of decoding one datagram with NDTPMessage::unpack_batch.
+enum class NDTPUnpackStatus : uint8_t {
+  kOk,
+  kTooShort,          // smaller than a header and CRC16
+  kCrcMismatch,
+  kUnsupportedHeader, // unknown version or data type
+  kMalformedPayload,  // the payload contradicts its own framing
+};
+
 /**
  * NDTPMessage represents a complete NDTP message, including header and payload.
  */
 struct NDTPMessage {
+  static constexpr size_t NDTP_CRC_SIZE = 2;
+
   NDTPHeader header;
-  std::variant<NDTPPayloadBroadband, NDTPPayloadSpiketrain> payload;
+  std::variant<NDTPPayloadBroadband, NDTPPayloadSpiketrain, NDTPPayloadBroadbandDelta, NDTPPayloadSpiketrainSparse> payload;
   uint16_t _crc16;
 
   // Packs the entire message into a byte array, calculating the CRC16.
   ByteArray pack();
 
+  // Exact number of bytes pack() produces: header, payload and CRC16.
+  size_t encoded_size() const;
+
+  // Packs the entire message into a caller-owned buffer (e.g. a registered send buffer) without
+  // allocating, calculating the CRC16. Returns the bytes written; throws if `cap` is too small.
+  size_t pack_into(uint8_t* dst, size_t cap);
+
   // Unpacks the entire message from a byte array, verifying the CRC16.
   static NDTPMessage unpack(const ByteArray& data, bool ignore_crc = false);
 
+  // Unpacks the entire message in place from a raw buffer (e.g. a receive buffer), verifying the CRC16.
+  // The buffer is not copied; only the decoded payload allocates.
+  static NDTPMessage unpack(const uint8_t* data, size_t size, bool ignore_crc = false);
+
+  // Unpacks a message into `out` in place, verifying the CRC16. The payload is only replaced by a
+  // new alternative when the data type changes; otherwise its vectors are decoded into, keeping
+  // their capacity, so a receiver that reuses one message for a steady stream does not allocate.
+  static void unpack_into(const uint8_t* data, size_t size, NDTPMessage& out, bool ignore_crc = false);
+
+  /**
+   * Decodes `count` datagrams (e.g. one recvmmsg batch) into the caller's out[0, count), setting
+   * statuses[i] for each instead of throwing; out[i] is decoded in place as by unpack_into and only
+   * meaningful when statuses[i] is kOk. Returns the number decoded.
+   *
+   * Datagrams are taken a few at a time: the framing and CRC of every datagram in a group are
+   * checked first, one after another, and the group is then decoded while it is still in L1.
+   * `out` and `statuses` can be kept and reused across batches, so a steady stream decodes
+   * without allocating.
+   */
+  static size_t unpack_batch(
+    const ByteSpan* datagrams, size_t count, NDTPMessage* out, NDTPUnpackStatus* statuses, bool ignore_crc = false
+  );
+
  private:
+  // Decodes a framed message into `out` once its CRC is checked.
+  static void unpack_checked(const uint8_t* data, size_t size, uint16_t crc, NDTPMessage& out);
+
   // Verifies CRC16 checksum.
   static bool crc16_verify(const ByteArray& data, uint16_t crc);
+  static bool crc16_verify(const uint8_t* data, size_t size, uint16_t crc);
 };
 
 }  // namespace science::libndtp
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "science/libndtp/ndtp.h"
+#include "science/libndtp/utils.h"
+
+#ifdef __linux__
+#include <sys/uio.h>
+#endif
+
+namespace science::libndtp {
+
+/**
+ * PacketBatch holds a sequence of encoded NDTP packets back to back in one contiguous slab, with
+ * an offset table marking where each packet starts.
+ *
+ * clear() keeps the slab and the offset table, so a batch reused across calls stops allocating once
+ * it has grown to the largest batch seen. Spans and iovecs point into the slab and stay valid until
+ * the next append or clear.
+ */
+class PacketBatch {
+ public:
+  PacketBatch() = default;
+
+  // Preallocates room for `slab_bytes` bytes of packets and `n_packets` offsets.
+  PacketBatch(size_t slab_bytes, size_t n_packets) { reserve(slab_bytes, n_packets); }
+
+  void reserve(size_t slab_bytes, size_t n_packets);
+
+  // Drops all packets, keeping the memory for reuse.
+  void clear() {
+    offsets_.resize(1);
+  }
+
+  // Returns a buffer of at least `max_size` bytes at the end of the slab for the next packet,
+  // which becomes part of the batch once commit() is called with the bytes actually written.
+  uint8_t* prepare(size_t max_size);
+  void commit(size_t size);
+
+  // Encodes `message` at the end of the slab; returns the packet size.
+  size_t append(NDTPMessage& message);
+
+  // Copies an already encoded packet into the batch.
+  void append(const uint8_t* data, size_t size);
+
+  // Adds `n` packets of the given sizes with their bytes left to the caller, and returns where the
+  // first one starts; the rest follow back to back. Distinct packets can be filled in from
+  // different threads.
+  uint8_t* append_uninitialized(const size_t* sizes, size_t n);
+
+  size_t size() const { return offsets_.size() - 1; }
+  bool empty() const { return size() == 0; }
+
+  ByteSpan operator[](size_t i) const {
+    return ByteSpan{slab_.data() + offsets_[i], offsets_[i + 1] - offsets_[i]};
+  }
+
+  ByteSpan at(size_t i) const {
+    if (i >= size()) {
+      throw std::out_of_range("packet index " + std::to_string(i) + " out of range (size: " + std::to_string(size()) + ")");
+    }
+    return (*this)[i];
+  }
+
+  // Start of each packet in the slab, followed by the end of the last one (size() + 1 entries).
+  const std::vector<size_t>& offsets() const { return offsets_; }
+
+  // The packets as one contiguous byte range.
+  const uint8_t* data() const { return slab_.data(); }
+  size_t bytes() const { return offsets_.back(); }
+
+#ifdef __linux__
+  // Describes packets [first, first + count) as iovecs for scatter/gather send APIs (e.g. one
+  // iovec per mmsghdr for sendmmsg); returns the number of entries filled.
+  size_t to_iovecs(iovec* iov, size_t count, size_t first = 0) const;
+#endif
+
+ private:
+  ByteArray slab_;
+  std::vector<size_t> offsets_ = {0};
+};
+
+}  // namespace science::libndtp
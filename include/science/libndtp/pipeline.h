@@ -0,0 +1,170 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "science/libndtp/ndtp.h"
+#include "science/libndtp/spsc_ring.h"
+#include "science/libndtp/stream.h"
+#include "science/libndtp/utils.h"
+
+namespace science::libndtp {
+
+/**
+ * Settings for NDTPDecodePipeline.
+ */
+struct NDTPPipelineOptions {
+  enum class Overflow {
+    kBlock,  // wait for the worker to make room, pushing back on the receive path
+    kDrop,   // drop the datagram and count it
+  };
+
+  size_t n_workers = 1;
+  size_t queue_capacity = 1024;  // per worker, in datagrams; rounded up to a power of two
+  Overflow overflow = Overflow::kBlock;
+  size_t reorder_window = 0;      // per stream, as in NDTPStreamDecoder
+  size_t max_datagram_size = 2048;
+
+  // CPU cores to pin threads to (Linux only); -1 or an empty list leaves them unpinned. Worker i
+  // runs on worker_cores[i % worker_cores.size()].
+  int receive_core = -1;
+  std::vector<int> worker_cores;
+  int sequencer_core = -1;
+};
+
+/**
+ * Counters kept by NDTPDecodePipeline. Datagrams that are received but neither queued nor dropped
+ * were held back or discarded by sequencing (invalid headers, duplicates, late packets, or still
+ * waiting in a reorder window).
+ */
+struct NDTPPipelineStats {
+  uint64_t received = 0;   // datagrams submitted
+  uint64_t queued = 0;     // datagrams handed to a decode worker
+  uint64_t dropped = 0;    // datagrams dropped because the worker queue was full
+  uint64_t invalid = 0;    // queued datagrams that failed to decode
+  uint64_t delivered = 0;  // messages passed to the consumer
+};
+
+/**
+ * NDTPDecodePipeline spreads NDTPMessage::unpack over several worker threads and hands the
+ * decoded messages to a consumer in per-stream sequence order.
+ *
+ * Datagrams come in on a single producer thread, either the pipeline's own receive thread
+ * (start()) or the caller's (submit()). The producer runs one NDTPStreamDecoder per stream data
+ * type (stream_data_type()) to put each stream in sequence order (without checking CRCs, which the
+ * workers do) and deals the datagrams out round robin into one lock-free SPSC ring per worker.
+ * Each worker decodes into its own output ring, and the sequencer thread collects the results in
+ * the same round robin order, which restores the order they were dealt in, before calling the
+ * consumer.
+ *
+ * All queues are bounded and preallocated. When a worker's queue is full the producer either
+ * waits or drops the datagram, as configured; workers always wait for the sequencer, so every
+ * queued datagram reaches the consumer or the invalid count.
+ */
+class NDTPDecodePipeline {
+ public:
+  using Consumer = std::function<void(NDTPMessage&&)>;
+
+  // Starts the workers and the sequencer, which calls `consumer` for every decoded message.
+  explicit NDTPDecodePipeline(Consumer consumer, NDTPPipelineOptions options = {});
+  ~NDTPDecodePipeline();
+
+  NDTPDecodePipeline(const NDTPDecodePipeline&) = delete;
+  NDTPDecodePipeline& operator=(const NDTPDecodePipeline&) = delete;
+
+  // Starts a receive thread that feeds every datagram from `receiver` (an NDTPUdpReceiver or
+  // NDTPUringReceiver, which must outlive the pipeline or stop()) into the pipeline. The thread
+  // checks for stop() every `poll_timeout_ms`. submit() must not be called after this.
+  template <typename Receiver>
+  void start(Receiver& receiver, int poll_timeout_ms = 10) {
+    if (receive_thread_.joinable() || stopped_) {
+      throw std::runtime_error("decode pipeline is already receiving or stopped");
+    }
+    receiving_.store(true, std::memory_order_relaxed);
+    receive_thread_ = std::thread([this, &receiver, poll_timeout_ms] {
+      try {
+        while (receiving_.load(std::memory_order_relaxed)) {
+          size_t n = receiver.receive(poll_timeout_ms);
+          for (size_t i = 0; i < n; ++i) {
+            ByteSpan datagram = receiver.datagram(i);
+            submit(datagram.data, datagram.size);
+          }
+        }
+      } catch (...) {
+        record_error(std::current_exception());
+      }
+    });
+    pin(receive_thread_, options_.receive_core);
+  }
+
+  // Feeds one datagram from the producer thread; the bytes are copied before this returns.
+  void submit(const uint8_t* data, size_t size);
+
+  // Stops the receive thread, flushes the reorder windows, waits for every queued datagram to
+  // reach the consumer and joins all threads. Rethrows the first exception raised by the receiver
+  // or the consumer. Must be called from the producer thread when submit() is used.
+  void stop();
+
+  NDTPPipelineStats stats() const;
+
+  size_t n_workers() const { return workers_.size(); }
+
+  // Datagrams waiting in worker `i`'s queue now, and the most there have been.
+  size_t queue_depth(size_t i) const { return workers_.at(i)->input.size(); }
+  size_t max_queue_depth(size_t i) const { return workers_.at(i)->max_depth.load(std::memory_order_relaxed); }
+
+ private:
+  struct Result {
+    NDTPMessage message;
+    bool valid = false;
+  };
+
+  struct Worker {
+    Worker(size_t capacity, size_t max_datagram_size);
+
+    SpscRing<ByteArray> input;
+    SpscRing<Result> output;
+    std::atomic<size_t> max_depth{0};
+    std::atomic<bool> done{false};
+    std::thread thread;
+  };
+
+  void dispatch(const NDTPStreamPacket& packet);
+  void run_worker(Worker& worker);
+  void run_sequencer();
+  void record_error(std::exception_ptr error);
+
+  // Pins `thread` to `core`; does nothing for a negative core.
+  static void pin(std::thread& thread, int core);
+
+  NDTPPipelineOptions options_;
+  Consumer consumer_;
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::thread sequencer_;
+  std::thread receive_thread_;
+  std::atomic<bool> receiving_{false};
+  std::atomic<bool> producer_done_{false};
+  bool stopped_ = false;
+
+  // producer state: one sequence tracker per data type and the next worker to deal to
+  std::array<std::unique_ptr<NDTPStreamDecoder>, 256> streams_;
+  size_t next_worker_ = 0;
+
+  std::atomic<uint64_t> received_{0};
+  std::atomic<uint64_t> queued_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> invalid_{0};
+  std::atomic<uint64_t> delivered_{0};
+
+  std::mutex error_mutex_;
+  std::exception_ptr error_;
+};
+
+}  // namespace science::libndtp
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace science::libndtp::simd {
+
+/**
+ * Instruction set used by the vectorized bit codecs. The best one supported by the CPU is
+ * detected when the library is loaded; kScalar means every width goes through the generic path.
+ */
+enum class Isa { kScalar, kSse41, kAvx2 };
+
+// Currently selected instruction set.
+Isa active_isa();
+
+// Selects `isa` if the CPU supports it (e.g. to compare kernels); returns false otherwise.
+bool set_isa(Isa isa);
+
+/**
+ * ScopedIsa puts back the instruction set that was active when it was created, so that code
+ * trying out kernels with set_isa() leaves the selection as it found it on every way out.
+ */
+class ScopedIsa {
+ public:
+  ScopedIsa() : saved_(active_isa()) {}
+  ~ScopedIsa() { set_isa(saved_); }
+
+  ScopedIsa(const ScopedIsa&) = delete;
+  ScopedIsa& operator=(const ScopedIsa&) = delete;
+
+ private:
+  Isa saved_;
+};
+
+// Extra bytes `pack` may write past the encoded data, which the destination must be able to hold.
+static constexpr size_t PACK_PADDING = 32;
+
+// Bit widths with vectorized kernels.
+constexpr bool has_kernel(uint8_t bit_width) {
+  return bit_width == 10 || bit_width == 12 || bit_width == 16 || bit_width == 24;
+}
+
+// Sample types the kernels read and write.
+template <typename T>
+constexpr bool is_kernel_type = std::is_same_v<T, int16_t> || std::is_same_v<T, uint16_t> || std::is_same_v<T, int32_t> ||
+                                std::is_same_v<T, uint32_t> || std::is_same_v<T, int64_t> || std::is_same_v<T, uint64_t>;
+
+/**
+ * Decodes big-endian `bit_width`-bit fields starting at the first bit of `src` into `out`, sign
+ * extending them if `is_signed`. Works on whole blocks only, never reads past `src + src_size`
+ * and returns the number of values decoded (possibly 0); the caller finishes the tail.
+ */
+template <typename T>
+size_t unpack(const uint8_t* src, size_t src_size, uint8_t bit_width, bool is_signed, T* out, size_t count);
+
+/**
+ * Encodes `values` as big-endian `bit_width`-bit fields starting at the first bit of `dst`,
+ * keeping the low `bit_width` bits of each value. Works on whole blocks only, writing complete
+ * bytes plus up to PACK_PADDING bytes of scratch past them, never past `dst + dst_size`.
+ * Returns the number of values encoded (possibly 0); the caller finishes the tail.
+ */
+template <typename T>
+size_t pack(const T* values, size_t count, uint8_t bit_width, uint8_t* dst, size_t dst_size);
+
+/**
+ * Packs `count` values as 4-bit fields, two per byte with the first in the high nibble, clamping
+ * each to 15. Writes exactly (count + 1) / 2 bytes to `dst`; an odd count leaves the low nibble of
+ * the last byte zero.
+ */
+void pack_nibbles(const uint8_t* values, size_t count, uint8_t* dst);
+
+// Unpacks `count` 4-bit fields written by pack_nibbles, reading (count + 1) / 2 bytes from `src`.
+void unpack_nibbles(const uint8_t* src, size_t count, uint8_t* out);
+
+}  // namespace science::libndtp::simd
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+namespace science::libndtp {
+
+/**
+ * SpscRing is a bounded lock-free queue between exactly one producer thread and one consumer
+ * thread.
+ *
+ * Elements live in slots that are constructed once and reused, so a producer can fill a slot in
+ * place (claim(), then publish()) and keep the memory it owns, e.g. a ByteArray's capacity, from
+ * one lap of the ring to the next. Head and tail sit on separate cache lines, and each side keeps
+ * a cached copy of the other's index so it only touches the shared line when the ring looks full
+ * or empty.
+ */
+template <typename T>
+class SpscRing {
+ public:
+  // `capacity` is rounded up to a power of two.
+  explicit SpscRing(size_t capacity) {
+    if (capacity == 0) {
+      throw std::invalid_argument("SPSC ring needs a non-zero capacity");
+    }
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    slots_.resize(size);
+    mask_ = size - 1;
+  }
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  size_t capacity() const { return slots_.size(); }
+
+  // Approximate number of queued elements; exact when called from either end.
+  size_t size() const { return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire); }
+
+  // Producer: returns the next free slot, or nullptr when the ring is full. The slot still holds
+  // whatever was left in it on the previous lap.
+  T* claim() {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - producer_head_ == slots_.size()) {
+      producer_head_ = head_.load(std::memory_order_acquire);
+      if (tail - producer_head_ == slots_.size()) {
+        return nullptr;
+      }
+    }
+    return &slots_[tail & mask_];
+  }
+
+  // Producer: makes the slot returned by claim() visible to the consumer.
+  void publish() { tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  // Consumer: returns the oldest element, or nullptr when the ring is empty.
+  T* front() {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == consumer_tail_) {
+      consumer_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == consumer_tail_) {
+        return nullptr;
+      }
+    }
+    return &slots_[head & mask_];
+  }
+
+  // Consumer: releases the element returned by front() back to the producer.
+  void pop() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+ private:
+  static constexpr size_t CACHE_LINE = 64;
+
+  std::vector<T> slots_;
+  size_t mask_ = 0;
+
+  alignas(CACHE_LINE) std::atomic<size_t> head_{0};  // written by the consumer
+  size_t consumer_tail_ = 0;
+
+  alignas(CACHE_LINE) std::atomic<size_t> tail_{0};  // written by the producer
+  size_t producer_head_ = 0;
+};
+
+}  // namespace science::libndtp
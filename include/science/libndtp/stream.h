@@ -0,0 +1,189 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "science/libndtp/ndtp.h"
+#include "science/libndtp/utils.h"
+
+namespace science::libndtp {
+
+/**
+ * Counters kept by NDTPStreamDecoder. Every pushed datagram ends up in exactly one of delivered,
+ * duplicates, late or invalid (or is still buffered); `dropped` counts sequence numbers that
+ * delivery moved past without having received them.
+ */
+struct NDTPStreamStats {
+  uint64_t received = 0;    // datagrams pushed
+  uint64_t delivered = 0;   // packets passed to the callback
+  uint64_t dropped = 0;     // sequence numbers skipped over
+  uint64_t duplicates = 0;  // packets whose sequence number was already received
+  uint64_t reordered = 0;   // packets that arrived after one with a higher sequence number
+  uint64_t late = 0;        // packets that arrived after delivery moved past them; discarded
+  uint64_t invalid = 0;     // datagrams that failed size, version or CRC checks
+};
+
+/**
+ * A packet delivered by NDTPStreamDecoder, in sequence order.
+ */
+struct NDTPStreamPacket {
+  uint64_t seq;        // header.seq_number extended to 64 bits
+  NDTPHeader header;
+  ByteSpan datagram;   // the whole datagram; only valid during the callback
+
+  // Decodes the full message (the CRC was already checked when the datagram was pushed).
+  NDTPMessage decode() const { return NDTPMessage::unpack(datagram.data, datagram.size, true); }
+};
+
+/**
+ * NDTPStreamDecoder tracks the datagrams of one NDTP stream: it extends the 16-bit sequence
+ * number to 64 bits across wraparounds, drops duplicates and counts losses and reordering, and
+ * delivers packets to a callback in sequence order.
+ *
+ * With a reorder window of N, up to N packets ahead of the next expected one are held back until
+ * the gap before them is filled, or until a packet arrives more than N past it, at which point
+ * the missing ones are counted as dropped. With a window of 0 packets are delivered as they arrive
+ * and anything older than the newest packet is discarded as late.
+ *
+ * Buffers for the window are allocated up front, so decoding is allocation free in steady state
+ * as long as datagrams fit in `max_datagram_size`. Invalid datagrams are counted, not thrown.
+ */
+class NDTPStreamDecoder {
+ public:
+  explicit NDTPStreamDecoder(size_t reorder_window = 0, size_t max_datagram_size = 2048, bool ignore_crc = false);
+
+  // Feeds one datagram; calls `deliver(const NDTPStreamPacket&)` for each packet that becomes ready.
+  template <typename F>
+  void push(const uint8_t* data, size_t size, F&& deliver) {
+    NDTPHeader header;
+    uint64_t seq;
+    if (!accept(data, size, header, seq)) {
+      return;
+    }
+    if (seq > next_ + window_) {
+      // out of reach of the window: give up on the oldest missing packets
+      advance_to(seq - window_, deliver);
+    }
+    if (seq == next_) {
+      // in order: hand the datagram over without copying it, then anything buffered behind it
+      mark(seq, true);
+      next_++;
+      stats_.delivered++;
+      deliver(NDTPStreamPacket{seq, header, ByteSpan{data, size}});
+      drain(deliver);
+      return;
+    }
+
+    // ahead of a gap: hold a copy until the gap is filled or given up on
+    Slot& slot = slots_[seq % window_];
+    if (slot.full && slot.seq == seq) {
+      stats_.duplicates++;
+      return;
+    }
+    slot.data.assign(data, data + size);
+    slot.seq = seq;
+    slot.header = header;
+    slot.full = true;
+    pending_++;
+  }
+
+  // Delivers every buffered packet, counting the gaps between them as dropped.
+  template <typename F>
+  void flush(F&& deliver) {
+    while (pending_ > 0) {
+      advance_to(next_ + 1, deliver);
+    }
+  }
+
+  // Forgets the stream position, buffered packets and counters.
+  void reset();
+
+  const NDTPStreamStats& stats() const { return stats_; }
+
+  // Extended sequence number of the next packet to deliver.
+  uint64_t next_seq() const { return next_; }
+
+ private:
+  // Sequence numbers remembered for duplicate detection behind the next expected one.
+  static constexpr size_t HISTORY = 1024;
+
+  struct Slot {
+    ByteArray data;
+    uint64_t seq = 0;
+    NDTPHeader header{};
+    bool full = false;
+  };
+
+  // Validates a datagram and extends its sequence number; counts and rejects invalid, duplicate and late ones.
+  bool accept(const uint8_t* data, size_t size, NDTPHeader& header, uint64_t& seq);
+
+  // Records whether `seq` was delivered, for duplicate detection.
+  void mark(uint64_t seq, bool delivered) {
+    uint64_t bit = 1ULL << (seq % 64);
+    auto& word = history_[(seq % HISTORY) / 64];
+    word = delivered ? word | bit : word & ~bit;
+  }
+
+  bool was_delivered(uint64_t seq) const {
+    return next_ - seq <= HISTORY && (history_[(seq % HISTORY) / 64] >> (seq % 64)) & 1;
+  }
+
+  // Moves delivery up to `target`, delivering buffered packets and counting the rest as dropped.
+  template <typename F>
+  void advance_to(uint64_t target, F& deliver) {
+    while (next_ < target) {
+      if (pending_ == 0) {
+        // nothing buffered: skip the whole gap at once
+        skip(target);
+        return;
+      }
+      Slot& slot = slots_[next_ % window_];
+      if (slot.full && slot.seq == next_) {
+        deliver_slot(slot, deliver);
+      } else {
+        mark(next_, false);
+        stats_.dropped++;
+      }
+      next_++;
+    }
+    drain(deliver);
+  }
+
+  // Delivers buffered packets that are next in sequence.
+  template <typename F>
+  void drain(F& deliver) {
+    while (pending_ > 0) {
+      Slot& slot = slots_[next_ % window_];
+      if (!slot.full || slot.seq != next_) {
+        return;
+      }
+      deliver_slot(slot, deliver);
+      next_++;
+    }
+  }
+
+  template <typename F>
+  void deliver_slot(Slot& slot, F& deliver) {
+    slot.full = false;
+    pending_--;
+    mark(slot.seq, true);
+    stats_.delivered++;
+    deliver(NDTPStreamPacket{slot.seq, slot.header, ByteSpan{slot.data.data(), slot.data.size()}});
+  }
+
+  // Counts [next_, target) as dropped when none of it is buffered.
+  void skip(uint64_t target);
+
+  size_t window_;
+  bool ignore_crc_;
+  std::vector<Slot> slots_;
+  size_t pending_ = 0;
+
+  bool started_ = false;
+  uint64_t next_ = 0;
+  uint64_t highest_ = 0;
+  std::array<uint64_t, HISTORY / 64> history_{};
+  NDTPStreamStats stats_;
+};
+
+}  // namespace science::libndtp
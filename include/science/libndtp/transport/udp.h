@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "science/libndtp/ndtp.h"
+#include "science/libndtp/packet_batch.h"
+#include "science/libndtp/types.h"
+#include "science/libndtp/utils.h"
+
+#include <sys/socket.h>
+
+namespace science::libndtp {
+
+/**
+ * Counters kept by the UDP transport.
+ */
+struct NDTPUdpStats {
+  uint64_t datagrams = 0;  // datagrams received or sent
+  uint64_t batches = 0;    // recvmmsg/sendmmsg calls that moved at least one datagram
+  uint64_t truncated = 0;  // received datagrams larger than the buffer slot, discarded
+  uint64_t invalid = 0;    // received datagrams that failed to decode
+  uint64_t refused = 0;    // sends that failed with ECONNREFUSED (nobody listening), then retried
+  uint64_t dropped = 0;    // datagrams not sent because every retry was refused
+};
+
+/**
+ * NDTPUdpReceiver reads NDTP datagrams from a bound UDP socket in batches with recvmmsg.
+ *
+ * Datagrams land in a ring of `batch_size` fixed slots of `max_datagram_size` bytes allocated up
+ * front, so a batch costs one syscall and no allocation. Datagrams of a batch stay valid until
+ * the next receive. Socket errors throw std::runtime_error.
+ */
+class NDTPUdpReceiver {
+ public:
+  // Binds to `address` (an IPv4 address, e.g. "0.0.0.0") and `port`; port 0 picks a free port.
+  NDTPUdpReceiver(
+    const std::string& address, uint16_t port, size_t batch_size = 64, size_t max_datagram_size = 2048,
+    int receive_buffer_bytes = 0
+  );
+  ~NDTPUdpReceiver();
+
+  NDTPUdpReceiver(const NDTPUdpReceiver&) = delete;
+  NDTPUdpReceiver& operator=(const NDTPUdpReceiver&) = delete;
+
+  // Waits up to `timeout_ms` (-1 blocks, 0 polls) for datagrams, then receives as many as are
+  // queued, up to one batch. Returns the number received, accessible through datagram().
+  size_t receive(int timeout_ms = -1);
+
+  ByteSpan datagram(size_t i) const {
+    return ByteSpan{slab_.data() + i * max_datagram_size_, sizes_[i]};
+  }
+
+  // Receives one batch and decodes it with NDTPMessage::unpack_batch, calling
+  // `on_message(NDTPMessage&&)` for each datagram that decodes. Returns the number of messages.
+  template <typename F>
+  size_t receive_messages(F&& on_message, int timeout_ms = -1) {
+    size_t n = receive(timeout_ms);
+    for (size_t i = 0; i < n; ++i) {
+      spans_[i] = datagram(i);
+    }
+    size_t n_messages = NDTPMessage::unpack_batch(spans_.data(), n, messages_.data(), statuses_.data());
+    stats_.invalid += n - n_messages;
+    for (size_t i = 0; i < n; ++i) {
+      if (statuses_[i] == NDTPUnpackStatus::kOk) {
+        on_message(std::move(messages_[i]));
+      }
+    }
+    return n_messages;
+  }
+
+  int fd() const { return fd_; }
+  uint16_t port() const { return port_; }
+  const NDTPUdpStats& stats() const { return stats_; }
+
+ private:
+  int fd_ = -1;
+  uint16_t port_ = 0;
+  size_t max_datagram_size_;
+  ByteArray slab_;
+  std::vector<size_t> sizes_;
+  std::vector<iovec> iovecs_;
+  std::vector<mmsghdr> headers_;
+  std::vector<ByteSpan> spans_;
+  std::vector<NDTPMessage> messages_;
+  std::vector<NDTPUnpackStatus> statuses_;
+  NDTPUdpStats stats_;
+};
+
+/**
+ * NDTPUdpSender writes NDTP packets to one UDP destination in batches with sendmmsg.
+ *
+ * The socket is connected to the destination, so the kernel resolves the route once. Packets are
+ * described straight out of a PacketBatch slab without copying. Socket errors throw
+ * std::runtime_error, except ECONNREFUSED (no listener), which is counted and skipped.
+ */
+class NDTPUdpSender {
+ public:
+  NDTPUdpSender(const std::string& address, uint16_t port, size_t batch_size = 64, int send_buffer_bytes = 0);
+  ~NDTPUdpSender();
+
+  NDTPUdpSender(const NDTPUdpSender&) = delete;
+  NDTPUdpSender& operator=(const NDTPUdpSender&) = delete;
+
+  // Sends every packet of `batch`; returns the number sent. A datagram whose send keeps failing
+  // with ECONNREFUSED is counted as dropped rather than sent.
+  size_t send(const PacketBatch& batch);
+
+  // Packs `data` with the next sequence numbers of this sender and sends the packets; returns the number sent.
+  size_t send(const ElectricalBroadbandData& data, size_t max_packet_size = NDTP_DEFAULT_MAX_PACKET_SIZE);
+
+  // Sequence number the next packed message will carry.
+  uint16_t seq_number() const { return seq_number_; }
+
+  int fd() const { return fd_; }
+  const NDTPUdpStats& stats() const { return stats_; }
+
+ private:
+  int fd_ = -1;
+  size_t batch_size_;
+  uint16_t seq_number_ = 0;
+  PacketBatch batch_;
+  std::vector<iovec> iovecs_;
+  std::vector<mmsghdr> headers_;
+  NDTPUdpStats stats_;
+};
+
+}  // namespace science::libndtp
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "science/libndtp/ndtp.h"
+#include "science/libndtp/transport/udp.h"
+#include "science/libndtp/utils.h"
+
+namespace science::libndtp {
+
+/**
+ * NDTPUringReceiver receives NDTP datagrams from a bound UDP socket through io_uring.
+ *
+ * A single multishot recvmsg stays armed on the socket and the kernel places each datagram
+ * straight into a buffer picked from a registered ring of `n_buffers` preallocated buffers, so
+ * there is no syscall or copy per datagram: receive() reaps up to `batch_size` completions at once
+ * and exposes the datagrams where they landed, for NDTPMessage::unpack or NDTPStreamDecoder to
+ * read in place. Their buffers go back to the ring on the next receive().
+ *
+ * When io_uring is unavailable (old kernel, disabled by policy or seccomp, no multishot recvmsg)
+ * the receiver falls back to an NDTPUdpReceiver with the same interface; backend() reports which
+ * one is in use.
+ */
+class NDTPUringReceiver {
+ public:
+  enum class Backend { kIoUring, kRecvmmsg };
+
+  // Binds to `address` and `port` like NDTPUdpReceiver; `preferred` = kRecvmmsg skips io_uring.
+  NDTPUringReceiver(
+    const std::string& address, uint16_t port, size_t batch_size = 64, size_t max_datagram_size = 2048,
+    size_t n_buffers = 256, int receive_buffer_bytes = 0, Backend preferred = Backend::kIoUring
+  );
+  ~NDTPUringReceiver();
+
+  NDTPUringReceiver(const NDTPUringReceiver&) = delete;
+  NDTPUringReceiver& operator=(const NDTPUringReceiver&) = delete;
+
+  Backend backend() const { return ring_ ? Backend::kIoUring : Backend::kRecvmmsg; }
+
+  // Waits up to `timeout_ms` (-1 blocks, 0 polls) for datagrams and returns the number now
+  // available through datagram(), at most one batch. They stay valid until the next receive().
+  size_t receive(int timeout_ms = -1);
+
+  ByteSpan datagram(size_t i) const { return ring_ ? datagrams_[i] : socket_->datagram(i); }
+
+  // Receives one batch and decodes it in place with NDTPMessage::unpack_batch, calling
+  // `on_message(NDTPMessage&&)` for each datagram that decodes. Returns the number of messages.
+  template <typename F>
+  size_t receive_messages(F&& on_message, int timeout_ms = -1) {
+    if (!ring_) {
+      return socket_->receive_messages(on_message, timeout_ms);
+    }
+    size_t n = receive(timeout_ms);
+    size_t n_messages = NDTPMessage::unpack_batch(datagrams_.data(), n, messages_.data(), statuses_.data());
+    stats_.invalid += n - n_messages;
+    for (size_t i = 0; i < n; ++i) {
+      if (statuses_[i] == NDTPUnpackStatus::kOk) {
+        on_message(std::move(messages_[i]));
+      }
+    }
+    return n_messages;
+  }
+
+  int fd() const { return socket_->fd(); }
+  uint16_t port() const { return socket_->port(); }
+  const NDTPUdpStats& stats() const { return ring_ ? stats_ : socket_->stats(); }
+
+ private:
+  struct Ring;
+
+  std::unique_ptr<NDTPUdpReceiver> socket_;
+  std::unique_ptr<Ring> ring_;
+  size_t batch_size_;
+  std::vector<ByteSpan> datagrams_;
+  std::vector<NDTPMessage> messages_;
+  std::vector<NDTPUnpackStatus> statuses_;
+  NDTPUdpStats stats_;
+};
+
+}  // namespace science::libndtp
@@ -6,21 +6,25 @@
 #include <variant>
 #include <vector>
 #include "science/libndtp/ndtp.h"
+#include "science/libndtp/packet_batch.h"
 #include "science/libndtp/utils.h"
 
 namespace science::libndtp {
 
+// Default upper bound on encoded packet size, which keeps a datagram within a 1500 byte Ethernet MTU.
+static constexpr size_t NDTP_DEFAULT_MAX_PACKET_SIZE = 1400;
+
 /**
  * ElectricalBroadbandData represents a collection of broadband data channels.
+ *
+ * Samples are stored as T; a type just wide enough for the bit width (e.g. int16_t for 12-bit
+ * signed samples) keeps buffered data compact. Instantiated for the 8- to 64-bit integer types.
  */
-struct ElectricalBroadbandData {
-  /**
-     * ChannelData holds data for a single electrical broadband channel.
-     */
-  struct ChannelData {
-    uint32_t channel_id;
-    std::vector<uint64_t> channel_data;
-  };
+template <typename T>
+struct GenericElectricalBroadbandData {
+  // ChannelData holds data for a single electrical broadband channel, laid out as in the payload
+  // so packets can be decoded straight into it.
+  using ChannelData = typename GenericNDTPPayloadBroadband<T>::ChannelData;
 
   bool is_signed;
   uint32_t bit_width;
@@ -28,13 +32,43 @@ struct ElectricalBroadbandData {
   uint64_t t0;
   std::vector<ChannelData> channels;
 
-  // Packs the data into a list of NDTP messages.
-  std::vector<ByteArray> pack(uint64_t seq_number) const;
+  // Packs the data into a list of NDTP messages of at most `max_packet_size` bytes each.
+  std::vector<ByteArray> pack(uint64_t seq_number, size_t max_packet_size = NDTP_DEFAULT_MAX_PACKET_SIZE) const;
+
+  /**
+   * Packs the data as NDTP messages of at most `max_packet_size` bytes appended to `batch`, and
+   * returns the number of packets added. Samples are split into time windows shared by all
+   * channels; each packet carries the runs of as many channels as fit within one window, with
+   * the header timestamp of the window's first sample (t0 plus the offset at `sample_rate`).
+   * Empty channels produce no runs.
+   */
+  size_t pack(uint64_t seq_number, PacketBatch& batch, size_t max_packet_size = NDTP_DEFAULT_MAX_PACKET_SIZE) const;
+
+  /**
+   * Same as pack(seq_number, batch, max_packet_size), encoding the packets on up to `n_threads`
+   * threads (0 for one per hardware thread). Every packet's size, position and sequence number is
+   * laid out before any is encoded, so the output is byte-identical to pack(). Small inputs are
+   * encoded on the calling thread.
+   */
+  size_t pack_parallel(
+    uint64_t seq_number, PacketBatch& batch, size_t n_threads = 0, size_t max_packet_size = NDTP_DEFAULT_MAX_PACKET_SIZE
+  ) const;
 
   // Unpacks the data from NDTP messages.
-  static ElectricalBroadbandData unpack(const NDTPMessage& msg);
+  static GenericElectricalBroadbandData unpack(const NDTPMessage& msg);
+
+  // Unpacks the data from an encoded broadband message, decoding samples straight into T (delta
+  // encoded samples go through a full width NDTPPayloadBroadbandDelta first).
+  static GenericElectricalBroadbandData unpack(const uint8_t* data, size_t size, bool ignore_crc = false);
+
+  // Same as the unpack() overloads, overwriting `out` in place and keeping the capacity of its
+  // channel and sample vectors. If decoding throws, `out` is left valid but unspecified.
+  static void unpack_into(const NDTPMessage& msg, GenericElectricalBroadbandData& out);
+  static void unpack_into(const uint8_t* data, size_t size, GenericElectricalBroadbandData& out, bool ignore_crc = false);
 };
 
+typedef GenericElectricalBroadbandData<uint64_t> ElectricalBroadbandData;
+
 
 /**
  * BinnedSpiketrainData represents spike count data.
@@ -47,8 +81,14 @@ struct BinnedSpiketrainData {
   // Packs the data into a list of NDTP messages.
   std::vector<ByteArray> pack(uint64_t seq_number) const;
 
+  // Packs the data as NDTP messages appended to `batch`; returns the number of packets added.
+  size_t pack(uint64_t seq_number, PacketBatch& batch) const;
+
   // Unpacks the data from NDTP messages.
   static BinnedSpiketrainData unpack(const NDTPMessage& msg);
+
+  // Same as unpack(), overwriting `out` in place and keeping the capacity of its spike counts.
+  static void unpack_into(const NDTPMessage& msg, BinnedSpiketrainData& out);
 };
 
 
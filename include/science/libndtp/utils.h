@@ -1,23 +1,87 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <tuple>
 #include <utility>
 #include <vector>
 
-#include <boost/crc.hpp>
+#include "science/libndtp/crc16.h"
+#include "science/libndtp/simd.h"
 
 namespace science::libndtp {
 
 using ByteArray = std::vector<uint8_t>;
 using BitOffset = size_t;
 
+/**
+ * ByteSpan is a non-owning view of a byte range, e.g. one packet inside a larger buffer.
+ */
+struct ByteSpan {
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+
+  const uint8_t* begin() const { return data; }
+  const uint8_t* end() const { return data + size; }
+  bool empty() const { return size == 0; }
+};
+
 inline uint16_t crc16(const ByteArray& data) {
-  boost::crc_16_type result;
-  result.process_bytes(data.data(), data.size());
-  return result.checksum();
+  return crc16(data.data(), data.size());
+}
+
+/**
+ * Mask of the low `bit_width` bits, for widths of 1 to 64.
+ */
+constexpr uint64_t low_bits_mask(uint8_t bit_width) {
+  return ~0ULL >> (64 - bit_width);
+}
+
+/**
+ * Sign extends the low `bit_width` bits (1-64) of `value` from bit `bit_width - 1`, with a left
+ * and an arithmetic right shift instead of testing the sign bit.
+ */
+constexpr int64_t sign_extend(uint64_t value, uint8_t bit_width) {
+  unsigned shift = 64 - bit_width;
+  return static_cast<int64_t>(value << shift) >> shift;
+}
+
+/**
+ * Returns whether all `count` values fit in `bit_width` bits (1-64), as two's complement if
+ * `is_signed`. Values are OR-ed together a block at a time and the block tested once, so the
+ * inner loop has no branches and vectorizes; a signed value is first folded onto its complement
+ * when negative, after which it fits iff no bit at or above the sign bit is set.
+ */
+template <typename T>
+bool fits_bit_width(const T* values, size_t count, uint8_t bit_width, bool is_signed) {
+  unsigned value_bits = is_signed ? bit_width - 1 : bit_width;
+  uint64_t excess = value_bits >= 64 ? 0 : ~0ULL << value_bits;
+  if (excess == 0) {
+    return true;
+  }
+  constexpr size_t BLOCK = 64;
+  for (size_t i = 0; i < count; i += BLOCK) {
+    size_t n = std::min(BLOCK, count - i);
+    uint64_t acc = 0;
+    if (is_signed) {
+      for (size_t j = 0; j < n; ++j) {
+        auto value = static_cast<int64_t>(values[i + j]);
+        acc |= static_cast<uint64_t>(value ^ (value >> 63));
+      }
+    } else {
+      for (size_t j = 0; j < n; ++j) {
+        acc |= static_cast<uint64_t>(values[i + j]);
+      }
+    }
+    if (acc & excess) {
+      return false;
+    }
+  }
+  return true;
 }
 
 /**
@@ -33,8 +97,8 @@ std::tuple<ByteArray, BitOffset, bool> to_bytes(
     bool is_signed = false,
     bool is_le = false
 ) {
-  if (bit_width <= 0) {
-    throw std::invalid_argument("to unpack bytes, bit width must be > 0 (value: " + std::to_string(bit_width) + ")");
+  if (bit_width <= 0 || bit_width > 64) {
+    throw std::invalid_argument("to pack bytes, bit width must be 1-64 (value: " + std::to_string(bit_width) + ")");
   }
 
   size_t truncate_bytes = writing_bit_offset / 8;
@@ -46,18 +110,26 @@ std::tuple<ByteArray, BitOffset, bool> to_bytes(
   uint8_t current_byte = (continue_last && !result.empty()) ? result.back() : 0;
   int bits_in_current_byte = writing_bit_offset;
 
-  bool status_good = true;
-  for (const auto& value : values) {
-    T val = value;
-    if (is_signed) {
-      if ( val > (1 << (bit_width - 1)) - 1 || val < -(1 << (bit_width - 1))) {
-        status_good = false; 
-      }
-    } else {
-      if (val > (1 << bit_width) - 1) {
-        status_good = false;
+  bool status_good = fits_bit_width(values.data(), values.size(), bit_width, is_signed);
+
+  // once the output is byte aligned, hand the bulk of the values to the vectorized kernels
+  bool use_kernel = simd::is_kernel_type<T> && simd::has_kernel(bit_width) && !is_le;
+  for (size_t i = 0; i < values.size(); ++i) {
+    if constexpr (simd::is_kernel_type<T>) {
+      if (use_kernel && bits_in_current_byte == 0) {
+        use_kernel = false;
+        size_t start = result.size();
+        size_t remaining = values.size() - i;
+        result.resize(start + remaining * bit_width / 8 + simd::PACK_PADDING);
+        size_t n = simd::pack(values.data() + i, remaining, bit_width, result.data() + start, result.size() - start);
+        result.resize(start + n * bit_width / 8);
+        i += n;
+        if (i == values.size()) {
+          break;
+        }
       }
-    } 
+    }
+    auto val = static_cast<uint64_t>(values[i]);
 
     int remaining_bits = bit_width;
     while (remaining_bits > 0) {
@@ -108,6 +180,307 @@ std::tuple<ByteArray, BitOffset, bool> to_bytes(
   return to_bytes(values, bit_width, existing, writing_bit_offset, is_signed, is_le);
 }
 
+/**
+ * BitReader reads big-endian (MSB first) bit fields from a byte buffer in place.
+ *
+ * It keeps a byte cursor and a 64-bit accumulator that is refilled a word at a time, so each
+ * field is extracted with a shift and a mask instead of bit by bit. Reading past the end of the
+ * buffer throws std::runtime_error.
+ */
+class BitReader {
+ public:
+  BitReader(const uint8_t* data, size_t size, size_t start_bit = 0)
+      : begin_(data), next_(data), end_(data + size) {
+    if (start_bit > size * 8) {
+      throw std::runtime_error(
+          "bit reader start offset out of range (" + std::to_string(start_bit) + " > " + std::to_string(size * 8) + ")"
+      );
+    }
+    next_ += start_bit / 8;
+    if (start_bit % 8 > 0) {
+      read(start_bit % 8);
+    }
+  }
+
+  // Reads an unsigned field of `bit_width` bits (1-64).
+  uint64_t read(uint8_t bit_width) {
+    if (bit_width > MAX_FIELD_BITS) {
+      uint64_t high = read(bit_width - 32);
+      return (high << 32) | read(32);
+    }
+    if (bits_ < bit_width) {
+      refill();
+      if (bits_ < bit_width) {
+        throw std::runtime_error(
+            "insufficient data to read " + std::to_string(bit_width) + " bits (remaining: " +
+            std::to_string(bits_remaining()) + ")"
+        );
+      }
+    }
+    uint64_t value = acc_ >> (64 - bit_width);
+    acc_ <<= bit_width;
+    bits_ -= bit_width;
+    return value;
+  }
+
+  // Reads a two's complement field of `bit_width` bits (1-64), sign extended to 64 bits.
+  int64_t read_signed(uint8_t bit_width) {
+    return sign_extend(read(bit_width), bit_width);
+  }
+
+  // Reads `count` fields of `bit_width` bits into `out`, sign extending them if `is_signed`.
+  template <typename T>
+  void read(T* out, size_t count, uint8_t bit_width, bool is_signed = false) {
+    if (count * bit_width > bits_remaining()) {
+      throw std::runtime_error(
+          "insufficient data to read " + std::to_string(count) + " values of " + std::to_string(bit_width) +
+          " bits (remaining: " + std::to_string(bits_remaining()) + " bits)"
+      );
+    }
+    size_t i = 0;
+    if constexpr (simd::is_kernel_type<T>) {
+      if (simd::has_kernel(bit_width)) {
+        // read single values up to a byte boundary, then decode whole blocks straight from the buffer
+        for (; i < count && bit_offset() % 8 > 0; ++i) {
+          out[i] = static_cast<T>(is_signed ? read_signed(bit_width) : read(bit_width));
+        }
+        size_t byte_offset = bit_offset() / 8;
+        size_t n = simd::unpack(begin_ + byte_offset, (end_ - begin_) - byte_offset, bit_width, is_signed, out + i, count - i);
+        if (n > 0) {
+          next_ = begin_ + byte_offset + n * bit_width / 8;
+          acc_ = 0;
+          bits_ = 0;
+          i += n;
+        }
+      }
+    }
+    if ((bit_width == 32 || bit_width == 64) && bit_offset() % 8 == 0) {
+      // byte aligned words need no shifting, just a byte swap each
+      const uint8_t* src = begin_ + bit_offset() / 8;
+      if (bit_width == 64) {
+        for (; i < count; ++i, src += 8) {
+          uint64_t word;
+          std::memcpy(&word, src, sizeof(word));
+          out[i] = static_cast<T>(load_be64(word));
+        }
+      } else {
+        for (; i < count; ++i, src += 4) {
+          uint64_t value = (uint64_t{src[0]} << 24) | (uint64_t{src[1]} << 16) | (uint64_t{src[2]} << 8) | src[3];
+          out[i] = static_cast<T>(is_signed ? sign_extend(value, 32) : static_cast<int64_t>(value));
+        }
+      }
+      next_ = src;
+      acc_ = 0;
+      bits_ = 0;
+    }
+    if (is_signed) {
+      for (; i < count; ++i) {
+        out[i] = static_cast<T>(read_signed(bit_width));
+      }
+    } else {
+      for (; i < count; ++i) {
+        out[i] = static_cast<T>(read(bit_width));
+      }
+    }
+  }
+
+  // Absolute bit offset of the next field, relative to the start of the buffer.
+  BitOffset bit_offset() const { return (next_ - begin_) * 8 - bits_; }
+
+  size_t bits_remaining() const { return (end_ - next_) * 8 + bits_; }
+
+ private:
+  // Widest field that can be served from a single refill.
+  static constexpr uint8_t MAX_FIELD_BITS = 56;
+
+  // Tops up the accumulator to at least 56 valid bits (or to the end of the buffer). When a full
+  // word is available it is loaded in one go; bits past `bits_` then already hold the following
+  // stream bits, so OR-ing them in again on the next refill is harmless.
+  void refill() {
+    if (end_ - next_ >= 8) {
+      uint64_t word;
+      std::memcpy(&word, next_, sizeof(word));
+      acc_ |= load_be64(word) >> bits_;
+      next_ += (63 - bits_) >> 3;
+      bits_ |= 56;
+      return;
+    }
+    while (bits_ <= 56 && next_ < end_) {
+      acc_ |= static_cast<uint64_t>(*next_++) << (56 - bits_);
+      bits_ += 8;
+    }
+  }
+
+  static uint64_t load_be64(uint64_t word) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return word;
+#else
+    return __builtin_bswap64(word);
+#endif
+  }
+
+  const uint8_t* begin_;
+  const uint8_t* next_;
+  const uint8_t* end_;
+  uint64_t acc_ = 0;  // valid bits are left aligned
+  unsigned bits_ = 0;
+};
+
+/**
+ * BitWriter writes big-endian (MSB first) bit fields into a caller-owned byte buffer, the
+ * counterpart of BitReader. Bytes are stored a word at a time when there is room, so the writer
+ * may touch bytes past the current position, but never past the end of the buffer. Writing past
+ * the end throws std::runtime_error.
+ */
+class BitWriter {
+ public:
+  BitWriter(uint8_t* data, size_t size) : begin_(data), next_(data), end_(data + size) {}
+
+  // Writes the low `bit_width` bits (1-64) of `value`.
+  void write(uint64_t value, uint8_t bit_width) {
+    if (bit_width > MAX_FIELD_BITS) {
+      write(value >> 32, bit_width - 32);
+      write(value, 32);
+      return;
+    }
+    value &= ~0ULL >> (64 - bit_width);
+    acc_ |= value << (64 - bits_ - bit_width);
+    bits_ += bit_width;
+    flush();
+  }
+
+  // Writes the low `bit_width` bits of each of `count` values.
+  template <typename T>
+  void write(const T* values, size_t count, uint8_t bit_width) {
+    size_t i = 0;
+    if constexpr (simd::is_kernel_type<T>) {
+      if (simd::has_kernel(bit_width)) {
+        // write single values up to a byte boundary, then encode whole blocks straight into the buffer
+        for (; i < count && bits_ > 0; ++i) {
+          write(static_cast<uint64_t>(values[i]), bit_width);
+        }
+        size_t n = simd::pack(values + i, count - i, bit_width, next_, end_ - next_);
+        next_ += n * bit_width / 8;
+        i += n;
+      }
+    }
+    if ((bit_width == 32 || bit_width == 64) && bits_ == 0 && i < count) {
+      size_t n_bytes = (count - i) * (bit_width / 8);
+      if (static_cast<size_t>(end_ - next_) < n_bytes) {
+        throw std::runtime_error(
+            "insufficient space to write " + std::to_string(n_bytes * 8) + " bits (remaining: " +
+            std::to_string((end_ - next_) * 8) + ")"
+        );
+      }
+      for (; i < count; ++i, next_ += bit_width / 8) {
+        uint64_t word = store_be64(static_cast<uint64_t>(values[i]) << (64 - bit_width));
+        std::memcpy(next_, &word, bit_width / 8);
+      }
+    }
+    for (; i < count; ++i) {
+      write(static_cast<uint64_t>(values[i]), bit_width);
+    }
+  }
+
+  // Pads the last partial byte with zero bits and returns the number of bytes written.
+  size_t finish() {
+    if (bits_ > 0) {
+      bits_ = 8;
+      flush();
+    }
+    return next_ - begin_;
+  }
+
+  BitOffset bit_offset() const { return (next_ - begin_) * 8 + bits_; }
+
+ private:
+  // Widest field that fits in the accumulator next to a partial byte.
+  static constexpr uint8_t MAX_FIELD_BITS = 56;
+
+  // Stores the complete bytes held in the accumulator, leaving fewer than 8 bits behind.
+  void flush() {
+    size_t n_bytes = bits_ / 8;
+    if (n_bytes == 0) {
+      return;
+    }
+    if (end_ - next_ >= 8) {
+      uint64_t word = store_be64(acc_);
+      std::memcpy(next_, &word, sizeof(word));
+    } else if (static_cast<size_t>(end_ - next_) >= n_bytes) {
+      for (size_t i = 0; i < n_bytes; ++i) {
+        next_[i] = acc_ >> (56 - 8 * i);
+      }
+    } else {
+      throw std::runtime_error(
+          "insufficient space to write " + std::to_string(bits_) + " bits (remaining: " +
+          std::to_string((end_ - next_) * 8) + ")"
+      );
+    }
+    next_ += n_bytes;
+    acc_ <<= 8 * n_bytes;
+    bits_ -= 8 * n_bytes;
+  }
+
+  static uint64_t store_be64(uint64_t word) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return word;
+#else
+    return __builtin_bswap64(word);
+#endif
+  }
+
+  uint8_t* begin_;
+  uint8_t* next_;
+  uint8_t* end_;
+  uint64_t acc_ = 0;  // valid bits are left aligned
+  unsigned bits_ = 0;
+};
+
+/**
+ * Parses a list of integers from a raw byte buffer with the specified bit width, reading in place.
+ * `start_bit` is an absolute offset into `data`; returns the extracted integers and the absolute
+ * bit offset following the last bit read.
+ */
+template <typename T>
+std::tuple<std::vector<T>, BitOffset> to_ints(
+  const uint8_t* data,
+  size_t size,
+  uint8_t bit_width,
+  size_t count = 0,
+  size_t start_bit = 0,
+  bool is_signed = false,
+  bool is_le = false
+) {
+  if (bit_width <= 0 || bit_width > 64) {
+    throw std::invalid_argument("to unpack ints, bit width must be 1-64 (value: " + std::to_string(bit_width) + ")");
+  }
+
+  size_t total_bits = size * 8;
+  if (start_bit >= total_bits) {
+    return { std::vector<T>(), start_bit };
+  }
+
+  size_t bits_available = total_bits - start_bit;
+  size_t n_available = bits_available / bit_width;
+  if (count == 0 && bits_available % bit_width > 0) {
+    throw std::invalid_argument("Insufficient bits to form a complete value");
+  }
+
+  // a short read returns the values that fit and consumes the remaining bits
+  size_t n_values = n_available;
+  BitOffset end_bit = start_bit + bits_available;
+  if (count > 0 && count <= n_available) {
+    n_values = count;
+    end_bit = start_bit + count * bit_width;
+  }
+
+  std::vector<T> values(n_values);
+  BitReader reader(data, size, start_bit);
+  reader.read(values.data(), n_values, bit_width, is_signed);
+
+  return { values, end_bit };
+}
+
 /**
  * Parses a list of integers from a byte array with the specified bit width.
  * Returns the extracted integers, the new bit offset, and the remaining data.
@@ -121,8 +494,8 @@ std::tuple<std::vector<T>, BitOffset, ByteArray> to_ints(
   bool is_signed = false,
   bool is_le = false
 ) {
-  if (bit_width <= 0) {
-    throw std::invalid_argument("to unpack ints, bit width must be > 0 (value: " + std::to_string(bit_width) + ")");
+  if (bit_width <= 0 || bit_width > 64) {
+    throw std::invalid_argument("to unpack ints, bit width must be 1-64 (value: " + std::to_string(bit_width) + ")");
   }
 
   size_t truncate_bytes = start_bit / 8;
@@ -135,59 +508,10 @@ std::tuple<std::vector<T>, BitOffset, ByteArray> to_ints(
     truncated_data.clear();
   }
 
-  std::vector<T> values;
-  T current_value = 0;
-  size_t bits_in_current_value = 0;
-  size_t total_bits_read = 0;
-  BitOffset end_bit = new_start_bit;
-
-  for (size_t byte_index = 0; byte_index < truncated_data.size(); ++byte_index) {
-    uint8_t byte = truncated_data[byte_index];
-    int start = (byte_index == 0) ? new_start_bit : 0;
-
-    for (int bit_index = 7 - start; bit_index >= 0; --bit_index) {
-      unsigned int bit = (byte >> bit_index) & 1;
-      current_value = (current_value << 1) | bit;
-      bits_in_current_value += 1;
-      total_bits_read += 1;
-
-      if (bits_in_current_value == bit_width) {
-        if (is_signed && (current_value & (1 << (bit_width - 1)))) {
-          current_value -= (1 << bit_width);
-        } else {
-          current_value &= ((1 << bit_width) - 1);
-        }
-        values.push_back(current_value);
-        current_value = 0;
-        bits_in_current_value = 0;
-
-        if (count > 0 && static_cast<size_t>(values.size()) == count) {
-          end_bit += total_bits_read;
-          return { values, end_bit, truncated_data };
-        }
-      }
-    }
-  }
-
-  if (bits_in_current_value > 0) {
-    if (bits_in_current_value == bit_width) {
-      if (is_signed && (current_value & (1 << (bit_width - 1)))) {
-        current_value -= (1 << bit_width);
-      } else {
-        current_value &= ((1 << bit_width) - 1);
-      }
-      values.push_back(current_value);
-    } else if (count == 0) {
-      throw std::invalid_argument("Insufficient bits to form a complete value");
-    }
-  }
-
-  if (count > 0 && values.size() > count) {
-    values.resize(count);
-  }
-
-  end_bit += total_bits_read;
-  return { values, end_bit, truncated_data};
+  auto [values, end_bit] = to_ints<T>(
+    truncated_data.data(), truncated_data.size(), bit_width, count, new_start_bit, is_signed, is_le
+  );
+  return { values, end_bit, truncated_data };
 }
 
 }  // namespace science::libndtp
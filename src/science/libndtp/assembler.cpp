@@ -0,0 +1,84 @@
+#include "science/libndtp/assembler.h"
+
+#include <algorithm>
+
+namespace science::libndtp {
+
+BroadbandAssembler::BroadbandAssembler(
+  const std::vector<uint32_t>& channel_ids, uint32_t sample_rate, size_t samples_per_block, size_t max_pending_blocks
+)
+    : channel_ids_(channel_ids), sample_rate_(sample_rate), samples_per_block_(samples_per_block) {
+  if (channel_ids.empty()) {
+    throw std::invalid_argument("broadband assembler needs at least one channel");
+  }
+  if (sample_rate == 0 || samples_per_block == 0 || max_pending_blocks == 0) {
+    throw std::invalid_argument("broadband assembler needs a non-zero sample rate, block size and pending block count");
+  }
+
+  channel_index_.reserve(channel_ids.size());
+  for (size_t c = 0; c < channel_ids.size(); ++c) {
+    if (!channel_index_.emplace(channel_ids[c], c).second) {
+      throw std::invalid_argument("duplicate channel id " + std::to_string(channel_ids[c]));
+    }
+  }
+
+  blocks_.resize(max_pending_blocks);
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    auto& block = blocks_[i];
+    block.index = i;
+    block.samples_per_channel = samples_per_block;
+    block.samples.resize(channel_ids.size() * samples_per_block);
+    block.present.resize(block.samples.size());
+    block.received.resize(channel_ids.size());
+  }
+}
+
+int64_t BroadbandAssembler::sample_index(uint64_t timestamp) {
+  if (!started_) {
+    started_ = true;
+    origin_ = timestamp;
+    for (auto& block : blocks_) {
+      block.timestamp = origin_ + block.index * samples_per_block_ * NDTP_TIMESTAMP_TICKS_PER_SECOND / sample_rate_;
+    }
+  }
+  if (timestamp < origin_) {
+    return -1;
+  }
+  // timestamps are truncated to whole ticks, so round to the nearest sample
+  return ((timestamp - origin_) * sample_rate_ + NDTP_TIMESTAMP_TICKS_PER_SECOND / 2) / NDTP_TIMESTAMP_TICKS_PER_SECOND;
+}
+
+void BroadbandAssembler::fill(BroadbandBlock& block, size_t channel, size_t offset, const uint64_t* data, size_t size) {
+  size_t start = channel * samples_per_block_ + offset;
+  for (size_t i = 0; i < size; ++i) {
+    if (!block.present[start + i]) {
+      block.present[start + i] = 1;
+      block.received[channel]++;
+      block.total_received++;
+    }
+  }
+  std::copy(data, data + size, block.samples.begin() + start);
+}
+
+void BroadbandAssembler::recycle_first() {
+  auto& block = pending_block(first_);
+  std::fill(block.samples.begin(), block.samples.end(), 0);
+  std::fill(block.present.begin(), block.present.end(), 0);
+  std::fill(block.received.begin(), block.received.end(), 0);
+  block.total_received = 0;
+  block.index = first_ + blocks_.size();
+  block.timestamp = origin_ + block.index * samples_per_block_ * NDTP_TIMESTAMP_TICKS_PER_SECOND / sample_rate_;
+  first_++;
+}
+
+void BroadbandAssembler::skip_to(uint64_t first) {
+  skipped_samples_ += (first - first_) * samples_per_block_ * channel_ids_.size();
+  first_ = first;
+  for (uint64_t index = first_; index < first_ + blocks_.size(); ++index) {
+    auto& block = pending_block(index);
+    block.index = index;
+    block.timestamp = origin_ + index * samples_per_block_ * NDTP_TIMESTAMP_TICKS_PER_SECOND / sample_rate_;
+  }
+}
+
+}  // namespace science::libndtp
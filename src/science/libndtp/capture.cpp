@@ -0,0 +1,368 @@
+#include "science/libndtp/capture.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include "science/libndtp/ndtp.h"
+
+namespace science::libndtp {
+
+namespace {
+
+constexpr uint8_t FILE_MAGIC[8] = {'N', 'D', 'T', 'P', 'C', 'A', 'P', 1};
+constexpr uint8_t TRAILER_MAGIC[8] = {'N', 'D', 'T', 'P', 'I', 'D', 'X', 1};
+
+// O_DIRECT transfers have to be aligned to the logical block size; 4096 covers common devices.
+constexpr size_t DIRECT_IO_ALIGNMENT = 4096;
+
+std::runtime_error file_error(const std::string& what) {
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+void store_be(uint8_t* dst, uint64_t value, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = static_cast<uint8_t>(value >> (8 * (n - 1 - i)));
+  }
+}
+
+uint64_t load_be(const uint8_t* src, size_t n) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < n; ++i) {
+    value = (value << 8) | src[i];
+  }
+  return value;
+}
+
+// NDTP timestamp and stream data type of a datagram, if it is long enough to have a header.
+bool peek_header(const uint8_t* data, size_t size, uint64_t& timestamp, uint8_t& data_type) {
+  if (size < NDTPHeader::NDTP_HEADER_SIZE) {
+    return false;
+  }
+  data_type = stream_data_type(data[1]);
+  timestamp = load_be(data + 2, 8);
+  return true;
+}
+
+}  // namespace
+
+void NDTPCaptureIndexBuilder::add(const uint8_t* datagram, size_t size, uint64_t offset) {
+  uint64_t timestamp;
+  uint8_t data_type;
+  if (!peek_header(datagram, size, timestamp, data_type)) {
+    return;
+  }
+  last_[data_type] = NDTPCaptureIndexEntry{timestamp, offset, data_type};
+  if (counts_[data_type]++ % interval_ == 0) {
+    entries_.push_back(last_[data_type]);
+  }
+}
+
+std::vector<NDTPCaptureIndexEntry> NDTPCaptureIndexBuilder::finish() {
+  // with its last record indexed, a seek into a stream never scans past the next entry
+  for (size_t t = 0; t < counts_.size(); ++t) {
+    if (counts_[t] > 0 && (counts_[t] - 1) % interval_ != 0) {
+      entries_.push_back(last_[t]);
+    }
+  }
+  // entries were added in file order, so a stable sort groups each stream's entries by position
+  std::stable_sort(entries_.begin(), entries_.end(), [](const auto& a, const auto& b) {
+    return a.data_type < b.data_type;
+  });
+  counts_.fill(0);
+  return std::move(entries_);
+}
+
+NDTPCaptureWriter::NDTPCaptureWriter(const std::string& path, NDTPCaptureOptions options)
+    : path_(path),
+      index_interval_(options.index_interval),
+      buffer_(nullptr, std::free),
+      index_(options.index_interval) {
+  if (options.index_interval == 0) {
+    throw std::invalid_argument("capture index interval must be non-zero");
+  }
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#ifdef O_DIRECT
+  if (options.direct_io) {
+    // file systems without O_DIRECT support (e.g. tmpfs) refuse it; those get buffered writes
+    fd_ = ::open(path.c_str(), flags | O_DIRECT, 0644);
+    direct_io_ = fd_ >= 0;
+  }
+#endif
+  if (fd_ < 0) {
+    fd_ = ::open(path.c_str(), flags, 0644);
+  }
+  if (fd_ < 0) {
+    throw file_error("failed to create capture file " + path);
+  }
+
+  buffer_size_ = std::max(DIRECT_IO_ALIGNMENT, options.buffer_bytes / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT);
+  buffer_.reset(static_cast<uint8_t*>(std::aligned_alloc(DIRECT_IO_ALIGNMENT, buffer_size_)));
+  if (!buffer_) {
+    ::close(fd_);
+    throw std::bad_alloc();
+  }
+
+  uint8_t header[NDTPCaptureReader::HEADER_SIZE] = {};
+  std::memcpy(header, FILE_MAGIC, sizeof(FILE_MAGIC));
+  store_be(header + 8, index_interval_, 4);
+  append(header, sizeof(header));
+}
+
+NDTPCaptureWriter::~NDTPCaptureWriter() {
+  try {
+    close();
+  } catch (const std::exception&) {
+  }
+}
+
+void NDTPCaptureWriter::write(const uint8_t* data, size_t size, uint64_t receive_time_ns) {
+  if (fd_ < 0) {
+    throw std::runtime_error("capture file " + path_ + " is closed");
+  }
+  if (size > UINT32_MAX) {
+    throw std::invalid_argument("datagram of " + std::to_string(size) + " bytes is too large to capture");
+  }
+  index_.add(data, size, bytes());
+
+  uint8_t record_header[NDTPCaptureReader::RECORD_HEADER_SIZE];
+  store_be(record_header, receive_time_ns, 8);
+  store_be(record_header + 8, size, 4);
+  append(record_header, sizeof(record_header));
+  append(data, size);
+  records_++;
+}
+
+void NDTPCaptureWriter::write(const uint8_t* data, size_t size) {
+  auto now = std::chrono::system_clock::now().time_since_epoch();
+  write(data, size, std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+void NDTPCaptureWriter::close() {
+  if (fd_ < 0) {
+    return;
+  }
+
+  auto index = index_.finish();
+  uint64_t index_offset = bytes();
+  for (const auto& entry : index) {
+    uint8_t bytes[NDTPCaptureReader::INDEX_ENTRY_SIZE] = {};
+    store_be(bytes, entry.timestamp, 8);
+    store_be(bytes + 8, entry.offset, 8);
+    bytes[16] = entry.data_type;
+    append(bytes, sizeof(bytes));
+  }
+  uint8_t trailer[NDTPCaptureReader::TRAILER_SIZE];
+  store_be(trailer, index_offset, 8);
+  store_be(trailer + 8, index.size(), 8);
+  std::memcpy(trailer + 16, TRAILER_MAGIC, sizeof(TRAILER_MAGIC));
+  append(trailer, sizeof(trailer));
+
+#ifdef O_DIRECT
+  // the tail is not a whole number of blocks, so it goes through the page cache
+  if (direct_io_ && fill_ % DIRECT_IO_ALIGNMENT != 0) {
+    int flags = ::fcntl(fd_, F_GETFL);
+    if (flags < 0 || ::fcntl(fd_, F_SETFL, flags & ~O_DIRECT) < 0) {
+      throw file_error("failed to finish capture file " + path_);
+    }
+  }
+#endif
+  int fd = fd_;
+  try {
+    flush_buffer();
+  } catch (...) {
+    fd_ = -1;
+    ::close(fd);
+    throw;
+  }
+  fd_ = -1;
+  if (::close(fd) < 0) {
+    throw file_error("failed to close capture file " + path_);
+  }
+}
+
+void NDTPCaptureWriter::append(const uint8_t* data, size_t size) {
+  while (size > 0) {
+    size_t n = std::min(size, buffer_size_ - fill_);
+    std::memcpy(buffer_.get() + fill_, data, n);
+    fill_ += n;
+    data += n;
+    size -= n;
+    if (fill_ == buffer_size_) {
+      flush_buffer();
+    }
+  }
+}
+
+void NDTPCaptureWriter::flush_buffer() {
+  write_fully(buffer_.get(), fill_);
+  flushed_ += fill_;
+  fill_ = 0;
+}
+
+void NDTPCaptureWriter::write_fully(const uint8_t* data, size_t size) {
+  while (size > 0) {
+    ssize_t n = ::write(fd_, data, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw file_error("failed to write capture file " + path_);
+    }
+    data += n;
+    size -= n;
+  }
+}
+
+NDTPCaptureReader::NDTPCaptureReader(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw file_error("failed to open capture file " + path);
+  }
+  struct stat st;
+  if (::fstat(fd, &st) < 0) {
+    auto error = file_error("failed to stat capture file " + path);
+    ::close(fd);
+    throw error;
+  }
+  size_ = st.st_size;
+  if (size_ < HEADER_SIZE) {
+    ::close(fd);
+    throw std::runtime_error("capture file " + path + " is too short (" + std::to_string(size_) + " bytes)");
+  }
+  void* mapping = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    throw file_error("failed to map capture file " + path);
+  }
+  data_ = static_cast<const uint8_t*>(mapping);
+
+  if (std::memcmp(data_, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) {
+    ::munmap(mapping, size_);
+    throw std::runtime_error("not an NDTP capture file: " + path);
+  }
+  index_interval_ = load_be(data_ + 8, 4);
+  if (!load_index()) {
+    rebuild_index();
+  }
+}
+
+NDTPCaptureReader::~NDTPCaptureReader() {
+  ::munmap(const_cast<uint8_t*>(data_), size_);
+}
+
+bool NDTPCaptureReader::load_index() {
+  if (size_ < HEADER_SIZE + TRAILER_SIZE) {
+    return false;
+  }
+  const uint8_t* trailer = data_ + size_ - TRAILER_SIZE;
+  if (std::memcmp(trailer + 16, TRAILER_MAGIC, sizeof(TRAILER_MAGIC)) != 0) {
+    return false;
+  }
+  uint64_t index_offset = load_be(trailer, 8);
+  uint64_t n_entries = load_be(trailer + 8, 8);
+  if (index_offset < HEADER_SIZE || index_offset > size_ - TRAILER_SIZE ||
+      n_entries != (size_ - TRAILER_SIZE - index_offset) / INDEX_ENTRY_SIZE ||
+      index_offset + n_entries * INDEX_ENTRY_SIZE != size_ - TRAILER_SIZE) {
+    throw std::runtime_error("corrupt NDTP capture trailer");
+  }
+
+  records_end_ = index_offset;
+  index_.resize(n_entries);
+  for (size_t i = 0; i < n_entries; ++i) {
+    const uint8_t* entry = data_ + index_offset + i * INDEX_ENTRY_SIZE;
+    index_[i] = NDTPCaptureIndexEntry{load_be(entry, 8), load_be(entry + 8, 8), entry[16]};
+    if (index_[i].offset < HEADER_SIZE || index_[i].offset >= records_end_) {
+      throw std::runtime_error("corrupt NDTP capture index entry " + std::to_string(i));
+    }
+  }
+  complete_ = true;
+  return true;
+}
+
+void NDTPCaptureReader::rebuild_index() {
+  // the writer stopped without closing: keep every record that was completely written
+  NDTPCaptureIndexBuilder index(std::max<uint32_t>(index_interval_, 1));
+  uint64_t pos = HEADER_SIZE;
+  while (size_ - pos >= RECORD_HEADER_SIZE) {
+    uint64_t size = load_be(data_ + pos + 8, 4);
+    if (size > size_ - pos - RECORD_HEADER_SIZE) {
+      break;
+    }
+    index.add(data_ + pos + RECORD_HEADER_SIZE, size, pos);
+    pos += RECORD_HEADER_SIZE + size;
+  }
+  records_end_ = pos;
+  index_ = index.finish();
+}
+
+bool NDTPCaptureReader::next(uint64_t& pos, NDTPCaptureRecord& record) const {
+  if (pos >= records_end_) {
+    return false;
+  }
+  if (records_end_ - pos < RECORD_HEADER_SIZE) {
+    throw std::runtime_error("truncated NDTP capture record at offset " + std::to_string(pos));
+  }
+  uint64_t size = load_be(data_ + pos + 8, 4);
+  if (size > records_end_ - pos - RECORD_HEADER_SIZE) {
+    throw std::runtime_error("truncated NDTP capture record at offset " + std::to_string(pos));
+  }
+  record.offset = pos;
+  record.receive_time_ns = load_be(data_ + pos, 8);
+  record.datagram = ByteSpan{data_ + pos + RECORD_HEADER_SIZE, size};
+  pos += RECORD_HEADER_SIZE + size;
+  return true;
+}
+
+uint64_t NDTPCaptureReader::seek(uint64_t timestamp, uint8_t data_type) const {
+  data_type = stream_data_type(data_type);
+  auto by_type = [](const NDTPCaptureIndexEntry& entry, uint8_t type) { return entry.data_type < type; };
+  auto first = std::lower_bound(index_.begin(), index_.end(), data_type, by_type);
+  auto last = first;
+  while (last != index_.end() && last->data_type == data_type) {
+    ++last;
+  }
+  // the record sought is after the last entry before the timestamp, and at or before the first
+  // entry at or after it; several records can share a timestamp, so the scan starts before all of
+  // them. A timestamp past the stream's last record has none.
+  auto at_or_after = std::lower_bound(first, last, timestamp, [](const NDTPCaptureIndexEntry& entry, uint64_t t) {
+    return entry.timestamp < t;
+  });
+  if (at_or_after == last) {
+    return records_end_;
+  }
+  uint64_t pos = at_or_after == first ? first->offset : std::prev(at_or_after)->offset;
+
+  NDTPCaptureRecord record;
+  for (uint64_t at = pos; next(pos, record); at = pos) {
+    uint64_t record_timestamp;
+    uint8_t record_type;
+    if (peek_header(record.datagram.data, record.datagram.size, record_timestamp, record_type) &&
+        record_type == data_type && record_timestamp >= timestamp) {
+      return at;
+    }
+  }
+  return records_end_;
+}
+
+uint64_t NDTPCaptureReader::seek(uint64_t timestamp) const {
+  uint64_t pos = records_end_;
+  for (size_t i = 0; i < index_.size();) {
+    uint8_t data_type = index_[i].data_type;
+    pos = std::min(pos, seek(timestamp, data_type));
+    while (i < index_.size() && index_[i].data_type == data_type) {
+      ++i;
+    }
+  }
+  return pos;
+}
+
+}  // namespace science::libndtp
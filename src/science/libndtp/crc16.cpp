@@ -0,0 +1,175 @@
+#include "science/libndtp/crc16.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LIBNDTP_CRC16_PCLMUL 1
+#define LIBNDTP_TARGET_PCLMUL __attribute__((target("pclmul,sse4.1")))
+#endif
+
+namespace science::libndtp {
+
+namespace {
+
+// CRC-16/ARC polynomial x^16 + x^15 + x^2 + 1, bit reflected.
+constexpr uint16_t POLY_REFLECTED = 0xA001;
+constexpr uint32_t POLY = 0x18005;
+
+using Crc16Tables = std::array<std::array<uint16_t, 256>, 8>;
+
+// tables[k][b] advances byte b through k further zero bytes, for slice-by-8.
+constexpr Crc16Tables make_tables() {
+  Crc16Tables tables{};
+  for (int b = 0; b < 256; b++) {
+    uint16_t crc = b;
+    for (int i = 0; i < 8; i++) {
+      crc = (crc & 1) ? (crc >> 1) ^ POLY_REFLECTED : crc >> 1;
+    }
+    tables[0][b] = crc;
+  }
+  for (int k = 1; k < 8; k++) {
+    for (int b = 0; b < 256; b++) {
+      uint16_t prev = tables[k - 1][b];
+      tables[k][b] = (prev >> 8) ^ tables[0][prev & 0xFF];
+    }
+  }
+  return tables;
+}
+
+constexpr Crc16Tables TABLES = make_tables();
+
+uint16_t update_tables(uint16_t crc, const uint8_t* data, size_t size) {
+  while (size >= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    word ^= crc;
+    crc = TABLES[7][word & 0xFF] ^ TABLES[6][(word >> 8) & 0xFF] ^ TABLES[5][(word >> 16) & 0xFF] ^
+          TABLES[4][(word >> 24) & 0xFF] ^ TABLES[3][(word >> 32) & 0xFF] ^ TABLES[2][(word >> 40) & 0xFF] ^
+          TABLES[1][(word >> 48) & 0xFF] ^ TABLES[0][word >> 56];
+    data += 8;
+    size -= 8;
+  }
+  while (size-- > 0) {
+    crc = (crc >> 8) ^ TABLES[0][(crc ^ *data++) & 0xFF];
+  }
+  return crc;
+}
+
+#ifdef LIBNDTP_CRC16_PCLMUL
+
+// Below this size the table path is faster than setting up the folding loop.
+constexpr size_t PCLMUL_MIN_SIZE = 64;
+
+bool detect_pclmul() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+}
+
+// x^n mod P, in normal (unreflected) bit order.
+uint32_t xpow_mod(size_t n) {
+  uint32_t r = 1;
+  for (size_t i = 0; i < n; i++) {
+    r <<= 1;
+    if (r & 0x10000) {
+      r ^= POLY;
+    }
+  }
+  return r;
+}
+
+// A polynomial of degree < 64 with bit i holding the coefficient of x^(63 - i).
+uint64_t reflect64(uint32_t poly) {
+  uint64_t r = 0;
+  for (int d = 0; d < 16; d++) {
+    if (poly & (1u << d)) {
+      r |= 1ULL << (63 - d);
+    }
+  }
+  return r;
+}
+
+/**
+ * Constants to move a 128-bit block D bits further along the message. A block loaded from memory
+ * holds x^127 in bit 0 (reflected), so its low qword H is the high-order half: H * x^64 + L.
+ * Advancing it by D bits is H * x^(D + 64) + L * x^D, reduced mod P. A reflected carry-less
+ * product comes out one bit short (bit k holds x^(126 - k)), hence the exponents are one lower.
+ */
+struct FoldConstants {
+  uint64_t high;
+  uint64_t low;
+};
+
+FoldConstants fold_constants(size_t distance_bits) {
+  return {reflect64(xpow_mod(distance_bits + 64 - 1)), reflect64(xpow_mod(distance_bits - 1))};
+}
+
+const FoldConstants FOLD_128 = fold_constants(128);
+const FoldConstants FOLD_512 = fold_constants(512);
+
+// initialized after the constants, so callers during static initialization fall back to the tables
+const bool has_pclmul = detect_pclmul();
+
+LIBNDTP_TARGET_PCLMUL inline __m128i fold(__m128i block, __m128i constants) {
+  return _mm_xor_si128(_mm_clmulepi64_si128(block, constants, 0x00), _mm_clmulepi64_si128(block, constants, 0x11));
+}
+
+inline __m128i load(const uint8_t* data) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+}
+
+// Folds the message into one 128-bit block congruent to it mod P, then finishes with the tables.
+LIBNDTP_TARGET_PCLMUL uint16_t update_pclmul(uint16_t crc, const uint8_t* data, size_t size) {
+  const __m128i k512 = _mm_set_epi64x(FOLD_512.low, FOLD_512.high);
+  const __m128i k128 = _mm_set_epi64x(FOLD_128.low, FOLD_128.high);
+
+  // the running CRC is equivalent to XOR-ing it into the first two message bytes
+  __m128i x0 = _mm_xor_si128(load(data), _mm_cvtsi32_si128(crc));
+  __m128i x1 = load(data + 16);
+  __m128i x2 = load(data + 32);
+  __m128i x3 = load(data + 48);
+  data += 64;
+  size -= 64;
+
+  while (size >= 64) {
+    x0 = _mm_xor_si128(fold(x0, k512), load(data));
+    x1 = _mm_xor_si128(fold(x1, k512), load(data + 16));
+    x2 = _mm_xor_si128(fold(x2, k512), load(data + 32));
+    x3 = _mm_xor_si128(fold(x3, k512), load(data + 48));
+    data += 64;
+    size -= 64;
+  }
+
+  __m128i x = _mm_xor_si128(fold(x0, k128), x1);
+  x = _mm_xor_si128(fold(x, k128), x2);
+  x = _mm_xor_si128(fold(x, k128), x3);
+  while (size >= 16) {
+    x = _mm_xor_si128(fold(x, k128), load(data));
+    data += 16;
+    size -= 16;
+  }
+
+  uint8_t block[16];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(block), x);
+  return update_tables(update_tables(0, block, sizeof(block)), data, size);
+}
+
+#endif  // LIBNDTP_CRC16_PCLMUL
+
+}  // namespace
+
+void Crc16State::update(const uint8_t* data, size_t size) {
+#ifdef LIBNDTP_CRC16_PCLMUL
+  if (has_pclmul && size >= PCLMUL_MIN_SIZE) {
+    crc_ = update_pclmul(crc_, data, size);
+    return;
+  }
+#endif
+  crc_ = update_tables(crc_, data, size);
+}
+
+}  // namespace science::libndtp
@@ -1,8 +1,14 @@
 // src/Ndtp.cpp
 #include "science/libndtp/ndtp.h"
+#include <algorithm>
+#include <array>
 #include <bit>
 #include <cstring>
 #include <iostream>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include "science/libndtp/simd.h"
 #include "science/libndtp/utils.h"
 
 namespace science::libndtp {
@@ -26,7 +32,17 @@ std::vector<uint64_t> to_unsigned(const std::vector<int64_t>& signed_vec) {
 
 ByteArray NDTPHeader::pack() const {
   ByteArray data(NDTP_HEADER_SIZE);
-  uint8_t* ptr = data.data();
+  pack_into(data.data(), data.size());
+  return data;
+}
+
+size_t NDTPHeader::pack_into(uint8_t* dst, size_t cap) const {
+  if (cap < NDTP_HEADER_SIZE) {
+    throw std::invalid_argument(
+        "insufficient buffer for header: expected " + std::to_string(NDTP_HEADER_SIZE) + ", got " + std::to_string(cap)
+    );
+  }
+  uint8_t* ptr = dst;
 
   *ptr++ = version;
   *ptr++ = data_type;
@@ -37,18 +53,21 @@ ByteArray NDTPHeader::pack() const {
 
   uint16_t n_seq_number = htons(seq_number);
   std::memcpy(ptr, &n_seq_number, sizeof(n_seq_number));
-  ptr += sizeof(n_seq_number);
 
-  return data;
+  return NDTP_HEADER_SIZE;
 }
 
 NDTPHeader NDTPHeader::unpack(const ByteArray& data) {
-  if (data.size() < NDTP_HEADER_SIZE) {
+  return unpack(data.data(), data.size());
+}
+
+NDTPHeader NDTPHeader::unpack(const uint8_t* data, size_t size) {
+  if (size < NDTP_HEADER_SIZE) {
     throw std::invalid_argument(
-        "invalid header size: expected " + std::to_string(NDTP_HEADER_SIZE) + ", got " + std::to_string(data.size())
+        "invalid header size: expected " + std::to_string(NDTP_HEADER_SIZE) + ", got " + std::to_string(size)
     );
   }
-  const uint8_t* ptr = data.data();
+  const uint8_t* ptr = data;
 
   uint8_t version = *ptr++;
   if (version != NDTP_VERSION) {
@@ -70,8 +89,20 @@ NDTPHeader NDTPHeader::unpack(const ByteArray& data) {
 }
 
 template <typename T>
-GenericNDTPPayloadBroadband<uint64_t> GenericNDTPPayloadBroadband<T>::unpack(const ByteArray& data) {
-  if (data.size() < 7) {
+GenericNDTPPayloadBroadband<T> GenericNDTPPayloadBroadband<T>::unpack(const ByteArray& data) {
+  return unpack(data.data(), data.size());
+}
+
+template <typename T>
+GenericNDTPPayloadBroadband<T> GenericNDTPPayloadBroadband<T>::unpack(const uint8_t* data, size_t size) {
+  GenericNDTPPayloadBroadband payload{};
+  unpack_into(data, size, payload);
+  return payload;
+}
+
+template <typename T>
+void GenericNDTPPayloadBroadband<T>::unpack_into(const uint8_t* data, size_t size, GenericNDTPPayloadBroadband& out) {
+  if (size < 7) {
     throw std::runtime_error("Invalid data size for NDTPPayloadBroadband");
   }
   uint8_t bit_width = data[0] >> 1;
@@ -79,72 +110,422 @@ GenericNDTPPayloadBroadband<uint64_t> GenericNDTPPayloadBroadband<T>::unpack(con
   uint32_t num_channels = (data[1] << 16) | (data[2] << 8) | (data[3]);
   uint32_t sample_rate = (data[4] << 16) | (data[5] << 8) | (data[6]);
 
-  BitOffset offset = 0;
-  ByteArray truncated = std::vector<uint8_t>(data.begin() + 7, data.end());
-  std::vector<NDTPPayloadBroadband::ChannelData> channels;
-  for (uint32_t i = 0; i < num_channels; ++i) {
-    auto u_channel_id = to_ints<uint32_t>(truncated, 24, 1, offset);
-    uint32_t channel_id = std::get<0>(u_channel_id)[0];
-    offset = std::get<1>(u_channel_id);
-    truncated = std::get<2>(u_channel_id);
-
-    auto u_num_samples = to_ints<uint16_t>(truncated, 16, 1, offset);
-    uint16_t num_samples = std::get<0>(u_num_samples)[0];
-    offset = std::get<1>(u_num_samples);
-    truncated = std::get<2>(u_num_samples);
-
-    auto u_channel_data = to_ints<uint64_t>(truncated, bit_width, num_samples, offset, is_signed);
-    std::vector<uint64_t> channel_data = std::get<0>(u_channel_data);
-    offset = std::get<1>(u_channel_data);
-    truncated = std::get<2>(u_channel_data);
-
-    channels.emplace_back(NDTPPayloadBroadband::ChannelData{
-      .channel_id = channel_id,
-      .channel_data = channel_data
-    });
-  }
-
-  return NDTPPayloadBroadband{
-      .is_signed = is_signed,
-      .bit_width = bit_width,
-      .ch_count = num_channels,
-      .sample_rate = sample_rate,
-      .channels = channels
+  if (bit_width < 1 || bit_width > 64) {
+    throw std::runtime_error("invalid bit width for NDTPPayloadBroadband: " + std::to_string(bit_width));
+  }
+  check_broadband_sample_type<T>(bit_width, is_signed);
+
+  // channel data is read in place, past the fixed fields; the channel count is checked against
+  // the data before `out` is resized to it
+  BitReader reader(data + 7, size - 7);
+  if (num_channels > reader.bits_remaining() / (24 + 16)) {
+    throw std::runtime_error("insufficient data for channel header in NDTPPayloadBroadband");
+  }
+  out.is_signed = is_signed;
+  out.bit_width = bit_width;
+  out.ch_count = num_channels;
+  out.sample_rate = sample_rate;
+  out.channels.resize(num_channels);
+  for (auto& channel : out.channels) {
+    if (reader.bits_remaining() < 24 + 16) {
+      throw std::runtime_error("insufficient data for channel header in NDTPPayloadBroadband");
+    }
+    channel.channel_id = reader.read(24);
+    uint16_t num_samples = reader.read(16);
+
+    channel.channel_data.resize(num_samples);
+    reader.read(channel.channel_data.data(), num_samples, bit_width, is_signed);
+  }
+}
+
+template struct GenericNDTPPayloadBroadband<uint64_t>;
+template struct GenericNDTPPayloadBroadband<int64_t>;
+template struct GenericNDTPPayloadBroadband<uint32_t>;
+template struct GenericNDTPPayloadBroadband<int32_t>;
+template struct GenericNDTPPayloadBroadband<uint16_t>;
+template struct GenericNDTPPayloadBroadband<int16_t>;
+template struct GenericNDTPPayloadBroadband<uint8_t>;
+template struct GenericNDTPPayloadBroadband<int8_t>;
+
+// Implementation of NDTPPayloadBroadbandDelta
+namespace {
+
+constexpr size_t DELTA_BLOCK = NDTPPayloadBroadbandDelta::BLOCK_SIZE;
+
+// Zigzag codes of the differences between consecutive samples, wrapped to `bit_width` bits:
+// codes[i] encodes samples[i + 1] - samples[i]. Returns the OR of the codes. The loop has no
+// branches, so it vectorizes.
+uint64_t delta_encode(const uint64_t* samples, size_t n, uint8_t bit_width, uint64_t* codes) {
+  uint64_t mask = low_bits_mask(bit_width);
+  uint64_t sign = 1ULL << (bit_width - 1);
+  uint64_t acc = 0;
+  for (size_t i = 0; i < n; ++i) {
+    // sign extend the wrapped difference, then fold the sign into the low bit
+    uint64_t delta = (((samples[i + 1] - samples[i]) & mask) ^ sign) - sign;
+    codes[i] = (delta << 1) ^ (0 - (delta >> 63));
+    acc |= codes[i];
+  }
+  return acc;
+}
+
+uint8_t code_width(uint64_t codes_or) {
+  return codes_or == 0 ? 0 : 64 - __builtin_clzll(codes_or);
+}
+
+// Bytes taken by `n` codes of `width` bits.
+size_t block_bytes(size_t n, uint8_t width) {
+  return (n * width + 7) / 8;
+}
+
+// A block of codes of Width bits packed MSB first fills 4 * Width bytes, i.e. ceil(Width / 2)
+// big-endian words. The position of every code is a compile time constant, so packing and
+// unpacking a block unrolls into straight-line shifts with no per-code branches.
+template <unsigned Width, size_t... I>
+void pack_block(const uint64_t* codes, uint64_t* words, std::index_sequence<I...>) {
+  auto put = [&](auto i) {
+    constexpr size_t bit = decltype(i)::value * Width;
+    constexpr unsigned offset = bit % 64;
+    if constexpr (offset + Width <= 64) {
+      words[bit / 64] |= codes[i] << (64 - offset - Width);
+    } else {
+      words[bit / 64] |= codes[i] >> (offset + Width - 64);
+      words[bit / 64 + 1] |= codes[i] << (128 - offset - Width);
+    }
+  };
+  (put(std::integral_constant<size_t, I>{}), ...);
+}
+
+template <unsigned Width, size_t... I>
+void unpack_block(const uint64_t* words, uint64_t* codes, std::index_sequence<I...>) {
+  auto get = [&](auto i) {
+    constexpr size_t bit = decltype(i)::value * Width;
+    constexpr unsigned offset = bit % 64;
+    if constexpr (offset + Width <= 64) {
+      codes[i] = (words[bit / 64] << offset) >> (64 - Width);
+    } else {
+      codes[i] = ((words[bit / 64] << offset) >> (64 - Width)) | (words[bit / 64 + 1] >> (128 - offset - Width));
+    }
+  };
+  (get(std::integral_constant<size_t, I>{}), ...);
+}
+
+using BlockFn = void (*)(const uint64_t*, uint64_t*);
+
+template <size_t... W>
+constexpr std::array<BlockFn, 65> block_packers(std::index_sequence<W...>) {
+  return {nullptr, [](const uint64_t* codes, uint64_t* words) {
+    pack_block<W + 1>(codes, words, std::make_index_sequence<DELTA_BLOCK>{});
+  }...};
+}
+
+template <size_t... W>
+constexpr std::array<BlockFn, 65> block_unpackers(std::index_sequence<W...>) {
+  return {nullptr, [](const uint64_t* words, uint64_t* codes) {
+    unpack_block<W + 1>(words, codes, std::make_index_sequence<DELTA_BLOCK>{});
+  }...};
+}
+
+// indexed by width, 1 to 64
+constexpr auto PACK_BLOCK = block_packers(std::make_index_sequence<64>{});
+constexpr auto UNPACK_BLOCK = block_unpackers(std::make_index_sequence<64>{});
+
+uint64_t load_be64(const uint8_t* src) {
+  uint64_t word;
+  std::memcpy(&word, src, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return word;
+#else
+  return __builtin_bswap64(word);
+#endif
+}
+
+void store_be64(uint8_t* dst, uint64_t word) {
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
+  std::memcpy(dst, &word, sizeof(word));
+}
+
+}  // namespace
+
+size_t NDTPPayloadBroadbandDelta::encoded_size() const {
+  if (!channels.empty() && (bit_width < 1 || bit_width > 64)) {
+    throw std::invalid_argument("invalid bit width for NDTPPayloadBroadbandDelta: " + std::to_string(bit_width));
+  }
+  uint64_t codes[DELTA_BLOCK];
+  size_t size = 7;
+  for (const auto& c : channels) {
+    size += 5;
+    size_t n_samples = c.channel_data.size();
+    if (n_samples == 0) {
+      continue;
+    }
+    size += (bit_width + 7) / 8;
+    for (size_t i = 0; i + 1 < n_samples; i += DELTA_BLOCK) {
+      size_t n = std::min(DELTA_BLOCK, n_samples - 1 - i);
+      size += 1 + block_bytes(n, code_width(delta_encode(c.channel_data.data() + i, n, bit_width, codes)));
+    }
+  }
+  return size;
+}
+
+ByteArray NDTPPayloadBroadbandDelta::pack() const {
+  ByteArray result(encoded_size());
+  pack_into(result.data(), result.size());
+  return result;
+}
+
+size_t NDTPPayloadBroadbandDelta::pack_into(uint8_t* dst, size_t cap) const {
+  // the exact size takes a pass over the samples, which a buffer that holds every block at the
+  // full bit width makes unnecessary
+  size_t first_bytes = (bit_width + 7) / 8;
+  size_t max_size = 7;
+  // bytes still to be written after the current one, at least: a header and first sample per
+  // channel and a width byte per block
+  size_t min_rest = 0;
+  for (const auto& c : channels) {
+    size_t n_codes = c.channel_data.empty() ? 0 : c.channel_data.size() - 1;
+    size_t n_blocks = (n_codes + DELTA_BLOCK - 1) / DELTA_BLOCK;
+    max_size += 5 + first_bytes + n_codes / DELTA_BLOCK * (1 + block_bytes(DELTA_BLOCK, bit_width)) +
+                (n_codes % DELTA_BLOCK > 0 ? 1 + block_bytes(n_codes % DELTA_BLOCK, bit_width) : 0);
+    min_rest += 5 + (c.channel_data.empty() ? 0 : first_bytes) + n_blocks;
+  }
+  if (cap < max_size) {
+    size_t size = encoded_size();
+    if (cap < size) {
+      throw std::runtime_error(
+        "insufficient buffer for NDTPPayloadBroadbandDelta (expected " + std::to_string(size) +
+        ", got " + std::to_string(cap) + ")"
+      );
+    }
+  } else if (!channels.empty() && (bit_width < 1 || bit_width > 64)) {
+    throw std::invalid_argument("invalid bit width for NDTPPayloadBroadbandDelta: " + std::to_string(bit_width));
+  }
+
+  // the fixed fields are laid out as in NDTPPayloadBroadband
+  uint32_t n_channels = channels.size();
+  dst[0] = ((bit_width & 0x7F) << 1) | (is_signed ? 1 : 0);
+  dst[1] = (n_channels >> 16) & 0xFF;
+  dst[2] = (n_channels >> 8) & 0xFF;
+  dst[3] = n_channels & 0xFF;
+  dst[4] = (sample_rate >> 16) & 0xFF;
+  dst[5] = (sample_rate >> 8) & 0xFF;
+  dst[6] = sample_rate & 0xFF;
+
+  uint64_t codes[DELTA_BLOCK];
+  uint8_t block[DELTA_BLOCK * 8];
+  uint8_t* ptr = dst + 7;
+  for (const auto& c : channels) {
+    size_t n_samples = c.channel_data.size();
+    if (n_samples > 0xFFFF) {
+      throw std::runtime_error("number of samples is too large, must be less than 65536");
+    }
+    *ptr++ = (c.channel_id >> 16) & 0xFF;
+    *ptr++ = (c.channel_id >> 8) & 0xFF;
+    *ptr++ = c.channel_id & 0xFF;
+    *ptr++ = (n_samples >> 8) & 0xFF;
+    *ptr++ = n_samples & 0xFF;
+    min_rest -= 5;
+    if (n_samples == 0) {
+      continue;
+    }
+
+    uint64_t first = c.channel_data[0] & low_bits_mask(bit_width);
+    for (int b = static_cast<int>(first_bytes) - 1; b >= 0; --b) {
+      *ptr++ = (first >> (8 * b)) & 0xFF;
+    }
+    min_rest -= first_bytes;
+    for (size_t i = 0; i + 1 < n_samples; i += DELTA_BLOCK) {
+      size_t n = std::min(DELTA_BLOCK, n_samples - 1 - i);
+      uint8_t width = code_width(delta_encode(c.channel_data.data() + i, n, bit_width, codes));
+      *ptr++ = width;
+      min_rest--;
+      if (width == 0) {
+        continue;
+      }
+      // codes past the end of a short block are zero, so they leave the padding bits clear
+      std::fill(codes + n, codes + DELTA_BLOCK, 0);
+      size_t n_words = (width + 1) / 2u;
+      uint64_t words[DELTA_BLOCK];
+      std::fill(words, words + n_words, 0);
+      PACK_BLOCK[width](codes, words);
+      // whole words go straight to the output when the bytes past the block are sure to be
+      // overwritten by what follows it, so nothing past encoded_size() is written
+      size_t n_bytes = block_bytes(n, width);
+      uint8_t* out = 8 * n_words <= n_bytes + min_rest ? ptr : block;
+      for (size_t w = 0; w < n_words; ++w) {
+        store_be64(out + 8 * w, words[w]);
+      }
+      if (out == block) {
+        std::memcpy(ptr, block, n_bytes);
+      }
+      ptr += n_bytes;
+    }
+  }
+
+  return ptr - dst;
+}
+
+NDTPPayloadBroadbandDelta NDTPPayloadBroadbandDelta::unpack(const ByteArray& data) {
+  return unpack(data.data(), data.size());
+}
+
+NDTPPayloadBroadbandDelta NDTPPayloadBroadbandDelta::unpack(const uint8_t* data, size_t size) {
+  NDTPPayloadBroadbandDelta payload{};
+  unpack_into(data, size, payload);
+  return payload;
+}
+
+void NDTPPayloadBroadbandDelta::unpack_into(const uint8_t* data, size_t size, NDTPPayloadBroadbandDelta& out) {
+  if (size < 7) {
+    throw std::runtime_error("Invalid data size for NDTPPayloadBroadbandDelta");
+  }
+  uint8_t bit_width = data[0] >> 1;
+  bool is_signed = (data[0] & 1) == 1;
+  uint32_t n_channels = (data[1] << 16) | (data[2] << 8) | data[3];
+  uint32_t sample_rate = (data[4] << 16) | (data[5] << 8) | data[6];
+  if (bit_width < 1 || bit_width > 64) {
+    throw std::runtime_error("invalid bit width for NDTPPayloadBroadbandDelta: " + std::to_string(bit_width));
+  }
+
+  // samples are rebuilt as a running sum wrapped to the bit width, then sign extended if signed;
+  // masking and sign extension fold into one xor and subtract
+  uint64_t mask = low_bits_mask(bit_width);
+  uint64_t sign = is_signed ? 1ULL << (bit_width - 1) : 0;
+  size_t first_bytes = (bit_width + 7) / 8;
+
+  auto insufficient = [](const char* what) {
+    return std::runtime_error(std::string("insufficient data for ") + what + " in NDTPPayloadBroadbandDelta");
   };
+
+  // every channel takes at least its 5 byte header, which bounds the count before `out` is resized
+  if (n_channels > (size - 7) / 5) {
+    throw insufficient("channel header");
+  }
+  out.is_signed = is_signed;
+  out.bit_width = bit_width;
+  out.sample_rate = sample_rate;
+  out.channels.resize(n_channels);
+  uint64_t codes[DELTA_BLOCK];
+  uint8_t block[DELTA_BLOCK * 8];
+  const uint8_t* ptr = data + 7;
+  const uint8_t* end = data + size;
+  for (auto& channel : out.channels) {
+    if (end - ptr < 5) {
+      throw insufficient("channel header");
+    }
+    channel.channel_id = (ptr[0] << 16) | (ptr[1] << 8) | ptr[2];
+    size_t n_samples = (ptr[3] << 8) | ptr[4];
+    ptr += 5;
+    channel.channel_data.resize(n_samples);
+    if (n_samples > 0) {
+      if (static_cast<size_t>(end - ptr) < first_bytes) {
+        throw insufficient("first sample");
+      }
+      uint64_t* samples = channel.channel_data.data();
+      samples[0] = 0;
+      for (size_t b = 0; b < first_bytes; ++b) {
+        samples[0] = (samples[0] << 8) | *ptr++;
+      }
+
+      for (size_t i = 1; i < n_samples; i += DELTA_BLOCK) {
+        size_t n = std::min(DELTA_BLOCK, n_samples - i);
+        if (ptr == end) {
+          throw insufficient("block width");
+        }
+        uint8_t width = *ptr++;
+        if (width > bit_width) {
+          throw std::runtime_error(
+            "invalid block width for NDTPPayloadBroadbandDelta: " + std::to_string(width) + " > " +
+            std::to_string(bit_width)
+          );
+        }
+        if (width == 0) {
+          std::fill(samples + i, samples + i + n, 0);
+          continue;
+        }
+        size_t n_bytes = block_bytes(n, width);
+        if (static_cast<size_t>(end - ptr) < n_bytes) {
+          throw insufficient("samples");
+        }
+        // whole words are loaded in place when they are within the buffer (bits past a short
+        // block only end up in codes past its end), otherwise the block is copied out first
+        size_t n_words = (width + 1) / 2u;
+        const uint8_t* in = ptr;
+        if (static_cast<size_t>(end - ptr) < 8 * n_words) {
+          std::memcpy(block, ptr, n_bytes);
+          std::memset(block + n_bytes, 0, 8 * n_words - n_bytes);
+          in = block;
+        }
+        ptr += n_bytes;
+        uint64_t words[DELTA_BLOCK];
+        for (size_t w = 0; w < n_words; ++w) {
+          words[w] = load_be64(in + 8 * w);
+        }
+        UNPACK_BLOCK[width](words, codes);
+        for (size_t j = 0; j < n; ++j) {
+          samples[i + j] = (codes[j] >> 1) ^ (0 - (codes[j] & 1));
+        }
+      }
+
+      uint64_t value = 0;
+      for (size_t i = 0; i < n_samples; ++i) {
+        value += samples[i];
+        samples[i] = ((value & mask) ^ sign) - sign;
+      }
+    }
+  }
 }
 
 // Implementation of NDTPPayloadSpiketrain
+size_t NDTPPayloadSpiketrain::encoded_size() const {
+  return 5 + (spike_counts.size() * BIT_WIDTH_BINNED_SPIKES + 7) / 8;
+}
+
 ByteArray NDTPPayloadSpiketrain::pack() const {
-  size_t sample_count = spike_counts.size();
-  uint8_t clamp_value = (1 << BIT_WIDTH_BINNED_SPIKES) - 1;
-  std::vector<uint64_t> clamped_counts;
+  ByteArray result(encoded_size());
+  pack_into(result.data(), result.size());
+  return result;
+}
 
-  // clamp spike counts to max value allowed by bit width
-  for (const auto& count : spike_counts) {
-    clamped_counts.push_back(std::min(static_cast<uint8_t>(count), clamp_value));
+size_t NDTPPayloadSpiketrain::pack_into(uint8_t* dst, size_t cap) const {
+  size_t size = encoded_size();
+  if (cap < size) {
+    throw std::runtime_error(
+      "insufficient buffer for NDTPPayloadSpiketrain (expected " + std::to_string(size) +
+      ", got " + std::to_string(cap) + ")"
+    );
   }
 
-  ByteArray result;  // Start with 4 bytes for sample_count
-
   // Pack sample_count (4 bytes)
-  uint32_t n_num_counts = sample_count;
-  result.push_back((n_num_counts >> 24) & 0xFF);
-  result.push_back((n_num_counts >> 16) & 0xFF);
-  result.push_back((n_num_counts >> 8) & 0xFF);
-  result.push_back(n_num_counts & 0xFF);
+  uint32_t n_num_counts = spike_counts.size();
+  dst[0] = (n_num_counts >> 24) & 0xFF;
+  dst[1] = (n_num_counts >> 16) & 0xFF;
+  dst[2] = (n_num_counts >> 8) & 0xFF;
+  dst[3] = n_num_counts & 0xFF;
 
   // Pack bin_size_ms (1 byte)
-  result.push_back(bin_size_ms);
+  dst[4] = bin_size_ms;
 
-  
-  // pack clamped spike counts
-  auto [bytes, final_bit_offset, _] = to_bytes(clamped_counts, BIT_WIDTH_BINNED_SPIKES, result, 0);
+  // pack spike counts, clamped to the max value allowed by the bit width, two to a byte
+  static_assert(BIT_WIDTH_BINNED_SPIKES == 4, "spike counts are packed as nibbles");
+  simd::pack_nibbles(spike_counts.data(), spike_counts.size(), dst + 5);
 
-  return result;
+  return size;
 }
 
 NDTPPayloadSpiketrain NDTPPayloadSpiketrain::unpack(const ByteArray& data) {
-  if (data.size() < 5) {
+  return unpack(data.data(), data.size());
+}
+
+NDTPPayloadSpiketrain NDTPPayloadSpiketrain::unpack(const uint8_t* data, size_t size) {
+  NDTPPayloadSpiketrain payload{};
+  unpack_into(data, size, payload);
+  return payload;
+}
+
+void NDTPPayloadSpiketrain::unpack_into(const uint8_t* data, size_t size, NDTPPayloadSpiketrain& out) {
+  if (size < 5) {
     throw std::runtime_error("Invalid data size for NDTPPayloadSpiketrain");
   }
 
@@ -155,84 +536,314 @@ NDTPPayloadSpiketrain NDTPPayloadSpiketrain::unpack(const ByteArray& data) {
   uint8_t bin_size_ms = data[4];
 
   // unpack spike_counts
-  std::vector<uint8_t> payload(data.begin() + 5, data.end());
-  auto bits_needed = sample_count * BIT_WIDTH_BINNED_SPIKES;
-  auto bytes_needed = (bits_needed + 7) / 8;
-  if (payload.size() < bytes_needed) {
+  size_t payload_size = size - 5;
+  size_t bytes_needed = (static_cast<size_t>(sample_count) * BIT_WIDTH_BINNED_SPIKES + 7) / 8;
+  if (payload_size < bytes_needed) {
     throw std::runtime_error(
       "insufficient data for spike_count (expected " + std::to_string(bytes_needed) +
-      ", got " + std::to_string(payload.size()) + ")"
+      ", got " + std::to_string(payload_size) + ")"
     );
   }
 
-  payload.resize(bytes_needed);
-  std::vector<uint8_t> spike_counts;
-  std::tie(spike_counts, std::ignore, std::ignore) = to_ints<uint8_t>(
-    payload, BIT_WIDTH_BINNED_SPIKES, sample_count
-  );
+  out.bin_size_ms = bin_size_ms;
+  out.spike_counts.resize(sample_count);
+  simd::unpack_nibbles(data + 5, sample_count, out.spike_counts.data());
+}
+
+// Implementation of NDTPPayloadSpiketrainSparse
+namespace {
+
+size_t count_nonzero(const std::vector<uint8_t>& counts) {
+  size_t n = 0;
+  for (auto count : counts) {
+    n += count != 0;
+  }
+  return n;
+}
+
+}  // namespace
 
-  return NDTPPayloadSpiketrain {
-    .bin_size_ms = bin_size_ms,
-    .spike_counts = spike_counts
-  };
+size_t NDTPPayloadSpiketrainSparse::encoded_size() const {
+  size_t n_entries = count_nonzero(spike_counts);
+  return 9 + (n_entries * (index_bits(spike_counts.size()) + BIT_WIDTH_BINNED_SPIKES) + 7) / 8;
+}
+
+ByteArray NDTPPayloadSpiketrainSparse::pack() const {
+  ByteArray result(encoded_size());
+  pack_into(result.data(), result.size());
+  return result;
+}
+
+size_t NDTPPayloadSpiketrainSparse::pack_into(uint8_t* dst, size_t cap) const {
+  size_t size = encoded_size();
+  if (cap < size) {
+    throw std::runtime_error(
+      "insufficient buffer for NDTPPayloadSpiketrainSparse (expected " + std::to_string(size) +
+      ", got " + std::to_string(cap) + ")"
+    );
+  }
+
+  if (spike_counts.size() > MAX_BINS) {
+    throw std::invalid_argument(
+      "too many bins for NDTPPayloadSpiketrainSparse (" + std::to_string(spike_counts.size()) +
+      ", max " + std::to_string(MAX_BINS) + ")"
+    );
+  }
+
+  // bin count and bin size as in NDTPPayloadSpiketrain, then the entry count
+  uint32_t n_bins = spike_counts.size();
+  uint32_t n_entries = count_nonzero(spike_counts);
+  dst[0] = (n_bins >> 24) & 0xFF;
+  dst[1] = (n_bins >> 16) & 0xFF;
+  dst[2] = (n_bins >> 8) & 0xFF;
+  dst[3] = n_bins & 0xFF;
+  dst[4] = bin_size_ms;
+  dst[5] = (n_entries >> 24) & 0xFF;
+  dst[6] = (n_entries >> 16) & 0xFF;
+  dst[7] = (n_entries >> 8) & 0xFF;
+  dst[8] = n_entries & 0xFF;
+
+  // each entry is written as one field, the index above the clamped count
+  uint8_t clamp_value = (1 << BIT_WIDTH_BINNED_SPIKES) - 1;
+  uint8_t entry_bits = index_bits(n_bins) + BIT_WIDTH_BINNED_SPIKES;
+  BitWriter writer(dst + 9, size - 9);
+  for (uint32_t i = 0; i < n_bins; ++i) {
+    if (spike_counts[i] != 0) {
+      writer.write((static_cast<uint64_t>(i) << BIT_WIDTH_BINNED_SPIKES) | std::min(spike_counts[i], clamp_value), entry_bits);
+    }
+  }
+  writer.finish();
+
+  return size;
+}
+
+NDTPPayloadSpiketrainSparse NDTPPayloadSpiketrainSparse::unpack(const ByteArray& data) {
+  return unpack(data.data(), data.size());
+}
+
+NDTPPayloadSpiketrainSparse NDTPPayloadSpiketrainSparse::unpack(const uint8_t* data, size_t size) {
+  NDTPPayloadSpiketrainSparse payload{};
+  unpack_into(data, size, payload);
+  return payload;
+}
+
+void NDTPPayloadSpiketrainSparse::unpack_into(const uint8_t* data, size_t size, NDTPPayloadSpiketrainSparse& out) {
+  if (size < 9) {
+    throw std::runtime_error("Invalid data size for NDTPPayloadSpiketrainSparse");
+  }
+  uint32_t n_bins = data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3];
+  uint8_t bin_size_ms = data[4];
+  uint32_t n_entries = data[5] << 24 | data[6] << 16 | data[7] << 8 | data[8];
+  if (n_bins > MAX_BINS) {
+    throw std::runtime_error(
+      "bin count " + std::to_string(n_bins) + " exceeds the maximum of " + std::to_string(MAX_BINS) +
+      " in NDTPPayloadSpiketrainSparse"
+    );
+  }
+
+  uint8_t entry_bits = index_bits(n_bins) + BIT_WIDTH_BINNED_SPIKES;
+  size_t bytes_needed = (static_cast<size_t>(n_entries) * entry_bits + 7) / 8;
+  if (n_entries > n_bins || size - 9 < bytes_needed) {
+    throw std::runtime_error(
+      "insufficient data for " + std::to_string(n_entries) + " entries of " + std::to_string(n_bins) +
+      " bins in NDTPPayloadSpiketrainSparse (got " + std::to_string(size - 9) + " bytes)"
+    );
+  }
+
+  // entries are scattered without branching: an index past the end lands in a spare slot and
+  // is reported once all entries are placed
+  auto& spike_counts = out.spike_counts;
+  spike_counts.assign(static_cast<size_t>(n_bins) + 1, 0);
+  BitReader reader(data + 9, bytes_needed);
+  uint64_t max_index = 0;
+  for (uint32_t e = 0; e < n_entries; ++e) {
+    uint64_t entry = reader.read(entry_bits);
+    uint64_t index = entry >> BIT_WIDTH_BINNED_SPIKES;
+    max_index = std::max(max_index, index);
+    spike_counts[std::min<uint64_t>(index, n_bins)] = entry & ((1 << BIT_WIDTH_BINNED_SPIKES) - 1);
+  }
+  if (n_entries > 0 && max_index >= n_bins) {
+    throw std::runtime_error(
+      "spike count index " + std::to_string(max_index) + " out of range for " + std::to_string(n_bins) +
+      " bins in NDTPPayloadSpiketrainSparse"
+    );
+  }
+  spike_counts.pop_back();
+  out.bin_size_ms = bin_size_ms;
 }
 
 ByteArray NDTPMessage::pack() {
-  auto result = header.pack();
+  ByteArray result(encoded_size());
+  pack_into(result.data(), result.size());
+  return result;
+}
 
-  if (std::holds_alternative<NDTPPayloadBroadband>(payload)) {
-    auto payload_bytes = std::get<NDTPPayloadBroadband>(payload).pack();
-    result.insert(result.end(), payload_bytes.begin(), payload_bytes.end());
+size_t NDTPMessage::encoded_size() const {
+  size_t payload_size = std::visit([](const auto& p) { return p.encoded_size(); }, payload);
+  return NDTPHeader::NDTP_HEADER_SIZE + payload_size + NDTP_CRC_SIZE;
+}
 
-  } else if (std::holds_alternative<NDTPPayloadSpiketrain>(payload)) {
-    auto payload_bytes = std::get<NDTPPayloadSpiketrain>(payload).pack();
-    result.insert(result.end(), payload_bytes.begin(), payload_bytes.end());
+size_t NDTPMessage::pack_into(uint8_t* dst, size_t cap) {
+  size_t size = encoded_size();
+  if (cap < size) {
+    throw std::runtime_error(
+      "insufficient buffer for NDTPMessage (expected " + std::to_string(size) + ", got " + std::to_string(cap) + ")"
+    );
+  }
 
+  // header and payload are written in place; the CRC covers both
+  size_t offset = header.pack_into(dst, cap);
+  if (std::holds_alternative<NDTPPayloadBroadband>(payload)) {
+    offset += std::get<NDTPPayloadBroadband>(payload).pack_into(dst + offset, cap - offset);
+  } else if (std::holds_alternative<NDTPPayloadSpiketrain>(payload)) {
+    offset += std::get<NDTPPayloadSpiketrain>(payload).pack_into(dst + offset, cap - offset);
+  } else if (std::holds_alternative<NDTPPayloadBroadbandDelta>(payload)) {
+    // the data type is what tells a decoder which encoding to expect
+    if (header.data_type != (synapse::DataType::kBroadband | NDTP_DATA_TYPE_COMPRESSED)) {
+      throw std::invalid_argument(
+        "NDTPPayloadBroadbandDelta must be sent with data type kBroadband | NDTP_DATA_TYPE_COMPRESSED (got " +
+        std::to_string(header.data_type) + ")"
+      );
+    }
+    offset += std::get<NDTPPayloadBroadbandDelta>(payload).pack_into(dst + offset, cap - offset);
+  } else if (std::holds_alternative<NDTPPayloadSpiketrainSparse>(payload)) {
+    if (header.data_type != (synapse::DataType::kSpiketrain | NDTP_DATA_TYPE_COMPRESSED)) {
+      throw std::invalid_argument(
+        "NDTPPayloadSpiketrainSparse must be sent with data type kSpiketrain | NDTP_DATA_TYPE_COMPRESSED (got " +
+        std::to_string(header.data_type) + ")"
+      );
+    }
+    offset += std::get<NDTPPayloadSpiketrainSparse>(payload).pack_into(dst + offset, cap - offset);
   } else {
     throw std::runtime_error("Unsupported payload type");
   }
 
-  _crc16 = crc16(result);
-  result.push_back((_crc16 >> 8) & 0xFF);
-  result.push_back(_crc16 & 0xFF);
-
-  return result;
+  _crc16 = crc16_append(dst, offset);
+  return offset + NDTP_CRC_SIZE;
 }
 
 NDTPMessage NDTPMessage::unpack(const ByteArray& data, bool ignore_crc) {
-  if (data.size() < 16) {
+  return unpack(data.data(), data.size(), ignore_crc);
+}
+
+NDTPMessage NDTPMessage::unpack(const uint8_t* data, size_t size, bool ignore_crc) {
+  NDTPMessage message{};
+  unpack_into(data, size, message, ignore_crc);
+  return message;
+}
+
+void NDTPMessage::unpack_into(const uint8_t* data, size_t size, NDTPMessage& out, bool ignore_crc) {
+  if (size < 16) {
     throw std::runtime_error("invalid data size for NDTPMessage");
   }
 
-  auto data_bytes = std::vector<uint8_t>(data.begin(), data.end() - 2);
-  auto header_bytes = std::vector<uint8_t>(data.begin(), data.begin() + NDTPHeader::NDTP_HEADER_SIZE);
-  auto payload_bytes = std::vector<uint8_t>(data.begin() + NDTPHeader::NDTP_HEADER_SIZE, data.end() - 2);
-  auto crc_bytes = std::vector<uint8_t>(data.end() - 2, data.end());
-
-  uint16_t received_crc = crc_bytes[0] << 8 | crc_bytes[1];
-  if (!crc16_verify(data_bytes, received_crc)) {
+  // framing is resolved as views into `data`: [header | payload | crc16]
+  size_t crc_offset = size - 2;
+  uint16_t received_crc = data[crc_offset] << 8 | data[crc_offset + 1];
+  if (!crc16_verify(data, crc_offset, received_crc)) {
       if (!ignore_crc) {
         throw std::runtime_error(
           "CRC verification failed (expected " + std::to_string(received_crc) +
-        ", got " + std::to_string(crc16(data_bytes)) + "; payload size: " + std::to_string(payload_bytes.size()) + " bytes)"
+        ", got " + std::to_string(crc16(data, crc_offset)) + "; payload size: " +
+        std::to_string(crc_offset - NDTPHeader::NDTP_HEADER_SIZE) + " bytes)"
       );
     }
   }
+  unpack_checked(data, size, received_crc, out);
+}
 
-  auto header = NDTPHeader::unpack(header_bytes);
+namespace {
+
+// Decodes a payload into `payload`, switching it to alternative P first if it holds another one.
+template <typename P, typename Variant>
+void unpack_payload_into(const uint8_t* data, size_t size, Variant& payload) {
+  auto* current = std::get_if<P>(&payload);
+  if (!current) {
+    current = &payload.template emplace<P>();
+  }
+  P::unpack_into(data, size, *current);
+}
+
+}  // namespace
+
+void NDTPMessage::unpack_checked(const uint8_t* data, size_t size, uint16_t crc, NDTPMessage& out) {
+  const uint8_t* payload_bytes = data + NDTPHeader::NDTP_HEADER_SIZE;
+  size_t payload_size = size - NDTPHeader::NDTP_HEADER_SIZE - NDTP_CRC_SIZE;
+
+  auto header = NDTPHeader::unpack(data, NDTPHeader::NDTP_HEADER_SIZE);
   if (header.data_type == synapse::DataType::kBroadband) {
-    auto unpacked_payload = NDTPPayloadBroadband::unpack(payload_bytes);
-    return NDTPMessage{ .header = header, .payload = unpacked_payload, ._crc16 = received_crc };
+    unpack_payload_into<NDTPPayloadBroadband>(payload_bytes, payload_size, out.payload);
   } else if (header.data_type == synapse::DataType::kSpiketrain) {
-    auto unpacked_payload = NDTPPayloadSpiketrain::unpack(payload_bytes);
-    return NDTPMessage{ .header = header, .payload = unpacked_payload, ._crc16 = received_crc };
+    unpack_payload_into<NDTPPayloadSpiketrain>(payload_bytes, payload_size, out.payload);
+  } else if (header.data_type == (synapse::DataType::kBroadband | NDTP_DATA_TYPE_COMPRESSED)) {
+    unpack_payload_into<NDTPPayloadBroadbandDelta>(payload_bytes, payload_size, out.payload);
+  } else if (header.data_type == (synapse::DataType::kSpiketrain | NDTP_DATA_TYPE_COMPRESSED)) {
+    unpack_payload_into<NDTPPayloadSpiketrainSparse>(payload_bytes, payload_size, out.payload);
+  } else {
+    throw std::runtime_error("unsupported data type in NDTP header");
   }
+  out.header = header;
+  out._crc16 = crc;
+}
+
+namespace {
 
-  throw std::runtime_error("unsupported data type in NDTP header");
+// Datagrams whose CRCs are checked together before they are decoded; 8 full-size packets fit in L1.
+constexpr size_t UNPACK_BATCH_GROUP = 8;
+
+bool is_supported_data_type(uint8_t data_type) {
+  return data_type == synapse::DataType::kBroadband || data_type == synapse::DataType::kSpiketrain ||
+         data_type == (synapse::DataType::kBroadband | NDTP_DATA_TYPE_COMPRESSED) ||
+         data_type == (synapse::DataType::kSpiketrain | NDTP_DATA_TYPE_COMPRESSED);
+}
+
+NDTPUnpackStatus check_framing(const ByteSpan& datagram, bool ignore_crc) {
+  if (datagram.size < NDTPHeader::NDTP_HEADER_SIZE + NDTPMessage::NDTP_CRC_SIZE) {
+    return NDTPUnpackStatus::kTooShort;
+  }
+  if (datagram.data[0] != NDTP_VERSION || !is_supported_data_type(datagram.data[1])) {
+    return NDTPUnpackStatus::kUnsupportedHeader;
+  }
+  if (!ignore_crc && !crc16_verify(datagram.data, datagram.size)) {
+    return NDTPUnpackStatus::kCrcMismatch;
+  }
+  return NDTPUnpackStatus::kOk;
+}
+
+}  // namespace
+
+size_t NDTPMessage::unpack_batch(
+  const ByteSpan* datagrams, size_t count, NDTPMessage* out, NDTPUnpackStatus* statuses, bool ignore_crc
+) {
+  size_t n_decoded = 0;
+  for (size_t first = 0; first < count; first += UNPACK_BATCH_GROUP) {
+    size_t last = std::min(count, first + UNPACK_BATCH_GROUP);
+    for (size_t i = first; i < last; ++i) {
+      statuses[i] = check_framing(datagrams[i], ignore_crc);
+    }
+    for (size_t i = first; i < last; ++i) {
+      if (statuses[i] != NDTPUnpackStatus::kOk) {
+        continue;
+      }
+      const auto& datagram = datagrams[i];
+      size_t crc_offset = datagram.size - NDTP_CRC_SIZE;
+      try {
+        unpack_checked(datagram.data, datagram.size, datagram.data[crc_offset] << 8 | datagram.data[crc_offset + 1], out[i]);
+        n_decoded++;
+      } catch (const std::exception&) {
+        statuses[i] = NDTPUnpackStatus::kMalformedPayload;
+      }
+    }
+  }
+  return n_decoded;
 }
 
 bool NDTPMessage::crc16_verify(const ByteArray& data, uint16_t crc) {
-  return crc16(data) == crc;
+  return crc16_verify(data.data(), data.size(), crc);
+}
+
+bool NDTPMessage::crc16_verify(const uint8_t* data, size_t size, uint16_t crc) {
+  return libndtp::crc16_verify(data, size, crc);
 }
 
 }  // namespace science::libndtp
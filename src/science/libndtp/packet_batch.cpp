@@ -0,0 +1,70 @@
+#include "science/libndtp/packet_batch.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace science::libndtp {
+
+void PacketBatch::reserve(size_t slab_bytes, size_t n_packets) {
+  if (slab_.size() < slab_bytes) {
+    slab_.resize(slab_bytes);
+  }
+  offsets_.reserve(n_packets + 1);
+}
+
+uint8_t* PacketBatch::prepare(size_t max_size) {
+  size_t needed = bytes() + max_size;
+  if (slab_.size() < needed) {
+    // grow geometrically so a batch built packet by packet resizes a logarithmic number of times
+    slab_.resize(std::max(needed, slab_.size() * 2));
+  }
+  return slab_.data() + bytes();
+}
+
+void PacketBatch::commit(size_t size) {
+  if (bytes() + size > slab_.size()) {
+    throw std::runtime_error("packet of " + std::to_string(size) + " bytes exceeds the prepared buffer");
+  }
+  offsets_.push_back(bytes() + size);
+}
+
+size_t PacketBatch::append(NDTPMessage& message) {
+  size_t size = message.encoded_size();
+  uint8_t* dst = prepare(size);
+  message.pack_into(dst, size);
+  commit(size);
+  return size;
+}
+
+void PacketBatch::append(const uint8_t* data, size_t size) {
+  uint8_t* dst = prepare(size);
+  if (size > 0) {
+    std::memcpy(dst, data, size);
+  }
+  commit(size);
+}
+
+uint8_t* PacketBatch::append_uninitialized(const size_t* sizes, size_t n) {
+  size_t total = 0;
+  for (size_t i = 0; i < n; ++i) {
+    total += sizes[i];
+  }
+  uint8_t* dst = prepare(total);
+  for (size_t i = 0; i < n; ++i) {
+    offsets_.push_back(bytes() + sizes[i]);
+  }
+  return dst;
+}
+
+#ifdef __linux__
+size_t PacketBatch::to_iovecs(iovec* iov, size_t count, size_t first) const {
+  size_t n = first < size() ? std::min(count, size() - first) : 0;
+  for (size_t i = 0; i < n; ++i) {
+    iov[i].iov_base = const_cast<uint8_t*>(slab_.data() + offsets_[first + i]);
+    iov[i].iov_len = offsets_[first + i + 1] - offsets_[first + i];
+  }
+  return n;
+}
+#endif
+
+}  // namespace science::libndtp
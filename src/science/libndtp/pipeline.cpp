@@ -0,0 +1,252 @@
+#include "science/libndtp/pipeline.h"
+
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace science::libndtp {
+
+namespace {
+
+// Waits for another thread to make progress: spins briefly, then yields the core.
+class Backoff {
+ public:
+  void operator()() {
+    if (++spins_ > SPIN_LIMIT) {
+      std::this_thread::yield();
+    }
+  }
+
+  void reset() { spins_ = 0; }
+
+ private:
+  static constexpr int SPIN_LIMIT = 64;
+  int spins_ = 0;
+};
+
+}  // namespace
+
+NDTPDecodePipeline::Worker::Worker(size_t capacity, size_t max_datagram_size) : input(capacity), output(capacity) {
+  // slots are reused, so their buffers only grow for oversized datagrams; go once around the ring to reserve them
+  for (size_t i = 0; i < input.capacity(); ++i) {
+    input.claim()->reserve(max_datagram_size);
+    input.publish();
+  }
+  while (input.front()) {
+    input.pop();
+  }
+}
+
+NDTPDecodePipeline::NDTPDecodePipeline(Consumer consumer, NDTPPipelineOptions options)
+    : options_(std::move(options)), consumer_(std::move(consumer)) {
+  if (options_.n_workers == 0) {
+    throw std::invalid_argument("decode pipeline needs at least one worker");
+  }
+  for (size_t i = 0; i < options_.n_workers; ++i) {
+    workers_.push_back(std::make_unique<Worker>(options_.queue_capacity, options_.max_datagram_size));
+  }
+
+  try {
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      Worker& worker = *workers_[i];
+      worker.thread = std::thread([this, &worker] { run_worker(worker); });
+      if (!options_.worker_cores.empty()) {
+        pin(worker.thread, options_.worker_cores[i % options_.worker_cores.size()]);
+      }
+    }
+    sequencer_ = std::thread([this] { run_sequencer(); });
+    pin(sequencer_, options_.sequencer_core);
+  } catch (...) {
+    stop();
+    throw;
+  }
+}
+
+NDTPDecodePipeline::~NDTPDecodePipeline() {
+  try {
+    stop();
+  } catch (...) {
+    // errors are only reported by an explicit stop()
+  }
+}
+
+void NDTPDecodePipeline::submit(const uint8_t* data, size_t size) {
+  if (producer_done_.load(std::memory_order_relaxed)) {
+    throw std::runtime_error("decode pipeline is stopped");
+  }
+  received_.fetch_add(1, std::memory_order_relaxed);
+  // each data type is its own stream with its own sequence numbers, whichever encoding it uses
+  auto& stream = streams_[size > 1 ? stream_data_type(data[1]) : 0];
+  if (!stream) {
+    stream = std::make_unique<NDTPStreamDecoder>(options_.reorder_window, options_.max_datagram_size, true);
+  }
+  stream->push(data, size, [this](const NDTPStreamPacket& packet) { dispatch(packet); });
+}
+
+void NDTPDecodePipeline::dispatch(const NDTPStreamPacket& packet) {
+  Worker& worker = *workers_[next_worker_];
+  ByteArray* slot = worker.input.claim();
+  if (!slot) {
+    if (options_.overflow == NDTPPipelineOptions::Overflow::kDrop) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    Backoff backoff;
+    while (!(slot = worker.input.claim())) {
+      backoff();
+    }
+  }
+  slot->assign(packet.datagram.begin(), packet.datagram.end());
+  worker.input.publish();
+
+  size_t depth = worker.input.size();
+  if (depth > worker.max_depth.load(std::memory_order_relaxed)) {
+    worker.max_depth.store(depth, std::memory_order_relaxed);
+  }
+  queued_.fetch_add(1, std::memory_order_relaxed);
+  // the sequencer collects results in this same order
+  next_worker_ = next_worker_ + 1 == workers_.size() ? 0 : next_worker_ + 1;
+}
+
+void NDTPDecodePipeline::run_worker(Worker& worker) {
+  Backoff backoff;
+  for (;;) {
+    ByteArray* datagram = worker.input.front();
+    if (!datagram) {
+      // the producer publishes its last datagram before setting producer_done_
+      if (producer_done_.load(std::memory_order_acquire) && !(datagram = worker.input.front())) {
+        break;
+      }
+      if (!datagram) {
+        backoff();
+        continue;
+      }
+    }
+    backoff.reset();
+
+    Result* result;
+    while (!(result = worker.output.claim())) {
+      backoff();
+    }
+    try {
+      // the stream decoders skipped the CRC check, so it happens here
+      result->message = NDTPMessage::unpack(*datagram);
+      result->valid = true;
+    } catch (const std::exception&) {
+      result->valid = false;
+    }
+    worker.output.publish();
+    worker.input.pop();
+  }
+  worker.done.store(true, std::memory_order_release);
+}
+
+void NDTPDecodePipeline::run_sequencer() {
+  Backoff backoff;
+  size_t next = 0;
+  for (;;) {
+    Worker& worker = *workers_[next];
+    Result* result = worker.output.front();
+    if (!result) {
+      // datagrams are dealt round robin, so once this worker has finished there are no more
+      if (worker.done.load(std::memory_order_acquire) && !(result = worker.output.front())) {
+        break;
+      }
+      if (!result) {
+        backoff();
+        continue;
+      }
+    }
+    backoff.reset();
+
+    if (result->valid) {
+      try {
+        consumer_(std::move(result->message));
+      } catch (...) {
+        record_error(std::current_exception());
+      }
+      delivered_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      invalid_.fetch_add(1, std::memory_order_relaxed);
+    }
+    worker.output.pop();
+    next = next + 1 == workers_.size() ? 0 : next + 1;
+  }
+}
+
+void NDTPDecodePipeline::stop() {
+  if (stopped_) {
+    return;
+  }
+  stopped_ = true;
+
+  receiving_.store(false, std::memory_order_relaxed);
+  if (receive_thread_.joinable()) {
+    receive_thread_.join();
+  }
+  for (auto& stream : streams_) {
+    if (stream) {
+      stream->flush([this](const NDTPStreamPacket& packet) { dispatch(packet); });
+    }
+  }
+  producer_done_.store(true, std::memory_order_release);
+  for (auto& worker : workers_) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    } else {
+      // never started, e.g. pinning failed during construction
+      worker->done.store(true, std::memory_order_release);
+    }
+  }
+  if (sequencer_.joinable()) {
+    sequencer_.join();
+  }
+
+  std::lock_guard<std::mutex> lock(error_mutex_);
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+}
+
+NDTPPipelineStats NDTPDecodePipeline::stats() const {
+  return NDTPPipelineStats{
+    .received = received_.load(std::memory_order_relaxed),
+    .queued = queued_.load(std::memory_order_relaxed),
+    .dropped = dropped_.load(std::memory_order_relaxed),
+    .invalid = invalid_.load(std::memory_order_relaxed),
+    .delivered = delivered_.load(std::memory_order_relaxed),
+  };
+}
+
+void NDTPDecodePipeline::record_error(std::exception_ptr error) {
+  std::lock_guard<std::mutex> lock(error_mutex_);
+  if (!error_) {
+    error_ = error;
+  }
+}
+
+void NDTPDecodePipeline::pin(std::thread& thread, int core) {
+  if (core < 0) {
+    return;
+  }
+#ifdef __linux__
+  if (core >= CPU_SETSIZE) {
+    throw std::invalid_argument("invalid CPU core: " + std::to_string(core));
+  }
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(core, &cpus);
+  int error = pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+  if (error != 0) {
+    throw std::runtime_error("failed to pin thread to CPU core " + std::to_string(core) + ": " + std::strerror(error));
+  }
+#else
+  throw std::runtime_error("pinning threads to CPU cores is only supported on Linux");
+#endif
+}
+
+}  // namespace science::libndtp
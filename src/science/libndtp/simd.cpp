@@ -0,0 +1,425 @@
+#include "science/libndtp/simd.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LIBNDTP_SIMD_X86 1
+#define LIBNDTP_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define LIBNDTP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace science::libndtp::simd {
+
+namespace {
+
+Isa detect_isa() {
+#ifdef LIBNDTP_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return Isa::kAvx2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return Isa::kSse41;
+  }
+#endif
+  return Isa::kScalar;
+}
+
+const Isa detected_isa = detect_isa();
+Isa selected_isa = detected_isa;
+
+#ifdef LIBNDTP_SIMD_X86
+
+/**
+ * Shuffle and shift tables for one bit width. A block is 4 values (4 * bit_width / 8 bytes, a
+ * whole number of bytes for the even widths we support); lane i holds the value starting at bit
+ * i * bit_width of the block.
+ *
+ * Unpacking gathers the 4 bytes around each value into a big-endian 32-bit lane, shifts the
+ * value's first bit up to the top of the lane, then shifts it back down by 32 - bit_width,
+ * arithmetically when signed so sign extension happens in the register.
+ *
+ * Packing reverses this: each lane is shifted so its field sits at the right bit position within
+ * its 4 output bytes, and bytes are routed to the output with two shuffles OR-ed together, since
+ * with bit_width >= 8 an output byte holds bits of at most two values.
+ */
+struct Layout {
+  alignas(16) uint8_t unpack_shuffle[16];
+  alignas(32) uint32_t unpack_shift[8];
+  alignas(16) uint32_t unpack_mul[4];
+  alignas(16) uint8_t pack_shuffle_a[16];
+  alignas(16) uint8_t pack_shuffle_b[16];
+  alignas(32) uint32_t pack_shift[8];
+  alignas(16) uint32_t pack_mul[4];
+  uint32_t mask;
+  uint8_t bit_width;
+  size_t block_bytes;
+};
+
+Layout make_layout(uint8_t bit_width) {
+  Layout l{};
+  l.bit_width = bit_width;
+  l.mask = (1u << bit_width) - 1;
+  l.block_bytes = 4 * bit_width / 8;
+
+  for (int i = 0; i < 16; i++) {
+    l.pack_shuffle_a[i] = 0x80;
+    l.pack_shuffle_b[i] = 0x80;
+  }
+
+  for (int lane = 0; lane < 4; lane++) {
+    int bit = lane * bit_width;
+    int first_byte = bit / 8;
+    int shift = bit % 8;
+    int last_byte = (bit + bit_width - 1) / 8;
+
+    for (int k = 0; k < 4; k++) {
+      l.unpack_shuffle[lane * 4 + k] = first_byte + 3 - k;
+    }
+    l.unpack_shift[lane] = l.unpack_shift[lane + 4] = shift;
+    l.unpack_mul[lane] = 1u << shift;
+
+    int pack_shift = 32 - bit_width - shift;
+    l.pack_shift[lane] = l.pack_shift[lane + 4] = pack_shift;
+    l.pack_mul[lane] = 1u << pack_shift;
+
+    for (int byte = first_byte; byte <= last_byte; byte++) {
+      uint8_t source = lane * 4 + 3 - (byte - first_byte);
+      if (l.pack_shuffle_a[byte] == 0x80) {
+        l.pack_shuffle_a[byte] = source;
+      } else {
+        l.pack_shuffle_b[byte] = source;
+      }
+    }
+  }
+  return l;
+}
+
+const Layout* find_layout(uint8_t bit_width) {
+  static const Layout layouts[] = {make_layout(10), make_layout(12), make_layout(16), make_layout(24)};
+  for (const auto& l : layouts) {
+    if (l.bit_width == bit_width) {
+      return &l;
+    }
+  }
+  return nullptr;
+}
+
+// Picks the low 16 bits of each 32-bit lane into the low 8 bytes.
+alignas(16) const uint8_t LOW_HALVES[16] = {0, 1, 4, 5, 8, 9, 12, 13, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80};
+
+inline __m128i load_128(const void* p) { return _mm_loadu_si128(static_cast<const __m128i*>(p)); }
+
+template <typename T>
+LIBNDTP_TARGET_SSE41 inline void store_4(T* out, __m128i v) {
+  if constexpr (sizeof(T) == 2) {
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(v, load_128(LOW_HALVES)));
+  } else if constexpr (sizeof(T) == 4) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), v);
+  } else {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_cvtepi32_epi64(v));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2), _mm_cvtepi32_epi64(_mm_srli_si128(v, 8)));
+  }
+}
+
+template <typename T>
+LIBNDTP_TARGET_SSE41 inline __m128i load_4(const T* values) {
+  if constexpr (sizeof(T) == 2) {
+    return _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(values)));
+  } else if constexpr (sizeof(T) == 4) {
+    return load_128(values);
+  } else {
+    __m128i lo = _mm_shuffle_epi32(load_128(values), _MM_SHUFFLE(3, 1, 2, 0));
+    __m128i hi = _mm_shuffle_epi32(load_128(values + 2), _MM_SHUFFLE(3, 1, 2, 0));
+    return _mm_unpacklo_epi64(lo, hi);
+  }
+}
+
+template <typename T>
+LIBNDTP_TARGET_AVX2 inline void store_8(T* out, __m256i v) {
+  if constexpr (sizeof(T) == 2) {
+    __m256i halves = _mm256_shuffle_epi8(v, _mm256_broadcastsi128_si256(load_128(LOW_HALVES)));
+    halves = _mm256_permute4x64_epi64(halves, _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(halves));
+  } else if constexpr (sizeof(T) == 4) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), v);
+  } else {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 4), _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+  }
+}
+
+template <typename T>
+LIBNDTP_TARGET_AVX2 inline __m256i load_8(const T* values) {
+  if constexpr (sizeof(T) == 2) {
+    return _mm256_cvtepu16_epi32(load_128(values));
+  } else if constexpr (sizeof(T) == 4) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values));
+  } else {
+    const __m256i low_dwords = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    __m256i lo = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(values)), low_dwords);
+    __m256i hi = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + 4)), low_dwords);
+    return _mm256_inserti128_si256(lo, _mm256_castsi256_si128(hi), 1);
+  }
+}
+
+template <typename T>
+LIBNDTP_TARGET_SSE41 size_t
+unpack_sse41(const uint8_t* src, size_t src_size, const Layout& l, bool is_signed, T* out, size_t count) {
+  const __m128i shuffle = load_128(l.unpack_shuffle);
+  const __m128i mul = load_128(l.unpack_mul);
+  const __m128i shift = _mm_cvtsi32_si128(32 - l.bit_width);
+
+  size_t n = 0;
+  size_t pos = 0;
+  while (count - n >= 4 && src_size - pos >= 16) {
+    __m128i v = _mm_shuffle_epi8(load_128(src + pos), shuffle);
+    v = _mm_mullo_epi32(v, mul);
+    v = is_signed ? _mm_sra_epi32(v, shift) : _mm_srl_epi32(v, shift);
+    store_4(out + n, v);
+    n += 4;
+    pos += l.block_bytes;
+  }
+  return n;
+}
+
+template <typename T>
+LIBNDTP_TARGET_SSE41 size_t pack_sse41(const T* values, size_t count, const Layout& l, uint8_t* dst, size_t dst_size) {
+  const __m128i mask = _mm_set1_epi32(l.mask);
+  const __m128i mul = load_128(l.pack_mul);
+  const __m128i shuffle_a = load_128(l.pack_shuffle_a);
+  const __m128i shuffle_b = load_128(l.pack_shuffle_b);
+
+  size_t n = 0;
+  size_t pos = 0;
+  while (count - n >= 4 && dst_size - pos >= 16) {
+    __m128i v = _mm_mullo_epi32(_mm_and_si128(load_4(values + n), mask), mul);
+    __m128i bytes = _mm_or_si128(_mm_shuffle_epi8(v, shuffle_a), _mm_shuffle_epi8(v, shuffle_b));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), bytes);
+    n += 4;
+    pos += l.block_bytes;
+  }
+  return n;
+}
+
+// AVX2 runs two blocks per iteration, one per 128-bit half, and leaves the rest to SSE4.1.
+template <typename T>
+LIBNDTP_TARGET_AVX2 size_t
+unpack_avx2(const uint8_t* src, size_t src_size, const Layout& l, bool is_signed, T* out, size_t count) {
+  const __m256i shuffle = _mm256_broadcastsi128_si256(load_128(l.unpack_shuffle));
+  const __m256i lane_shift = _mm256_load_si256(reinterpret_cast<const __m256i*>(l.unpack_shift));
+  const __m128i shift = _mm_cvtsi32_si128(32 - l.bit_width);
+
+  size_t n = 0;
+  size_t pos = 0;
+  while (count - n >= 8 && src_size - pos >= l.block_bytes + 16) {
+    __m256i raw = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(load_128(src + pos)), load_128(src + pos + l.block_bytes), 1
+    );
+    __m256i v = _mm256_sllv_epi32(_mm256_shuffle_epi8(raw, shuffle), lane_shift);
+    v = is_signed ? _mm256_sra_epi32(v, shift) : _mm256_srl_epi32(v, shift);
+    store_8(out + n, v);
+    n += 8;
+    pos += 2 * l.block_bytes;
+  }
+  return n + unpack_sse41(src + pos, src_size - pos, l, is_signed, out + n, count - n);
+}
+
+template <typename T>
+LIBNDTP_TARGET_AVX2 size_t pack_avx2(const T* values, size_t count, const Layout& l, uint8_t* dst, size_t dst_size) {
+  const __m256i mask = _mm256_set1_epi32(l.mask);
+  const __m256i lane_shift = _mm256_load_si256(reinterpret_cast<const __m256i*>(l.pack_shift));
+  const __m256i shuffle_a = _mm256_broadcastsi128_si256(load_128(l.pack_shuffle_a));
+  const __m256i shuffle_b = _mm256_broadcastsi128_si256(load_128(l.pack_shuffle_b));
+
+  size_t n = 0;
+  size_t pos = 0;
+  while (count - n >= 8 && dst_size - pos >= l.block_bytes + 16) {
+    __m256i v = _mm256_sllv_epi32(_mm256_and_si256(load_8(values + n), mask), lane_shift);
+    __m256i bytes = _mm256_or_si256(_mm256_shuffle_epi8(v, shuffle_a), _mm256_shuffle_epi8(v, shuffle_b));
+    // the second half's store overwrites the zero tail of the first
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), _mm256_castsi256_si128(bytes));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos + l.block_bytes), _mm256_extracti128_si256(bytes, 1));
+    n += 8;
+    pos += 2 * l.block_bytes;
+  }
+  return n + pack_sse41(values + n, count - n, l, dst + pos, dst_size - pos);
+}
+
+/**
+ * Nibble codecs. Packing clamps 16 (32) counts with an unsigned byte min, then multiplies each
+ * pair by (16, 1) and adds with maddubs, giving one packed byte per 16-bit lane, which packus
+ * narrows; AVX2 handles two such registers per iteration. Unpacking splits each byte into its
+ * high and low nibble and interleaves them back into order.
+ */
+LIBNDTP_TARGET_SSE41 size_t pack_nibbles_sse41(const uint8_t* values, size_t count, uint8_t* dst) {
+  const __m128i max = _mm_set1_epi8(15);
+  const __m128i weights = _mm_set1_epi16(0x0110);  // bytes 16, 1
+  size_t n = 0;
+  for (; count - n >= 32; n += 32) {
+    __m128i a = _mm_maddubs_epi16(_mm_min_epu8(load_128(values + n), max), weights);
+    __m128i b = _mm_maddubs_epi16(_mm_min_epu8(load_128(values + n + 16), max), weights);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n / 2), _mm_packus_epi16(a, b));
+  }
+  return n;
+}
+
+LIBNDTP_TARGET_SSE41 size_t unpack_nibbles_sse41(const uint8_t* src, size_t count, uint8_t* out) {
+  const __m128i low = _mm_set1_epi8(0x0F);
+  size_t n = 0;
+  for (; count - n >= 32; n += 32) {
+    __m128i v = load_128(src + n / 2);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low);
+    __m128i lo = _mm_and_si128(v, low);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + n), _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + n + 16), _mm_unpackhi_epi8(hi, lo));
+  }
+  return n;
+}
+
+LIBNDTP_TARGET_AVX2 size_t pack_nibbles_avx2(const uint8_t* values, size_t count, uint8_t* dst) {
+  const __m256i max = _mm256_set1_epi8(15);
+  const __m256i weights = _mm256_set1_epi16(0x0110);
+  size_t n = 0;
+  for (; count - n >= 64; n += 64) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + n));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + n + 32));
+    a = _mm256_maddubs_epi16(_mm256_min_epu8(a, max), weights);
+    b = _mm256_maddubs_epi16(_mm256_min_epu8(b, max), weights);
+    // packus works within 128-bit halves, leaving the quarters in the order a0 b0 a1 b1
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + n / 2), packed);
+  }
+  return n + pack_nibbles_sse41(values + n, count - n, dst + n / 2);
+}
+
+LIBNDTP_TARGET_AVX2 size_t unpack_nibbles_avx2(const uint8_t* src, size_t count, uint8_t* out) {
+  const __m256i low = _mm256_set1_epi8(0x0F);
+  size_t n = 0;
+  for (; count - n >= 64; n += 64) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + n / 2));
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+    __m256i lo = _mm256_and_si256(v, low);
+    // the unpacks interleave within 128-bit halves: bytes 0-7 and 16-23, then 8-15 and 24-31
+    __m256i first = _mm256_unpacklo_epi8(hi, lo);
+    __m256i second = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + n), _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + n + 32), _mm256_permute2x128_si256(first, second, 0x31));
+  }
+  return n + unpack_nibbles_sse41(src + n / 2, count - n, out + n);
+}
+
+#endif  // LIBNDTP_SIMD_X86
+
+}  // namespace
+
+Isa active_isa() {
+  return selected_isa;
+}
+
+bool set_isa(Isa isa) {
+  if (isa > detected_isa) {
+    return false;
+  }
+  selected_isa = isa;
+  return true;
+}
+
+template <typename T>
+size_t unpack(const uint8_t* src, size_t src_size, uint8_t bit_width, bool is_signed, T* out, size_t count) {
+#ifdef LIBNDTP_SIMD_X86
+  const Layout* l = find_layout(bit_width);
+  if (l == nullptr) {
+    return 0;
+  }
+  switch (selected_isa) {
+    case Isa::kAvx2:
+      return unpack_avx2(src, src_size, *l, is_signed, out, count);
+    case Isa::kSse41:
+      return unpack_sse41(src, src_size, *l, is_signed, out, count);
+    case Isa::kScalar:
+      break;
+  }
+#endif
+  return 0;
+}
+
+template <typename T>
+size_t pack(const T* values, size_t count, uint8_t bit_width, uint8_t* dst, size_t dst_size) {
+#ifdef LIBNDTP_SIMD_X86
+  const Layout* l = find_layout(bit_width);
+  if (l == nullptr) {
+    return 0;
+  }
+  switch (selected_isa) {
+    case Isa::kAvx2:
+      return pack_avx2(values, count, *l, dst, dst_size);
+    case Isa::kSse41:
+      return pack_sse41(values, count, *l, dst, dst_size);
+    case Isa::kScalar:
+      break;
+  }
+#endif
+  return 0;
+}
+
+void pack_nibbles(const uint8_t* values, size_t count, uint8_t* dst) {
+  size_t n = 0;
+#ifdef LIBNDTP_SIMD_X86
+  switch (selected_isa) {
+    case Isa::kAvx2:
+      n = pack_nibbles_avx2(values, count, dst);
+      break;
+    case Isa::kSse41:
+      n = pack_nibbles_sse41(values, count, dst);
+      break;
+    case Isa::kScalar:
+      break;
+  }
+#endif
+  for (; n + 1 < count; n += 2) {
+    dst[n / 2] = (std::min<uint8_t>(values[n], 15) << 4) | std::min<uint8_t>(values[n + 1], 15);
+  }
+  if (n < count) {
+    dst[n / 2] = std::min<uint8_t>(values[n], 15) << 4;
+  }
+}
+
+void unpack_nibbles(const uint8_t* src, size_t count, uint8_t* out) {
+  size_t n = 0;
+#ifdef LIBNDTP_SIMD_X86
+  switch (selected_isa) {
+    case Isa::kAvx2:
+      n = unpack_nibbles_avx2(src, count, out);
+      break;
+    case Isa::kSse41:
+      n = unpack_nibbles_sse41(src, count, out);
+      break;
+    case Isa::kScalar:
+      break;
+  }
+#endif
+  for (; n + 1 < count; n += 2) {
+    out[n] = src[n / 2] >> 4;
+    out[n + 1] = src[n / 2] & 0x0F;
+  }
+  if (n < count) {
+    out[n] = src[n / 2] >> 4;
+  }
+}
+
+#define LIBNDTP_SIMD_INSTANTIATE(T)                                             \
+  template size_t unpack<T>(const uint8_t*, size_t, uint8_t, bool, T*, size_t); \
+  template size_t pack<T>(const T*, size_t, uint8_t, uint8_t*, size_t);
+
+LIBNDTP_SIMD_INSTANTIATE(int16_t)
+LIBNDTP_SIMD_INSTANTIATE(uint16_t)
+LIBNDTP_SIMD_INSTANTIATE(int32_t)
+LIBNDTP_SIMD_INSTANTIATE(uint32_t)
+LIBNDTP_SIMD_INSTANTIATE(int64_t)
+LIBNDTP_SIMD_INSTANTIATE(uint64_t)
+
+#undef LIBNDTP_SIMD_INSTANTIATE
+
+}  // namespace science::libndtp::simd
@@ -0,0 +1,75 @@
+#include "science/libndtp/stream.h"
+
+#include <algorithm>
+
+namespace science::libndtp {
+
+NDTPStreamDecoder::NDTPStreamDecoder(size_t reorder_window, size_t max_datagram_size, bool ignore_crc)
+    : window_(reorder_window), ignore_crc_(ignore_crc), slots_(reorder_window) {
+  for (auto& slot : slots_) {
+    slot.data.reserve(max_datagram_size);
+  }
+}
+
+void NDTPStreamDecoder::reset() {
+  for (auto& slot : slots_) {
+    slot.full = false;
+  }
+  pending_ = 0;
+  started_ = false;
+  next_ = 0;
+  highest_ = 0;
+  history_ = {};
+  stats_ = {};
+}
+
+bool NDTPStreamDecoder::accept(const uint8_t* data, size_t size, NDTPHeader& header, uint64_t& seq) {
+  stats_.received++;
+  if (size < NDTPHeader::NDTP_HEADER_SIZE + NDTPMessage::NDTP_CRC_SIZE + 2 || data[0] != NDTP_VERSION ||
+      (!ignore_crc_ && !crc16_verify(data, size))) {
+    stats_.invalid++;
+    return false;
+  }
+  header = NDTPHeader::unpack(data, size);
+
+  if (!started_) {
+    started_ = true;
+    seq = next_ = highest_ = header.seq_number;
+    return true;
+  }
+
+  // take the extended sequence number closest to the highest one seen so far
+  int16_t delta = static_cast<int16_t>(header.seq_number - static_cast<uint16_t>(highest_));
+  if (delta < 0 && static_cast<uint64_t>(-delta) > highest_) {
+    // from before the start of the stream
+    stats_.reordered++;
+    stats_.late++;
+    return false;
+  }
+  seq = highest_ + delta;
+  if (delta < 0) {
+    stats_.reordered++;
+  } else {
+    highest_ = seq;
+  }
+
+  if (seq < next_) {
+    if (was_delivered(seq)) {
+      stats_.duplicates++;
+    } else {
+      stats_.late++;
+    }
+    return false;
+  }
+  return true;
+}
+
+void NDTPStreamDecoder::skip(uint64_t target) {
+  for (uint64_t seq = std::max(next_, target > HISTORY ? target - HISTORY : 0); seq < target; ++seq) {
+    mark(seq, false);
+  }
+  stats_.dropped += target - next_;
+  next_ = target;
+}
+
+}  // namespace science::libndtp
@@ -0,0 +1,187 @@
+#include "science/libndtp/transport/udp.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace science::libndtp {
+
+namespace {
+
+std::runtime_error socket_error(const std::string& what) {
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+sockaddr_in make_address(const std::string& address, uint16_t port) {
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+    throw std::invalid_argument("invalid IPv4 address: " + address);
+  }
+  return addr;
+}
+
+int open_socket(int buffer_option, int buffer_bytes) {
+  int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    throw socket_error("failed to create UDP socket");
+  }
+  if (buffer_bytes > 0 && ::setsockopt(fd, SOL_SOCKET, buffer_option, &buffer_bytes, sizeof(buffer_bytes)) < 0) {
+    auto error = socket_error("failed to set socket buffer size");
+    ::close(fd);
+    throw error;
+  }
+  return fd;
+}
+
+}  // namespace
+
+NDTPUdpReceiver::NDTPUdpReceiver(
+  const std::string& address, uint16_t port, size_t batch_size, size_t max_datagram_size, int receive_buffer_bytes
+)
+    : max_datagram_size_(max_datagram_size),
+      slab_(batch_size * max_datagram_size),
+      sizes_(batch_size),
+      iovecs_(batch_size),
+      headers_(batch_size),
+      spans_(batch_size),
+      messages_(batch_size),
+      statuses_(batch_size) {
+  if (batch_size == 0 || max_datagram_size == 0) {
+    throw std::invalid_argument("UDP receiver needs a non-zero batch size and datagram size");
+  }
+  auto addr = make_address(address, port);
+  fd_ = open_socket(SO_RCVBUF, receive_buffer_bytes);
+  socklen_t addr_len = sizeof(addr);
+  if (::bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+      ::getsockname(fd_, reinterpret_cast<sockaddr*>(&addr), &addr_len) < 0) {
+    auto error = socket_error("failed to bind UDP socket to " + address + ":" + std::to_string(port));
+    ::close(fd_);
+    throw error;
+  }
+  port_ = ntohs(addr.sin_port);
+
+  for (size_t i = 0; i < batch_size; ++i) {
+    iovecs_[i] = iovec{slab_.data() + i * max_datagram_size, max_datagram_size};
+    headers_[i].msg_hdr = msghdr{};
+    headers_[i].msg_hdr.msg_iov = &iovecs_[i];
+    headers_[i].msg_hdr.msg_iovlen = 1;
+  }
+}
+
+NDTPUdpReceiver::~NDTPUdpReceiver() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+size_t NDTPUdpReceiver::receive(int timeout_ms) {
+  if (timeout_ms != 0) {
+    pollfd pfd{fd_, POLLIN, 0};
+    int ready = ::poll(&pfd, 1, timeout_ms);
+    if (ready < 0 && errno != EINTR) {
+      throw socket_error("failed to poll UDP socket");
+    }
+    if (ready <= 0) {
+      return 0;
+    }
+  }
+
+  int n = ::recvmmsg(fd_, headers_.data(), headers_.size(), MSG_DONTWAIT, nullptr);
+  if (n < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return 0;
+    }
+    throw socket_error("failed to receive UDP datagrams");
+  }
+
+  // truncated datagrams are dropped, keeping the rest of the batch contiguous
+  size_t n_kept = 0;
+  for (int i = 0; i < n; ++i) {
+    if (headers_[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      stats_.truncated++;
+      continue;
+    }
+    if (n_kept != static_cast<size_t>(i)) {
+      std::memcpy(slab_.data() + n_kept * max_datagram_size_, slab_.data() + i * max_datagram_size_, headers_[i].msg_len);
+    }
+    sizes_[n_kept++] = headers_[i].msg_len;
+  }
+  stats_.datagrams += n_kept;
+  stats_.batches += n > 0;
+  return n_kept;
+}
+
+NDTPUdpSender::NDTPUdpSender(const std::string& address, uint16_t port, size_t batch_size, int send_buffer_bytes)
+    : batch_size_(batch_size), iovecs_(batch_size), headers_(batch_size) {
+  if (batch_size == 0) {
+    throw std::invalid_argument("UDP sender needs a non-zero batch size");
+  }
+  auto addr = make_address(address, port);
+  fd_ = open_socket(SO_SNDBUF, send_buffer_bytes);
+  if (::connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+    auto error = socket_error("failed to connect UDP socket to " + address + ":" + std::to_string(port));
+    ::close(fd_);
+    throw error;
+  }
+  for (size_t i = 0; i < batch_size; ++i) {
+    headers_[i].msg_hdr = msghdr{};
+    headers_[i].msg_hdr.msg_iov = &iovecs_[i];
+    headers_[i].msg_hdr.msg_iovlen = 1;
+  }
+}
+
+NDTPUdpSender::~NDTPUdpSender() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+size_t NDTPUdpSender::send(const PacketBatch& batch) {
+  constexpr size_t MAX_REFUSALS = 3;
+  size_t n_sent = 0;
+  size_t next = 0;
+  size_t refusals = 0;  // in a row, for the datagram at `next`
+  while (next < batch.size()) {
+    size_t n = batch.to_iovecs(iovecs_.data(), batch_size_, next);
+    int sent = ::sendmmsg(fd_, headers_.data(), n, 0);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == ECONNREFUSED) {
+        // the error belongs to an earlier datagram and reporting it clears it, so the datagram at
+        // `next` was not sent and goes again, unless it keeps being refused
+        stats_.refused++;
+        if (++refusals == MAX_REFUSALS) {
+          stats_.dropped++;
+          next++;
+          refusals = 0;
+        }
+        continue;
+      }
+      throw socket_error("failed to send UDP datagrams");
+    }
+    refusals = 0;
+    n_sent += sent;
+    next += sent;
+    stats_.datagrams += sent;
+    stats_.batches += sent > 0;
+  }
+  return n_sent;
+}
+
+size_t NDTPUdpSender::send(const ElectricalBroadbandData& data, size_t max_packet_size) {
+  batch_.clear();
+  size_t n_packets = data.pack(seq_number_, batch_, max_packet_size);
+  seq_number_ += n_packets;
+  return send(batch_);
+}
+
+}  // namespace science::libndtp
@@ -0,0 +1,323 @@
+#include "science/libndtp/transport/uring.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+namespace science::libndtp {
+
+namespace {
+
+constexpr uint64_t RECV_USER_DATA = 1;
+constexpr uint16_t BUFFER_GROUP = 0;
+
+int io_uring_setup(unsigned entries, io_uring_params* params) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, const void* arg, size_t arg_size) {
+  return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size));
+}
+
+int io_uring_register(int fd, unsigned opcode, const void* arg, unsigned n_args) {
+  return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, n_args));
+}
+
+size_t round_up_pow2(size_t n) {
+  size_t p = 1;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+}  // namespace
+
+/**
+ * The io_uring instance: submission and completion rings mapped from the kernel, plus the
+ * registered ring of provided receive buffers. Construction throws std::runtime_error on any
+ * failure, which the receiver treats as io_uring being unavailable.
+ */
+struct NDTPUringReceiver::Ring {
+  Ring(int socket_fd, size_t n_buffers, size_t max_datagram_size) : socket_fd(socket_fd) {
+    try {
+      init(n_buffers, max_datagram_size);
+    } catch (...) {
+      release();
+      throw;
+    }
+  }
+
+  ~Ring() { release(); }
+
+  void init(size_t n_buffers, size_t max_datagram_size) {
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = 2 * n_buffers;
+    fd = io_uring_setup(4, &params);
+    if (fd < 0) {
+      throw std::runtime_error(std::string("io_uring_setup failed: ") + std::strerror(errno));
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+      throw std::runtime_error("io_uring lacks IORING_FEAT_EXT_ARG");
+    }
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      sq_size = cq_size = std::max(sq_size, cq_size);
+    }
+    sq_ptr = map(sq_size, IORING_OFF_SQ_RING);
+    cq_ptr = (params.features & IORING_FEAT_SINGLE_MMAP) ? sq_ptr : map(cq_size, IORING_OFF_CQ_RING);
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(map(sqes_size, IORING_OFF_SQES));
+
+    auto* sq = static_cast<uint8_t*>(sq_ptr);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    auto* cq = static_cast<uint8_t*>(cq_ptr);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // provided buffers: each holds the recvmsg header followed by the datagram
+    buffer_count = round_up_pow2(n_buffers);
+    buffer_size = sizeof(io_uring_recvmsg_out) + max_datagram_size;
+    buffers.resize(buffer_count * buffer_size);
+    buf_ring_size = buffer_count * sizeof(io_uring_buf);
+    buf_ring = static_cast<io_uring_buf_ring*>(
+      ::mmap(nullptr, buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+    );
+    if (buf_ring == MAP_FAILED) {
+      buf_ring = nullptr;
+      throw std::runtime_error("failed to map io_uring buffer ring");
+    }
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring);
+    reg.ring_entries = buffer_count;
+    reg.bgid = BUFFER_GROUP;
+    if (io_uring_register(fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+      throw std::runtime_error(std::string("failed to register io_uring buffer ring: ") + std::strerror(errno));
+    }
+    for (size_t bid = 0; bid < buffer_count; ++bid) {
+      add_buffer(bid, bid);
+    }
+    publish_buffers(buffer_count);
+
+    // multishot recvmsg only learns the name and control sizes from this header
+    std::memset(&msg, 0, sizeof(msg));
+    arm();
+    // kernels without multishot recvmsg reject it straight away
+    io_uring_enter(fd, 0, 0, 0, nullptr, 0);
+    unsigned head = *cq_head;
+    if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+      const io_uring_cqe& cqe = cqes[head & cq_mask];
+      if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP) {
+        throw std::runtime_error("io_uring does not support multishot recvmsg");
+      }
+    }
+  }
+
+  void release() {
+    // closing the ring unregisters the buffer ring before its memory goes away
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    if (buf_ring) {
+      ::munmap(buf_ring, buf_ring_size);
+    }
+    if (sqes) {
+      ::munmap(sqes, sqes_size);
+    }
+    if (cq_ptr && cq_ptr != sq_ptr) {
+      ::munmap(cq_ptr, cq_size);
+    }
+    if (sq_ptr) {
+      ::munmap(sq_ptr, sq_size);
+    }
+  }
+
+  void* map(size_t size, off_t offset) {
+    void* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    if (ptr == MAP_FAILED) {
+      throw std::runtime_error(std::string("failed to map io_uring ring: ") + std::strerror(errno));
+    }
+    return ptr;
+  }
+
+  // Queues buffer `bid` at position `offset` past the buffer ring tail; publish_buffers() makes them visible.
+  void add_buffer(uint16_t bid, size_t offset) {
+    // not buf_ring->bufs: in C++ the uapi flexible array member lands 8 bytes past the ring start
+    auto* bufs = reinterpret_cast<io_uring_buf*>(buf_ring);
+    io_uring_buf& buf = bufs[(buf_ring->tail + offset) & (buffer_count - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(buffers.data() + bid * buffer_size);
+    buf.len = buffer_size;
+    buf.bid = bid;
+  }
+
+  void publish_buffers(size_t count) {
+    __atomic_store_n(&buf_ring->tail, static_cast<uint16_t>(buf_ring->tail + count), __ATOMIC_RELEASE);
+  }
+
+  // Submits the multishot recvmsg that keeps delivering datagrams until it runs out of buffers.
+  void arm() {
+    unsigned tail = *sq_tail;
+    unsigned index = tail & sq_mask;
+    io_uring_sqe& sqe = sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_RECVMSG;
+    sqe.fd = socket_fd;
+    sqe.addr = reinterpret_cast<uint64_t>(&msg);
+    sqe.len = 1;
+    sqe.flags = IOSQE_BUFFER_SELECT;
+    sqe.buf_group = BUFFER_GROUP;
+    sqe.ioprio = IORING_RECV_MULTISHOT;
+    sqe.user_data = RECV_USER_DATA;
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    if (io_uring_enter(fd, 1, 0, 0, nullptr, 0) < 0) {
+      throw std::runtime_error(std::string("failed to submit io_uring recvmsg: ") + std::strerror(errno));
+    }
+  }
+
+  // Waits until a completion is available or `timeout_ms` passes; returns false on timeout.
+  bool wait(int timeout_ms) {
+    if (*cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+      return true;
+    }
+    if (timeout_ms == 0) {
+      return false;
+    }
+    __kernel_timespec ts{timeout_ms / 1000, (timeout_ms % 1000) * 1000000LL};
+    io_uring_getevents_arg arg{};
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = timeout_ms > 0 ? reinterpret_cast<uint64_t>(&ts) : 0;
+    if (io_uring_enter(fd, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) < 0 &&
+        errno != ETIME && errno != EINTR) {
+      throw std::runtime_error(std::string("failed to wait for io_uring completions: ") + std::strerror(errno));
+    }
+    return *cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+  }
+
+  int fd = -1;
+  int socket_fd;
+  msghdr msg{};
+
+  void* sq_ptr = nullptr;
+  void* cq_ptr = nullptr;
+  size_t sq_size = 0;
+  size_t cq_size = 0;
+  io_uring_sqe* sqes = nullptr;
+  size_t sqes_size = 0;
+  unsigned* sq_tail = nullptr;
+  unsigned* sq_array = nullptr;
+  unsigned sq_mask = 0;
+  unsigned* cq_head = nullptr;
+  unsigned* cq_tail = nullptr;
+  unsigned cq_mask = 0;
+  io_uring_cqe* cqes = nullptr;
+
+  io_uring_buf_ring* buf_ring = nullptr;
+  size_t buf_ring_size = 0;
+  size_t buffer_count = 0;
+  size_t buffer_size = 0;
+  ByteArray buffers;
+
+  // buffers handed out by the last receive(), returned to the ring on the next one
+  std::vector<uint16_t> in_use;
+};
+
+NDTPUringReceiver::NDTPUringReceiver(
+  const std::string& address, uint16_t port, size_t batch_size, size_t max_datagram_size, size_t n_buffers,
+  int receive_buffer_bytes, Backend preferred
+)
+    : socket_(std::make_unique<NDTPUdpReceiver>(address, port, batch_size, max_datagram_size, receive_buffer_bytes)),
+      batch_size_(batch_size) {
+  if (n_buffers == 0 || n_buffers > 32768) {
+    throw std::invalid_argument("io_uring receiver needs between 1 and 32768 buffers");
+  }
+  if (preferred == Backend::kIoUring) {
+    try {
+      ring_ = std::make_unique<Ring>(socket_->fd(), n_buffers, max_datagram_size);
+      datagrams_.reserve(batch_size);
+      messages_.resize(batch_size);
+      statuses_.resize(batch_size);
+      ring_->in_use.reserve(batch_size);
+    } catch (const std::runtime_error&) {
+      ring_.reset();
+    }
+  }
+}
+
+NDTPUringReceiver::~NDTPUringReceiver() = default;
+
+size_t NDTPUringReceiver::receive(int timeout_ms) {
+  if (!ring_) {
+    return socket_->receive(timeout_ms);
+  }
+  Ring& ring = *ring_;
+
+  datagrams_.clear();
+  // a batch holding only the completion that ended the multishot request re-arms it and waits again
+  for (bool rearm = true; rearm && datagrams_.empty();) {
+    for (size_t i = 0; i < ring.in_use.size(); ++i) {
+      ring.add_buffer(ring.in_use[i], i);
+    }
+    ring.publish_buffers(ring.in_use.size());
+    ring.in_use.clear();
+
+    if (!ring.wait(timeout_ms)) {
+      return 0;
+    }
+    rearm = false;
+    unsigned head = *ring.cq_head;
+    unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail && datagrams_.size() < batch_size_; ++head) {
+      const io_uring_cqe& cqe = ring.cqes[head & ring.cq_mask];
+      if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        // the multishot request ended (e.g. out of buffers); it is submitted again below
+        rearm = true;
+      }
+      if (cqe.res < 0) {
+        if (cqe.res != -ENOBUFS) {
+          throw std::runtime_error(std::string("io_uring recvmsg failed: ") + std::strerror(-cqe.res));
+        }
+        continue;
+      }
+      if (!(cqe.flags & IORING_CQE_F_BUFFER)) {
+        continue;
+      }
+
+      auto bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+      ring.in_use.push_back(bid);
+      const uint8_t* buffer = ring.buffers.data() + bid * ring.buffer_size;
+      io_uring_recvmsg_out out;
+      std::memcpy(&out, buffer, sizeof(out));
+      if (out.flags & MSG_TRUNC) {
+        stats_.truncated++;
+        continue;
+      }
+      datagrams_.push_back(ByteSpan{buffer + sizeof(out) + out.namelen + out.controllen, out.payloadlen});
+    }
+    __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+
+    if (rearm) {
+      ring.arm();
+    }
+  }
+  stats_.datagrams += datagrams_.size();
+  stats_.batches += !datagrams_.empty();
+  return datagrams_.size();
+}
+
+}  // namespace science::libndtp
@@ -1,106 +1,342 @@
 #include "science/libndtp/types.h"
+#include "science/libndtp/crc16.h"
 #include "science/libndtp/ndtp.h"
 
+#include <algorithm>
+#include <thread>
+#include <utility>
+
 namespace science::libndtp {
 
-static constexpr size_t MAX_CH_PAYLOAD_SIZE_BYTES = 1400;
+// Fixed bytes in every broadband packet: header, payload fields (bit width, channel count, sample rate) and CRC16.
+static constexpr size_t BROADBAND_PACKET_OVERHEAD =
+  NDTPHeader::NDTP_HEADER_SIZE + NDTPPayloadBroadband::FIXED_SIZE + NDTPMessage::NDTP_CRC_SIZE;
+
+// Bits in front of each channel's samples: 24-bit channel id and 16-bit sample count.
+static constexpr size_t BROADBAND_RUN_HEADER_BITS = 24 + 16;
+
+static std::vector<ByteArray> to_packet_list(const PacketBatch& batch) {
+  std::vector<ByteArray> packets;
+  packets.reserve(batch.size());
+  for (size_t i = 0; i < batch.size(); ++i) {
+    auto packet = batch[i];
+    packets.emplace_back(packet.begin(), packet.end());
+  }
+  return packets;
+}
+
+template <typename T>
+std::vector<ByteArray> GenericElectricalBroadbandData<T>::pack(uint64_t seq_number, size_t max_packet_size) const {
+  PacketBatch batch;
+  pack(seq_number, batch, max_packet_size);
+  return to_packet_list(batch);
+}
+
+/**
+ * One broadband packet as laid out by plan_broadband_packets(): the runs of channels [first, last)
+ * starting at sample index k, taking `bits` bits of payload after the fixed fields.
+ */
+struct BroadbandPacketPlan {
+  size_t k;
+  size_t first;
+  size_t last;
+  uint32_t n_runs;
+  size_t bits;
+
+  size_t size() const { return BROADBAND_PACKET_OVERHEAD + (bits + 7) / 8; }
+};
+
+template <typename Channel>
+static size_t broadband_run_length(const Channel& channel, size_t k, size_t window) {
+  return channel.channel_data.size() > k ? std::min(window, channel.channel_data.size() - k) : 0;
+}
+
+// Window length in samples of packets of at most `max_packet_size` bytes.
+template <typename T>
+static size_t broadband_window(const GenericElectricalBroadbandData<T>& data, size_t max_packet_size) {
+  if (data.bit_width < 1 || data.bit_width > 64) {
+    throw std::invalid_argument("invalid bit width for ElectricalBroadbandData: " + std::to_string(data.bit_width));
+  }
+  if (max_packet_size < BROADBAND_PACKET_OVERHEAD + (BROADBAND_RUN_HEADER_BITS + data.bit_width + 7) / 8) {
+    throw std::invalid_argument(
+      "max packet size of " + std::to_string(max_packet_size) + " bytes cannot hold a single sample"
+    );
+  }
+
+  // Packets cover windows of `window` samples starting at a common sample index k, so each one is
+  // described by a single header timestamp. Within a window, the channels' runs are packed in
+  // order into as few packets as fit, and a window is never longer than what one channel's run
+  // can carry in a packet on its own.
+  size_t payload_bits = (max_packet_size - BROADBAND_PACKET_OVERHEAD) * 8;
+  return std::min<size_t>((payload_bits - BROADBAND_RUN_HEADER_BITS) / data.bit_width, 0xFFFF);
+}
 
-void chunk_channel_data(
-  const std::vector<uint64_t>& ch_data,
-  size_t max_payload_size_bytes,
-  std::vector<std::vector<uint64_t>>* chunks
+// Splits the data into packets of at most `max_packet_size` bytes with windows of `window`
+// samples, calling `on_packet(const BroadbandPacketPlan&)` for each in order.
+template <typename T, typename F>
+static void plan_broadband_packets(
+  const GenericElectricalBroadbandData<T>& data, size_t max_packet_size, size_t window, F&& on_packet
 ) {
-  size_t n_packets = std::ceil(ch_data.size() / max_payload_size_bytes);
-  size_t n_pts_per_packet = std::ceil(ch_data.size() / n_packets);
-  for (size_t i = 0; i < n_packets; ++i) {
-    size_t start_idx = i * n_pts_per_packet;
-    size_t end_idx = std::min(start_idx + n_pts_per_packet, ch_data.size());
-    chunks->push_back(std::vector<uint64_t>(ch_data.begin() + start_idx, ch_data.begin() + end_idx));
+  size_t payload_bits = (max_packet_size - BROADBAND_PACKET_OVERHEAD) * 8;
+  size_t n_samples = 0;
+  for (const auto& channel : data.channels) {
+    n_samples = std::max(n_samples, channel.channel_data.size());
+  }
+  for (size_t k = 0; k < n_samples; k += window) {
+    BroadbandPacketPlan plan{k, 0, 0, 0, 0};
+    for (size_t c = 0; c < data.channels.size(); ++c) {
+      size_t run = broadband_run_length(data.channels[c], k, window);
+      if (run == 0) {
+        continue;
+      }
+      size_t run_bits = BROADBAND_RUN_HEADER_BITS + run * data.bit_width;
+      if (plan.bits + run_bits > payload_bits) {
+        plan.last = c;
+        on_packet(plan);
+        plan = BroadbandPacketPlan{k, c, 0, 0, 0};
+      }
+      plan.n_runs += 1;
+      plan.bits += run_bits;
+    }
+    if (plan.n_runs > 0) {
+      plan.last = data.channels.size();
+      on_packet(plan);
+    }
   }
 }
 
-std::vector<ByteArray> ElectricalBroadbandData::pack(uint64_t seq_number) const {
-  std::vector<ByteArray> packets;
-  int seq_number_offset = 0;
-
-  for (const auto& channel : channels) {
-    std::vector<std::vector<uint64_t>> chunked;
-    chunk_channel_data(channel.channel_data, MAX_CH_PAYLOAD_SIZE_BYTES, &chunked);
-
-    for (const auto& chunk : chunked) {
-      NDTPHeader header;
-      header.version = NDTP_VERSION;
-      header.data_type = synapse::DataType::kBroadband;
-      header.timestamp = t0;
-      header.seq_number = seq_number + seq_number_offset;
-
-      NDTPPayloadBroadband payload;
-      payload.is_signed = is_signed;
-      payload.bit_width = bit_width;
-      payload.sample_rate = sample_rate;
-      payload.channels.push_back({
-        .channel_id = channel.channel_id,
-        .channel_data = channel.channel_data
-      });
-
-      NDTPMessage message;
-      message.header = header;
-      message.payload = payload;
-
-      packets.push_back(message.pack());
-      seq_number_offset += 1;
+// Encodes the packet described by `plan` into the plan.size() bytes at `dst`, with the same
+// serializers as NDTPMessage::pack_into.
+template <typename T>
+static void encode_broadband_packet(
+  const GenericElectricalBroadbandData<T>& data, const BroadbandPacketPlan& plan, size_t window, uint16_t seq_number,
+  uint8_t* dst
+) {
+  using Payload = GenericNDTPPayloadBroadband<T>;
+  NDTPHeader header{
+    .data_type = synapse::DataType::kBroadband,
+    .timestamp = data.sample_rate > 0 ? data.t0 + plan.k * NDTP_TIMESTAMP_TICKS_PER_SECOND / data.sample_rate : data.t0,
+    .seq_number = seq_number
+  };
+  uint8_t* ptr = dst + header.pack_into(dst, plan.size());
+  Payload::pack_fields(ptr, data.is_signed, data.bit_width, plan.n_runs, data.sample_rate);
+  ptr += Payload::FIXED_SIZE;
+
+  BitWriter writer(ptr, (plan.bits + 7) / 8);
+  for (size_t c = plan.first; c < plan.last; ++c) {
+    const auto& channel = data.channels[c];
+    size_t run = broadband_run_length(channel, plan.k, window);
+    if (run > 0) {
+      Payload::pack_run(writer, channel.channel_id, channel.channel_data.data() + plan.k, run, data.bit_width);
     }
   }
+  ptr += writer.finish();
 
-  return packets;
+  crc16_append(dst, ptr - dst);
+}
+
+template <typename T>
+size_t GenericElectricalBroadbandData<T>::pack(uint64_t seq_number, PacketBatch& batch, size_t max_packet_size) const {
+  // each packet is encoded as soon as it is laid out, straight into the batch
+  size_t window = broadband_window(*this, max_packet_size);
+  size_t n_packets = 0;
+  plan_broadband_packets(*this, max_packet_size, window, [&](const BroadbandPacketPlan& plan) {
+    size_t size = plan.size();
+    uint8_t* dst = batch.append_uninitialized(&size, 1);
+    encode_broadband_packet(*this, plan, window, static_cast<uint16_t>(seq_number + n_packets++), dst);
+  });
+  return n_packets;
 }
 
-ElectricalBroadbandData ElectricalBroadbandData::unpack(const NDTPMessage& msg) {
-  ElectricalBroadbandData data;
-  auto payload = std::get<NDTPPayloadBroadband>(msg.payload);
-  data.bit_width = payload.bit_width;
-  data.is_signed = payload.is_signed;
-  data.sample_rate = payload.sample_rate;
-  data.t0 = msg.header.timestamp;
+template <typename T>
+size_t GenericElectricalBroadbandData<T>::pack_parallel(
+  uint64_t seq_number, PacketBatch& batch, size_t n_threads, size_t max_packet_size
+) const {
+  // laying the packets out first fixes every packet's sequence number and position, so the
+  // threads can encode disjoint ranges of them in any order
+  size_t window = broadband_window(*this, max_packet_size);
+  std::vector<BroadbandPacketPlan> plans;
+  std::vector<size_t> offsets;
+  plan_broadband_packets(*this, max_packet_size, window, [&](const BroadbandPacketPlan& plan) {
+    plans.push_back(plan);
+    offsets.push_back(plan.size());
+  });
+  // the packet sizes become their offsets once the slots are reserved
+  uint8_t* dst = batch.append_uninitialized(offsets.data(), offsets.size());
+  size_t total = 0;
+  for (auto& offset : offsets) {
+    total += std::exchange(offset, total);
+  }
+  offsets.push_back(total);
+
+  if (n_threads == 0) {
+    n_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  // not worth a thread for less than this many bytes of packets
+  constexpr size_t MIN_BYTES_PER_THREAD = 64 * 1024;
+  n_threads = std::max<size_t>(1, std::min(n_threads, offsets.back() / MIN_BYTES_PER_THREAD));
+  n_threads = std::min(n_threads, std::max<size_t>(plans.size(), 1));
 
-  for (const auto& channel : payload.channels) {
-    ChannelData cd;
-    cd.channel_id = channel.channel_id;
-    cd.channel_data = channel.channel_data;
-    data.channels.push_back(cd);
+  // split the packets into ranges of roughly equal bytes
+  auto encode_range = [&](size_t t) {
+    size_t begin = std::lower_bound(offsets.begin(), offsets.end() - 1, offsets.back() * t / n_threads) - offsets.begin();
+    size_t end = std::lower_bound(offsets.begin(), offsets.end() - 1, offsets.back() * (t + 1) / n_threads) - offsets.begin();
+    for (size_t i = begin; i < end; ++i) {
+      encode_broadband_packet(*this, plans[i], window, static_cast<uint16_t>(seq_number + i), dst + offsets[i]);
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(n_threads - 1);
+  for (size_t t = 1; t < n_threads; ++t) {
+    threads.emplace_back(encode_range, t);
+  }
+  encode_range(0);
+  for (auto& thread : threads) {
+    thread.join();
   }
+  return plans.size();
+}
 
+template <typename T>
+GenericElectricalBroadbandData<T> GenericElectricalBroadbandData<T>::unpack(const NDTPMessage& msg) {
+  GenericElectricalBroadbandData data{};
+  unpack_into(msg, data);
   return data;
 }
 
+// Copies a decoded payload of either broadband encoding into `out`.
+template <typename T, typename Payload>
+static void assign_broadband(const Payload& payload, uint64_t timestamp, GenericElectricalBroadbandData<T>& out) {
+  check_broadband_sample_type<T>(payload.bit_width, payload.is_signed);
+  out.bit_width = payload.bit_width;
+  out.is_signed = payload.is_signed;
+  out.sample_rate = payload.sample_rate;
+  out.t0 = timestamp;
+
+  out.channels.resize(payload.channels.size());
+  for (size_t c = 0; c < payload.channels.size(); ++c) {
+    out.channels[c].channel_id = payload.channels[c].channel_id;
+    // signed samples are sign extended to 64 bits, so truncating keeps their value
+    out.channels[c].channel_data.assign(payload.channels[c].channel_data.begin(), payload.channels[c].channel_data.end());
+  }
+}
+
+template <typename T>
+void GenericElectricalBroadbandData<T>::unpack_into(const NDTPMessage& msg, GenericElectricalBroadbandData& out) {
+  if (const auto* delta = std::get_if<NDTPPayloadBroadbandDelta>(&msg.payload)) {
+    assign_broadband(*delta, msg.header.timestamp, out);
+  } else {
+    assign_broadband(std::get<NDTPPayloadBroadband>(msg.payload), msg.header.timestamp, out);
+  }
+}
+
+template <typename T>
+GenericElectricalBroadbandData<T> GenericElectricalBroadbandData<T>::unpack(const uint8_t* data, size_t size, bool ignore_crc) {
+  GenericElectricalBroadbandData result{};
+  unpack_into(data, size, result, ignore_crc);
+  return result;
+}
+
+template <typename T>
+void GenericElectricalBroadbandData<T>::unpack_into(
+  const uint8_t* data, size_t size, GenericElectricalBroadbandData& out, bool ignore_crc
+) {
+  if (size < NDTPHeader::NDTP_HEADER_SIZE + NDTPMessage::NDTP_CRC_SIZE) {
+    throw std::runtime_error("invalid data size for NDTPMessage");
+  }
+  if (!ignore_crc && !crc16_verify(data, size)) {
+    throw std::runtime_error("CRC verification failed");
+  }
+  auto header = NDTPHeader::unpack(data, NDTPHeader::NDTP_HEADER_SIZE);
+  const uint8_t* payload_data = data + NDTPHeader::NDTP_HEADER_SIZE;
+  size_t payload_size = size - NDTPHeader::NDTP_HEADER_SIZE - NDTPMessage::NDTP_CRC_SIZE;
+  if (header.data_type == (synapse::DataType::kBroadband | NDTP_DATA_TYPE_COMPRESSED)) {
+    // delta samples depend on the ones before them, so they are decoded at full width first
+    assign_broadband(NDTPPayloadBroadbandDelta::unpack(payload_data, payload_size), header.timestamp, out);
+    return;
+  }
+  if (header.data_type != synapse::DataType::kBroadband) {
+    throw std::runtime_error("NDTP message is not broadband data (data type " + std::to_string(header.data_type) + ")");
+  }
+
+  // the channels of `out` are lent to the payload, which decodes straight into them
+  GenericNDTPPayloadBroadband<T> payload{};
+  payload.channels.swap(out.channels);
+  try {
+    GenericNDTPPayloadBroadband<T>::unpack_into(payload_data, payload_size, payload);
+  } catch (...) {
+    out.channels.swap(payload.channels);
+    throw;
+  }
+  out.channels.swap(payload.channels);
+  out.is_signed = payload.is_signed;
+  out.bit_width = payload.bit_width;
+  out.sample_rate = payload.sample_rate;
+  out.t0 = header.timestamp;
+}
+
+template struct GenericElectricalBroadbandData<uint64_t>;
+template struct GenericElectricalBroadbandData<int64_t>;
+template struct GenericElectricalBroadbandData<uint32_t>;
+template struct GenericElectricalBroadbandData<int32_t>;
+template struct GenericElectricalBroadbandData<uint16_t>;
+template struct GenericElectricalBroadbandData<int16_t>;
+template struct GenericElectricalBroadbandData<uint8_t>;
+template struct GenericElectricalBroadbandData<int8_t>;
+
 // Implementation of BinnedSpiketrainData
 std::vector<ByteArray> BinnedSpiketrainData::pack(uint64_t seq_number) const {
-  std::vector<ByteArray> packets;
+  PacketBatch batch;
+  pack(seq_number, batch);
+  return to_packet_list(batch);
+}
 
+size_t BinnedSpiketrainData::pack(uint64_t seq_number, PacketBatch& batch) const {
   NDTPHeader header;
   header.version = NDTP_VERSION;
   header.data_type = synapse::DataType::kSpiketrain;
-  header.timestamp = 0;  // Assign appropriate timestamp
+  header.timestamp = t0;
   header.seq_number = seq_number;
 
   NDTPPayloadSpiketrain payload;
+  payload.bin_size_ms = bin_size_ms;
   payload.spike_counts = spike_counts;
 
   NDTPMessage message;
   message.header = header;
-  message.payload = payload;
 
-  packets.push_back(message.pack());
+  // mostly empty bins go out as a list of the non-zero ones
+  size_t dense_size = payload.encoded_size();
+  NDTPPayloadSpiketrainSparse sparse{.bin_size_ms = bin_size_ms, .spike_counts = std::move(payload.spike_counts)};
+  if (sparse.spike_counts.size() <= NDTPPayloadSpiketrainSparse::MAX_BINS && sparse.encoded_size() < dense_size) {
+    message.header.data_type |= NDTP_DATA_TYPE_COMPRESSED;
+    message.payload = std::move(sparse);
+  } else {
+    payload.spike_counts = std::move(sparse.spike_counts);
+    message.payload = std::move(payload);
+  }
+
+  batch.append(message);
 
-  return packets;
+  return 1;
 }
 
 BinnedSpiketrainData BinnedSpiketrainData::unpack(const NDTPMessage& msg) {
-  BinnedSpiketrainData data;
-  data.spike_counts = std::get<NDTPPayloadSpiketrain>(msg.payload).spike_counts;
-  data.bin_size_ms = std::get<NDTPPayloadSpiketrain>(msg.payload).bin_size_ms;
-  data.t0 = msg.header.timestamp;
+  BinnedSpiketrainData data{};
+  unpack_into(msg, data);
   return data;
 }
 
+void BinnedSpiketrainData::unpack_into(const NDTPMessage& msg, BinnedSpiketrainData& out) {
+  if (const auto* sparse = std::get_if<NDTPPayloadSpiketrainSparse>(&msg.payload)) {
+    out.spike_counts.assign(sparse->spike_counts.begin(), sparse->spike_counts.end());
+    out.bin_size_ms = sparse->bin_size_ms;
+  } else {
+    const auto& dense = std::get<NDTPPayloadSpiketrain>(msg.payload);
+    out.spike_counts.assign(dense.spike_counts.begin(), dense.spike_counts.end());
+    out.bin_size_ms = dense.bin_size_ms;
+  }
+  out.t0 = msg.header.timestamp;
+}
+
 }  // namespace science::libndtp
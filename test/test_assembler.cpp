@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+#include <science/libndtp/assembler.h>
+
+namespace science::libndtp {
+
+static ElectricalBroadbandData make_block_data(size_t n_channels, size_t n_samples) {
+  ElectricalBroadbandData data{.is_signed = false, .bit_width = 16, .sample_rate = 30000, .t0 = 1000000};
+  for (uint32_t c = 0; c < n_channels; c++) {
+    std::vector<uint64_t> samples(n_samples);
+    for (size_t i = 0; i < n_samples; i++) {
+      samples[i] = (c * 1000 + i) & 0xFFFF;
+    }
+    data.channels.push_back({.channel_id = c + 1, .channel_data = samples});
+  }
+  return data;
+}
+
+TEST(AssemblerTest, BroadbandAssemblerBuildsBlocksFromPackets) {
+  auto data = make_block_data(3, 3000);
+  std::vector<NDTPMessage> messages;
+  for (const auto& packet : data.pack(0)) {
+    messages.push_back(NDTPMessage::unpack(packet));
+  }
+  ASSERT_GT(messages.size(), 4);
+
+  // swap two packets and lose one in the second block
+  std::swap(messages[1], messages[2]);
+  auto lost = messages[messages.size() - 2];
+  messages.erase(messages.end() - 2);
+
+  BroadbandAssembler assembler({1, 2, 3}, 30000, 1500);
+  std::vector<BroadbandBlock> blocks;
+  auto emit = [&](const BroadbandBlock& block) { blocks.push_back(block); };
+  for (const auto& message : messages) {
+    assembler.push(message, emit);
+  }
+  ASSERT_EQ(blocks.size(), 1);
+  assembler.flush(emit);
+  ASSERT_EQ(blocks.size(), 2);
+
+  // mark the samples the lost packet carried
+  std::vector<std::vector<bool>> lost_samples(3, std::vector<bool>(3000));
+  size_t n_lost = 0;
+  size_t lost_start = ((lost.header.timestamp - data.t0) * 30000 + 500000) / 1000000;
+  for (const auto& channel : std::get<NDTPPayloadBroadband>(lost.payload).channels) {
+    for (size_t i = 0; i < channel.channel_data.size(); i++) {
+      lost_samples[channel.channel_id - 1][lost_start + i] = true;
+      n_lost++;
+    }
+  }
+  ASSERT_GT(n_lost, 0);
+
+  for (size_t b = 0; b < blocks.size(); b++) {
+    EXPECT_EQ(blocks[b].index, b);
+    EXPECT_EQ(blocks[b].timestamp, data.t0 + b * 50000);
+    for (size_t c = 0; c < 3; c++) {
+      for (size_t i = 0; i < 1500; i++) {
+        size_t k = c * 1500 + i;
+        bool missing = lost_samples[c][b * 1500 + i];
+        EXPECT_EQ(blocks[b].present[k], missing ? 0 : 1);
+        EXPECT_EQ(blocks[b].samples[k], missing ? 0 : data.channels[c].channel_data[b * 1500 + i]);
+      }
+    }
+  }
+  EXPECT_TRUE(blocks[0].complete());
+  EXPECT_FALSE(blocks[1].complete());
+  EXPECT_EQ(blocks[1].total_received, 4500 - n_lost);
+
+  // the lost packet shows up after its block was emitted
+  assembler.push(lost, emit);
+  EXPECT_EQ(assembler.late_samples(), n_lost);
+  EXPECT_EQ(blocks.size(), 2);
+}
+
+TEST(AssemblerTest, BroadbandAssemblerEmitsIncompleteBlocksWhenOverrun) {
+  BroadbandAssembler assembler({7}, 1000, 10, 2);
+  std::vector<uint64_t> emitted;
+  auto emit = [&](const BroadbandBlock& block) {
+    EXPECT_FALSE(block.complete());
+    emitted.push_back(block.index);
+  };
+
+  // 5 samples each into blocks 0 and 3; block 3 pushes out blocks 0 and 1
+  assembler.push(ElectricalBroadbandData{.sample_rate = 1000, .t0 = 0, .channels = {{7, {1, 2, 3, 4, 5}}}}, emit);
+  assembler.push(ElectricalBroadbandData{.sample_rate = 1000, .t0 = 30000, .channels = {{7, {1, 2, 3, 4, 5}}, {8, {1}}}}, emit);
+  EXPECT_EQ(emitted, std::vector<uint64_t>({0, 1}));
+  EXPECT_EQ(assembler.ignored_samples(), 1);
+
+  assembler.flush(emit);
+  EXPECT_EQ(emitted, std::vector<uint64_t>({0, 1, 3}));
+
+  EXPECT_THROW(assembler.push(ElectricalBroadbandData{.sample_rate = 2000, .t0 = 0}, emit), std::invalid_argument);
+}
+
+TEST(AssemblerTest, BroadbandAssemblerSkipsTimestampJumps) {
+  BroadbandAssembler assembler({7, 8}, 1000, 10, 2);
+  std::vector<BroadbandBlock> blocks;
+  auto emit = [&](const BroadbandBlock& block) { blocks.push_back(block); };
+
+  // an hour later: the pending blocks go out and the range moves on, without 360000 empty blocks
+  assembler.push(ElectricalBroadbandData{.sample_rate = 1000, .t0 = 0, .channels = {{7, {1, 2, 3, 4, 5}}}}, emit);
+  assembler.push(ElectricalBroadbandData{.sample_rate = 1000, .t0 = 3600000000, .channels = {{7, {9}}, {8, {9}}}}, emit);
+  ASSERT_EQ(blocks.size(), 1);
+  EXPECT_EQ(blocks[0].index, 0);
+  EXPECT_EQ(blocks[0].total_received, 5);
+  // blocks 2 to 359998 were skipped; 0 and 1 were flushed and 359999 and 360000 are pending
+  EXPECT_EQ(assembler.skipped_samples(), (359999 - 2) * 10 * 2);
+
+  assembler.push(ElectricalBroadbandData{.sample_rate = 1000, .t0 = 3599990000, .channels = {{7, {4}}}}, emit);
+  assembler.flush(emit);
+  ASSERT_EQ(blocks.size(), 3);
+  EXPECT_EQ(blocks[1].index, 359999);
+  EXPECT_EQ(blocks[1].timestamp, 3599990000);
+  EXPECT_EQ(blocks[1].samples[0], 4);
+  EXPECT_EQ(blocks[2].index, 360000);
+  EXPECT_EQ(blocks[2].timestamp, 3600000000);
+  EXPECT_EQ(blocks[2].samples[0], 9);
+  EXPECT_EQ(blocks[2].samples[10], 9);
+  EXPECT_EQ(assembler.late_samples(), 0);
+
+  // a jump of less than twice the pending range still pushes out the blocks in between
+  blocks.clear();
+  assembler.push(ElectricalBroadbandData{.sample_rate = 1000, .t0 = 3600030000, .channels = {{7, {1}}}}, emit);
+  ASSERT_EQ(blocks.size(), 1);
+  EXPECT_EQ(blocks[0].index, 360001);
+  assembler.flush(emit);
+  ASSERT_EQ(blocks.size(), 2);
+  EXPECT_EQ(blocks[1].index, 360003);
+  EXPECT_EQ(assembler.skipped_samples(), (359999 - 2) * 10 * 2);
+}
+
+}  // namespace science::libndtp
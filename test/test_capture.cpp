@@ -0,0 +1,190 @@
+#include <gtest/gtest.h>
+#include <science/libndtp/capture.h>
+#include <science/libndtp/ndtp.h>
+#include "test_helpers.h"
+
+#include <unistd.h>
+
+#include <memory>
+
+namespace science::libndtp {
+
+static ByteArray make_capture_datagram(uint8_t data_type, uint64_t timestamp, uint16_t seq_number) {
+  return make_test_datagram(data_type, timestamp, seq_number, seq_number % 50);
+}
+
+// Two interleaved streams: broadband every 10 us and spiketrain every 30 us, plus a stray short datagram.
+static std::vector<ByteArray> write_capture(const std::string& path, NDTPCaptureOptions options, bool close = true) {
+  std::vector<ByteArray> datagrams;
+  auto writer = std::make_unique<NDTPCaptureWriter>(path, options);
+  for (uint16_t i = 0; i < 1000; i++) {
+    datagrams.push_back(make_capture_datagram(synapse::DataType::kBroadband, 1000 + i * 10, i));
+    if (i % 3 == 0) {
+      datagrams.push_back(make_capture_datagram(synapse::DataType::kSpiketrain, 1000 + i * 10, i / 3));
+    }
+    if (i == 500) {
+      datagrams.push_back(ByteArray{1, 2, 3});
+    }
+  }
+  for (size_t i = 0; i < datagrams.size(); i++) {
+    writer->write(datagrams[i].data(), datagrams[i].size(), 5000000000ULL + i);
+  }
+  EXPECT_EQ(writer->records(), datagrams.size());
+  uint64_t records_end = writer->bytes();
+  writer.reset();
+  if (!close) {
+    // leave the file as a crashed writer would, without the index
+    ::truncate(path.c_str(), records_end);
+  }
+  return datagrams;
+}
+
+TEST(CaptureTest, ReadsBackEveryDatagram) {
+  auto path = testing::TempDir() + "/libndtp_capture_test.ndtpcap";
+  for (bool direct_io : {false, true}) {
+    auto datagrams = write_capture(path, NDTPCaptureOptions{.buffer_bytes = 10000, .direct_io = direct_io, .index_interval = 16});
+    NDTPCaptureReader reader(path);
+    EXPECT_TRUE(reader.complete());
+    EXPECT_EQ(reader.index_interval(), 16);
+
+    NDTPCaptureRecord record;
+    size_t n = 0;
+    for (uint64_t pos = reader.begin(); reader.next(pos, record); n++) {
+      ASSERT_LT(n, datagrams.size());
+      EXPECT_EQ(record.receive_time_ns, 5000000000ULL + n);
+      ASSERT_EQ(ByteArray(record.datagram.begin(), record.datagram.end()), datagrams[n]) << "record " << n;
+    }
+    EXPECT_EQ(n, datagrams.size());
+  }
+  ::unlink(path.c_str());
+}
+
+TEST(CaptureTest, SeeksByTimestampAndStream) {
+  auto path = testing::TempDir() + "/libndtp_capture_seek.ndtpcap";
+  for (bool close : {true, false}) {
+    write_capture(path, NDTPCaptureOptions{.index_interval = 16}, close);
+    NDTPCaptureReader reader(path);
+    EXPECT_EQ(reader.complete(), close);
+    // 1000 broadband and 334 spiketrain records: entries every 16, plus each stream's last record
+    EXPECT_EQ(reader.index().size(), 63 + 1 + 21 + 1);
+
+    NDTPCaptureRecord record;
+    for (uint64_t timestamp : {0, 1000, 1005, 1010, 4321, 5990, 10990}) {
+      uint64_t pos = reader.seek(timestamp, synapse::DataType::kBroadband);
+      ASSERT_TRUE(reader.next(pos, record));
+      auto header = NDTPHeader::unpack(record.datagram.data, record.datagram.size);
+      EXPECT_EQ(header.data_type, synapse::DataType::kBroadband);
+      EXPECT_EQ(header.timestamp, std::max<uint64_t>(1000, (timestamp + 9) / 10 * 10)) << timestamp;
+
+      pos = reader.seek(timestamp, synapse::DataType::kSpiketrain);
+      ASSERT_TRUE(reader.next(pos, record));
+      header = NDTPHeader::unpack(record.datagram.data, record.datagram.size);
+      EXPECT_EQ(header.data_type, synapse::DataType::kSpiketrain);
+      uint64_t periods = timestamp > 1000 ? (timestamp - 1000 + 29) / 30 : 0;
+      EXPECT_EQ(header.timestamp, 1000 + periods * 30) << timestamp;
+    }
+
+    // the earliest record of any stream; at 3010 both streams have one, and broadband comes first
+    uint64_t pos = reader.seek(3010);
+    ASSERT_TRUE(reader.next(pos, record));
+    EXPECT_EQ(record.datagram.data[1], synapse::DataType::kBroadband);
+    EXPECT_EQ(NDTPHeader::unpack(record.datagram.data, record.datagram.size).timestamp, 3010);
+    ASSERT_TRUE(reader.next(pos, record));
+    EXPECT_EQ(NDTPHeader::unpack(record.datagram.data, record.datagram.size).timestamp, 3010);
+
+    EXPECT_EQ(reader.seek(10991, synapse::DataType::kBroadband), reader.end());
+    EXPECT_EQ(reader.seek(10991), reader.end());
+    EXPECT_EQ(reader.seek(0, 0x42), reader.end());
+  }
+  ::unlink(path.c_str());
+}
+
+TEST(CaptureTest, SeeksToTheFirstOfRecordsSharingATimestamp) {
+  // the packets of one broadband window share its timestamp: 10 windows of 9 packets, with index
+  // entries every 4 records so that several entries carry each timestamp
+  auto path = testing::TempDir() + "/libndtp_capture_shared.ndtpcap";
+  {
+    NDTPCaptureWriter writer(path, NDTPCaptureOptions{.index_interval = 4});
+    for (uint16_t seq = 0; seq < 90; seq++) {
+      auto datagram = make_capture_datagram(synapse::DataType::kBroadband, 10 * (seq / 9 + 1), seq);
+      writer.write(datagram.data(), datagram.size(), seq);
+    }
+  }
+  NDTPCaptureReader reader(path);
+  NDTPCaptureRecord record;
+  for (uint64_t timestamp : {0, 10, 15, 20, 50, 100}) {
+    uint64_t pos = reader.seek(timestamp, synapse::DataType::kBroadband);
+    ASSERT_TRUE(reader.next(pos, record));
+    auto header = NDTPHeader::unpack(record.datagram.data, record.datagram.size);
+    uint64_t window = timestamp == 0 ? 0 : (timestamp + 9) / 10 - 1;
+    EXPECT_EQ(header.seq_number, window * 9) << timestamp;
+    EXPECT_EQ(reader.seek(timestamp), record.offset) << timestamp;
+  }
+  EXPECT_EQ(reader.seek(101), reader.end());
+  ::unlink(path.c_str());
+}
+
+TEST(CaptureTest, IndexesBothEncodingsOfAStreamTogether) {
+  // a spiketrain stream that alternates between dense and sparse payloads
+  auto path = testing::TempDir() + "/libndtp_capture_encodings.ndtpcap";
+  {
+    NDTPCaptureWriter writer(path, NDTPCaptureOptions{.index_interval = 4});
+    for (uint16_t seq = 0; seq < 20; seq++) {
+      NDTPMessage message{.header = NDTPHeader{.data_type = synapse::DataType::kSpiketrain, .timestamp = 10u * seq, .seq_number = seq}};
+      std::vector<uint8_t> spike_counts(64, 0);
+      spike_counts[seq] = 1;
+      if (seq % 2) {
+        message.header.data_type |= NDTP_DATA_TYPE_COMPRESSED;
+        message.payload = NDTPPayloadSpiketrainSparse{.bin_size_ms = 1, .spike_counts = spike_counts};
+      } else {
+        message.payload = NDTPPayloadSpiketrain{.bin_size_ms = 1, .spike_counts = spike_counts};
+      }
+      auto datagram = message.pack();
+      writer.write(datagram.data(), datagram.size(), seq);
+    }
+  }
+  NDTPCaptureReader reader(path);
+  for (const auto& entry : reader.index()) {
+    EXPECT_EQ(entry.data_type, synapse::DataType::kSpiketrain);
+  }
+  NDTPCaptureRecord record;
+  for (uint16_t seq = 0; seq < 20; seq++) {
+    for (uint8_t flags : {uint8_t{0}, NDTP_DATA_TYPE_COMPRESSED}) {
+      uint64_t pos = reader.seek(10u * seq - (seq % 3), synapse::DataType::kSpiketrain | flags);
+      ASSERT_TRUE(reader.next(pos, record));
+      EXPECT_EQ(NDTPHeader::unpack(record.datagram.data, record.datagram.size).seq_number, seq);
+    }
+  }
+  ::unlink(path.c_str());
+}
+
+TEST(CaptureTest, RecoversUnclosedCaptures) {
+  auto path = testing::TempDir() + "/libndtp_capture_recover.ndtpcap";
+  auto datagrams = write_capture(path, NDTPCaptureOptions{}, false);
+
+  // cut the last record short
+  NDTPCaptureReader full(path);
+  EXPECT_FALSE(full.complete());
+  uint64_t pos = full.begin();
+  NDTPCaptureRecord record;
+  uint64_t last = pos;
+  while (full.next(pos, record)) {
+    last = record.offset;
+  }
+  ::truncate(path.c_str(), last + 20);
+
+  NDTPCaptureReader reader(path);
+  EXPECT_EQ(reader.end(), last);
+  size_t n = 0;
+  for (pos = reader.begin(); reader.next(pos, record); n++) {
+  }
+  EXPECT_EQ(n, datagrams.size() - 1);
+
+  ::truncate(path.c_str(), 4);
+  EXPECT_THROW(NDTPCaptureReader{path}, std::runtime_error);
+  ::unlink(path.c_str());
+  EXPECT_THROW(NDTPCaptureReader{path}, std::runtime_error);
+  EXPECT_THROW(NDTPCaptureWriter(path, NDTPCaptureOptions{.index_interval = 0}), std::invalid_argument);
+}
+
+}  // namespace science::libndtp
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <science/libndtp/codec.h>
+#include <science/libndtp/ndtp.h>
+
+namespace science::libndtp {
+
+template <uint8_t BitWidth, bool Signed, typename SampleT>
+static void expect_codec_matches_message(const std::vector<uint32_t>& channel_ids, uint16_t samples_per_channel) {
+  FixedBroadbandCodec<BitWidth, Signed, SampleT> codec(channel_ids, samples_per_channel, 30000);
+
+  std::vector<SampleT> samples(codec.samples_per_packet());
+  NDTPPayloadBroadband payload{.is_signed = Signed, .bit_width = BitWidth, .sample_rate = 30000};
+  for (size_t c = 0; c < channel_ids.size(); c++) {
+    std::vector<uint64_t> channel_data;
+    for (size_t i = 0; i < samples_per_channel; i++) {
+      uint64_t bits = ((c + 1) * 0x9E3779B97F4A7C15ULL * (i + 3)) >> 11;
+      int64_t value = Signed ? static_cast<int64_t>(bits << (64 - BitWidth)) >> (64 - BitWidth)
+                             : static_cast<int64_t>(BitWidth == 64 ? bits : bits & ((1ULL << BitWidth) - 1));
+      samples[c * samples_per_channel + i] = static_cast<SampleT>(value);
+      channel_data.push_back(static_cast<uint64_t>(value));
+    }
+    payload.channels.push_back({.channel_id = channel_ids[c], .channel_data = channel_data});
+  }
+
+  NDTPHeader header{.data_type = synapse::DataType::kBroadband, .timestamp = 1234567890123, .seq_number = 4242};
+  NDTPMessage message{.header = header, .payload = payload};
+  auto expected = message.pack();
+
+  auto packed = codec.pack(header.timestamp, header.seq_number, samples.data());
+  ASSERT_EQ(packed.size(), codec.packet_size());
+  EXPECT_EQ(packed, expected) << "bit width " << static_cast<int>(BitWidth);
+
+  auto unpacked_message = NDTPMessage::unpack(packed);
+  EXPECT_EQ(unpacked_message.header, header);
+  EXPECT_EQ(std::get<NDTPPayloadBroadband>(unpacked_message.payload), payload);
+
+  std::vector<SampleT> unpacked(codec.samples_per_packet());
+  auto unpacked_header = codec.unpack(expected.data(), expected.size(), unpacked.data());
+  EXPECT_EQ(unpacked_header, header);
+  EXPECT_EQ(unpacked, samples) << "bit width " << static_cast<int>(BitWidth);
+}
+
+TEST(CodecTest, FixedBroadbandCodecMatchesNDTPMessage) {
+  std::vector<uint32_t> channel_ids = {0, 1, 7, 0xABCDEF};
+  expect_codec_matches_message<10, false, uint16_t>(channel_ids, 13);
+  expect_codec_matches_message<12, true, int16_t>(channel_ids, 17);
+  expect_codec_matches_message<13, true, int32_t>(channel_ids, 9);
+  expect_codec_matches_message<16, false, uint16_t>(channel_ids, 32);
+  expect_codec_matches_message<24, true, int32_t>(channel_ids, 5);
+  expect_codec_matches_message<3, false, uint8_t>(channel_ids, 11);
+  expect_codec_matches_message<64, true, int64_t>(channel_ids, 3);
+  expect_codec_matches_message<12, false, uint64_t>({42}, 1);
+}
+
+TEST(CodecTest, FixedBroadbandCodecRejectsMismatchedMessages) {
+  FixedBroadbandCodec<12, true, int16_t> codec({1, 2}, 8, 30000);
+  std::vector<int16_t> samples(codec.samples_per_packet(), -3);
+  std::vector<int16_t> unpacked(codec.samples_per_packet());
+  auto packed = codec.pack(1, 2, samples.data());
+
+  FixedBroadbandCodec<12, true, int16_t> other_channels({1, 3}, 8, 30000);
+  EXPECT_THROW(other_channels.unpack(packed.data(), packed.size(), unpacked.data()), std::runtime_error);
+
+  FixedBroadbandCodec<12, false, int16_t> unsigned_codec({1, 2}, 8, 30000);
+  EXPECT_THROW(unsigned_codec.unpack(packed.data(), packed.size(), unpacked.data()), std::runtime_error);
+
+  packed[20] ^= 0x01;
+  EXPECT_THROW(codec.unpack(packed.data(), packed.size(), unpacked.data()), std::runtime_error);
+
+  uint8_t too_small[8];
+  EXPECT_THROW(codec.pack(1, 2, samples.data(), too_small, sizeof(too_small)), std::runtime_error);
+}
+
+}  // namespace science::libndtp
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <science/libndtp/ndtp.h>
+
+namespace science::libndtp {
+
+// An encoded broadband or spiketrain message with `n_values` samples (on channel 1) or spike
+// counts, whose values follow from the sequence number.
+inline ByteArray make_test_datagram(uint8_t data_type, uint64_t timestamp, uint16_t seq_number, size_t n_values) {
+  NDTPMessage message{.header = NDTPHeader{.data_type = data_type, .timestamp = timestamp, .seq_number = seq_number}};
+  if (data_type == synapse::DataType::kBroadband) {
+    message.payload = NDTPPayloadBroadband{
+      .is_signed = false,
+      .bit_width = 12,
+      .sample_rate = 30000,
+      .channels = {{.channel_id = 1, .channel_data = std::vector<uint64_t>(n_values, seq_number & 0xFFF)}}
+    };
+  } else {
+    message.payload = NDTPPayloadSpiketrain{
+      .bin_size_ms = 1, .spike_counts = std::vector<uint8_t>(n_values, static_cast<uint8_t>(seq_number & 0xF))
+    };
+  }
+  return message.pack();
+}
+
+}  // namespace science::libndtp
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <science/libndtp/matrix.h>
+
+namespace science::libndtp {
+
+static ByteArray make_matrix_message(bool is_signed, uint8_t bit_width) {
+  NDTPPayloadBroadband payload{.is_signed = is_signed, .bit_width = bit_width, .sample_rate = 30000};
+  for (uint32_t c = 0; c < 3; c++) {
+    std::vector<uint64_t> samples(300 + c * 100);
+    for (size_t i = 0; i < samples.size(); i++) {
+      int64_t value = static_cast<int64_t>((c * 97 + i * 13) % 2000) - (is_signed ? 1000 : 0);
+      samples[i] = static_cast<uint64_t>(value) & ((1ULL << bit_width) - 1);
+    }
+    payload.channels.push_back({.channel_id = 100 + c * 7, .channel_data = samples});
+  }
+  NDTPMessage message{
+    .header = NDTPHeader{.data_type = synapse::DataType::kBroadband, .timestamp = 42, .seq_number = 7},
+    .payload = payload
+  };
+  return message.pack();
+}
+
+TEST(MatrixTest, DecodesChannelMajorAndSampleMajor) {
+  auto datagram = make_matrix_message(true, 12);
+  auto expected = std::get<NDTPPayloadBroadband>(NDTPMessage::unpack(datagram).payload);
+
+  using Matrix = BroadbandSampleMatrix<int16_t>;
+  for (auto layout : {Matrix::Layout::kChannelMajor, Matrix::Layout::kSampleMajor}) {
+    for (size_t stride : {0, 520}) {
+      std::vector<int16_t> samples(520 * 520, -1);
+      std::vector<uint32_t> channel_ids(4);
+      std::vector<uint16_t> sample_counts(4);
+      Matrix matrix{
+        .samples = samples.data(),
+        .max_channels = 4,
+        .max_samples = 512,
+        .channel_ids = channel_ids.data(),
+        .sample_counts = sample_counts.data(),
+        .layout = layout,
+        .stride = stride
+      };
+      auto info = matrix.unpack(datagram.data(), datagram.size());
+      EXPECT_EQ(info.header.timestamp, 42);
+      EXPECT_EQ(info.header.seq_number, 7);
+      EXPECT_TRUE(info.is_signed);
+      EXPECT_EQ(info.bit_width, 12);
+      EXPECT_EQ(info.sample_rate, 30000);
+      ASSERT_EQ(info.n_channels, 3);
+      EXPECT_EQ(info.n_samples, 500);
+
+      for (size_t c = 0; c < 3; c++) {
+        EXPECT_EQ(channel_ids[c], expected.channels[c].channel_id);
+        ASSERT_EQ(sample_counts[c], expected.channels[c].channel_data.size());
+        for (size_t i = 0; i < sample_counts[c]; i++) {
+          ASSERT_EQ(matrix.at(c, i), static_cast<int16_t>(expected.channels[c].channel_data[i]))
+            << "channel " << c << " sample " << i << " stride " << stride;
+        }
+        // past the end of a row nothing is written
+        EXPECT_EQ(matrix.at(c, sample_counts[c]), -1);
+      }
+    }
+  }
+}
+
+TEST(MatrixTest, RejectsPacketsThatDoNotFit) {
+  auto datagram = make_matrix_message(false, 16);
+  std::vector<uint16_t> samples(4 * 512);
+  std::vector<uint32_t> channel_ids(4);
+  BroadbandSampleMatrix<uint16_t> matrix{
+    .samples = samples.data(), .max_channels = 4, .max_samples = 512, .channel_ids = channel_ids.data()
+  };
+  EXPECT_EQ(matrix.unpack(datagram.data(), datagram.size()).n_channels, 3);
+  EXPECT_EQ(matrix.at(2, 499), std::get<NDTPPayloadBroadband>(NDTPMessage::unpack(datagram).payload).channels[2].channel_data[499]);
+
+  auto too_few_channels = matrix;
+  too_few_channels.max_channels = 2;
+  EXPECT_THROW(too_few_channels.unpack(datagram.data(), datagram.size()), std::runtime_error);
+
+  auto too_few_samples = matrix;
+  too_few_samples.max_samples = 400;
+  EXPECT_THROW(too_few_samples.unpack(datagram.data(), datagram.size()), std::runtime_error);
+
+  auto bad_stride = matrix;
+  bad_stride.stride = 100;
+  EXPECT_THROW(bad_stride.unpack(datagram.data(), datagram.size()), std::invalid_argument);
+
+  // samples wider than the matrix type are refused rather than truncated
+  auto wide_datagram = make_matrix_message(true, 24);
+  std::vector<int16_t> narrow_samples(4 * 512);
+  BroadbandSampleMatrix<int16_t> narrow{
+    .samples = narrow_samples.data(), .max_channels = 4, .max_samples = 512, .channel_ids = channel_ids.data()
+  };
+  EXPECT_THROW(narrow.unpack(wide_datagram.data(), wide_datagram.size()), std::runtime_error);
+  EXPECT_THROW(matrix.unpack(wide_datagram.data(), wide_datagram.size()), std::runtime_error);
+  auto narrow_datagram = make_matrix_message(true, 16);
+  EXPECT_EQ(narrow.unpack(narrow_datagram.data(), narrow_datagram.size()).n_channels, 3);
+  std::vector<int32_t> wide_samples(4 * 512);
+  BroadbandSampleMatrix<int32_t> wide{
+    .samples = wide_samples.data(), .max_channels = 4, .max_samples = 512, .channel_ids = channel_ids.data()
+  };
+  EXPECT_EQ(wide.unpack(wide_datagram.data(), wide_datagram.size()).bit_width, 24);
+
+  datagram[NDTPHeader::NDTP_HEADER_SIZE + 100] ^= 1;
+  EXPECT_THROW(matrix.unpack(datagram.data(), datagram.size()), std::runtime_error);
+  EXPECT_NO_THROW(matrix.unpack(datagram.data(), datagram.size(), true));
+
+  NDTPMessage spiketrain{
+    .header = NDTPHeader{.data_type = synapse::DataType::kSpiketrain, .timestamp = 1, .seq_number = 1},
+    .payload = NDTPPayloadSpiketrain{.bin_size_ms = 1, .spike_counts = {1, 2}}
+  };
+  auto spiketrain_datagram = spiketrain.pack();
+  EXPECT_THROW(matrix.unpack(spiketrain_datagram.data(), spiketrain_datagram.size()), std::runtime_error);
+
+  // delta broadband is valid, but only decoded by ElectricalBroadbandData
+  auto message = NDTPMessage::unpack(make_matrix_message(false, 16));
+  const auto& plain = std::get<NDTPPayloadBroadband>(message.payload);
+  message.header.data_type |= NDTP_DATA_TYPE_COMPRESSED;
+  message.payload = NDTPPayloadBroadbandDelta{
+    .is_signed = plain.is_signed, .bit_width = plain.bit_width, .sample_rate = plain.sample_rate, .channels = plain.channels
+  };
+  auto delta_datagram = message.pack();
+  try {
+    matrix.unpack(delta_datagram.data(), delta_datagram.size());
+    FAIL() << "delta broadband was decoded";
+  } catch (const std::runtime_error& e) {
+    EXPECT_NE(std::string(e.what()).find("compressed broadband is not supported"), std::string::npos);
+  }
+}
+
+}  // namespace science::libndtp
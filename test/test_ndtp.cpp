@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
 #include <science/libndtp/ndtp.h>
 #include <science/libndtp/types.h>
 
@@ -347,4 +349,348 @@ TEST(NDTPTest, NDTPMessageSpiketrainPackUnpack) {
   ) << "payload is not equal to unpacked.payload";
 }
 
+TEST(NDTPTest, NDTPMessageUnpackFromRawBuffer) {
+  auto as_unsigned = [](std::vector<int64_t> values) {
+    return std::vector<uint64_t>(values.begin(), values.end());
+  };
+  NDTPHeader header {
+    .data_type = synapse::DataType::kBroadband,
+    .timestamp = 1234567890,
+    .seq_number = 7
+  };
+  NDTPPayloadBroadband payload {
+    .is_signed = true,
+    .bit_width = 12,
+    .sample_rate = 30000,
+    .channels = {
+      NDTPPayloadBroadband::ChannelData {
+        .channel_id = 3,
+        .channel_data = as_unsigned({-5, 0, 2047, -2048})
+      },
+      NDTPPayloadBroadband::ChannelData {
+        .channel_id = 9,
+        .channel_data = as_unsigned({1, -1})
+      }
+    }
+  };
+  NDTPMessage message {
+    .header = header,
+    .payload = payload
+  };
+  auto packed = message.pack();
+
+  // place the datagram in the middle of a larger receive buffer
+  ByteArray receive_buffer(packed.size() + 64, 0xAA);
+  std::copy(packed.begin(), packed.end(), receive_buffer.begin() + 32);
+
+  auto unpacked = NDTPMessage::unpack(receive_buffer.data() + 32, packed.size());
+  EXPECT_EQ(unpacked.header, header);
+  EXPECT_EQ(std::get<NDTPPayloadBroadband>(unpacked.payload), payload);
+  EXPECT_EQ(unpacked._crc16, message._crc16);
+
+  auto unpacked_header = NDTPHeader::unpack(receive_buffer.data() + 32, NDTPHeader::NDTP_HEADER_SIZE);
+  EXPECT_EQ(unpacked_header, header);
+
+  // corrupt a payload byte in place
+  receive_buffer[32 + NDTPHeader::NDTP_HEADER_SIZE + 8] ^= 0xFF;
+  EXPECT_THROW(NDTPMessage::unpack(receive_buffer.data() + 32, packed.size()), std::runtime_error);
+  EXPECT_NO_THROW(NDTPMessage::unpack(receive_buffer.data() + 32, packed.size(), true));
+}
+
+TEST(NDTPTest, NDTPMessagePackIntoCallerBuffer) {
+  NDTPMessage broadband {
+    .header = NDTPHeader{.data_type = synapse::DataType::kBroadband, .timestamp = 1234567890, .seq_number = 7},
+    .payload = NDTPPayloadBroadband{
+      .is_signed = false,
+      .bit_width = 12,
+      .sample_rate = 30000,
+      .channels = {
+        NDTPPayloadBroadband::ChannelData{.channel_id = 1, .channel_data = std::vector<uint64_t>(100, 0x5A5)},
+        NDTPPayloadBroadband::ChannelData{.channel_id = 2, .channel_data = {1, 2, 3}},
+        NDTPPayloadBroadband::ChannelData{.channel_id = 3, .channel_data = {}}
+      }
+    }
+  };
+  NDTPMessage spiketrain {
+    .header = NDTPHeader{.data_type = synapse::DataType::kSpiketrain, .timestamp = 42, .seq_number = 8},
+    .payload = NDTPPayloadSpiketrain{.bin_size_ms = 1, .spike_counts = {1, 2, 3, 0, 20}}
+  };
+
+  for (auto* message : {&broadband, &spiketrain}) {
+    auto packed = message->pack();
+    EXPECT_EQ(message->encoded_size(), packed.size());
+
+    // the message is written at an offset into a larger buffer, leaving the bytes after it untouched
+    ByteArray buffer(packed.size() + 40, 0xEE);
+    size_t written = message->pack_into(buffer.data() + 8, packed.size());
+    EXPECT_EQ(written, packed.size());
+    EXPECT_EQ(ByteArray(buffer.begin() + 8, buffer.begin() + 8 + written), packed);
+    EXPECT_EQ(ByteArray(buffer.begin() + 8 + written, buffer.end()), ByteArray(32, 0xEE));
+
+    EXPECT_THROW(message->pack_into(buffer.data(), packed.size() - 1), std::runtime_error);
+  }
+}
+
+TEST(NDTPTest, NDTPPayloadSpiketrainSparsePackUnpack) {
+  std::vector<uint8_t> spike_counts(1000);
+  spike_counts[0] = 1;
+  spike_counts[17] = 3;
+  spike_counts[500] = 20;  // clamped to 15, as in the dense encoding
+  spike_counts[999] = 2;
+  NDTPPayloadSpiketrainSparse payload{.bin_size_ms = 1, .spike_counts = spike_counts};
+
+  // 4 entries of a 10-bit index and a 4-bit count
+  EXPECT_EQ(NDTPPayloadSpiketrainSparse::index_bits(1000), 10);
+  EXPECT_EQ(payload.encoded_size(), 9 + 7);
+  NDTPPayloadSpiketrain dense{.bin_size_ms = 1, .spike_counts = spike_counts};
+  EXPECT_LT(payload.encoded_size(), dense.encoded_size());
+
+  NDTPMessage message{
+    .header = NDTPHeader{.data_type = synapse::DataType::kSpiketrain | NDTP_DATA_TYPE_COMPRESSED, .timestamp = 5, .seq_number = 6},
+    .payload = payload
+  };
+  auto unpacked = NDTPMessage::unpack(message.pack());
+  ASSERT_TRUE(std::holds_alternative<NDTPPayloadSpiketrainSparse>(unpacked.payload));
+  spike_counts[500] = 15;
+  EXPECT_EQ(std::get<NDTPPayloadSpiketrainSparse>(unpacked.payload).spike_counts, spike_counts);
+  EXPECT_EQ(std::get<NDTPPayloadSpiketrainSparse>(unpacked.payload).bin_size_ms, 1);
+
+  for (size_t n_bins : {0, 1, 2, 3}) {
+    NDTPPayloadSpiketrainSparse small{.bin_size_ms = 2, .spike_counts = std::vector<uint8_t>(n_bins, 1)};
+    EXPECT_EQ(NDTPPayloadSpiketrainSparse::unpack(small.pack()), small) << n_bins << " bins";
+  }
+
+  // an index past the last bin, or entries missing from the end
+  auto packed = NDTPPayloadSpiketrainSparse{.bin_size_ms = 1, .spike_counts = {0, 0, 0, 1}}.pack();
+  ASSERT_EQ(packed.size(), 10);
+  EXPECT_EQ(packed[9], 0xC4);  // 2-bit index 3 and 4-bit count 1, MSB first
+  packed[3] = 3;
+  EXPECT_THROW(NDTPPayloadSpiketrainSparse::unpack(packed), std::runtime_error);
+  EXPECT_THROW(NDTPPayloadSpiketrainSparse::unpack(packed.data(), 9), std::runtime_error);
+
+  message.header.data_type = synapse::DataType::kSpiketrain;
+  EXPECT_THROW(message.pack(), std::invalid_argument);
+
+  // a 9 byte payload claiming 4 billion empty bins is rejected before anything is allocated
+  ByteArray hostile{0xFF, 0xFF, 0xFF, 0xFF, 1, 0, 0, 0, 0};
+  EXPECT_THROW(NDTPPayloadSpiketrainSparse::unpack(hostile), std::runtime_error);
+  hostile[0] = 0;
+  hostile[1] = 0x10;
+  hostile[2] = 0;
+  hostile[3] = 0;
+  EXPECT_EQ(NDTPPayloadSpiketrainSparse::unpack(hostile).spike_counts.size(), NDTPPayloadSpiketrainSparse::MAX_BINS);
+  hostile[3] = 1;
+  EXPECT_THROW(NDTPPayloadSpiketrainSparse::unpack(hostile), std::runtime_error);
+  NDTPPayloadSpiketrainSparse too_many{.bin_size_ms = 1, .spike_counts = std::vector<uint8_t>(NDTPPayloadSpiketrainSparse::MAX_BINS + 1)};
+  EXPECT_THROW(too_many.pack(), std::invalid_argument);
+
+  ByteArray datagram = NDTPHeader{
+    .data_type = synapse::DataType::kSpiketrain | NDTP_DATA_TYPE_COMPRESSED, .timestamp = 1, .seq_number = 1
+  }.pack();
+  datagram.insert(datagram.end(), {0xFF, 0xFF, 0xFF, 0xFF, 1, 0, 0, 0, 0});
+  auto crc = crc16(datagram.data(), datagram.size());
+  datagram.push_back(crc >> 8);
+  datagram.push_back(crc & 0xFF);
+  EXPECT_THROW(NDTPMessage::unpack(datagram), std::runtime_error);
+  ByteSpan span{datagram.data(), datagram.size()};
+  NDTPUnpackStatus status;
+  EXPECT_EQ(NDTPMessage::unpack_batch(&span, 1, &message, &status), 0);
+  EXPECT_EQ(status, NDTPUnpackStatus::kMalformedPayload);
+}
+
+TEST(NDTPTest, NDTPMessageBroadbandDeltaPackUnpack) {
+  for (uint8_t bit_width : {1, 12, 16, 33, 64}) {
+    for (bool is_signed : {false, true}) {
+      uint64_t mask = bit_width == 64 ? ~0ULL : (1ULL << bit_width) - 1;
+      NDTPPayloadBroadbandDelta payload{.is_signed = is_signed, .bit_width = bit_width, .sample_rate = 30000};
+      // a slow ramp, a constant run, a signal jumping across the whole range and short channels
+      std::vector<uint64_t> ramp(1000), constant(100, 5 & mask), jumps(70);
+      for (size_t i = 0; i < ramp.size(); i++) {
+        ramp[i] = static_cast<uint64_t>(static_cast<int64_t>(i / 3) - 100) & mask;
+      }
+      for (size_t i = 0; i < jumps.size(); i++) {
+        jumps[i] = (i % 2 ? 0 : ~0ULL) & mask;
+      }
+      for (auto& samples : {ramp, constant, jumps, std::vector<uint64_t>{}, std::vector<uint64_t>{1}}) {
+        auto decoded = samples;
+        if (is_signed && bit_width < 64) {
+          // the decoder sign extends, as NDTPPayloadBroadband does
+          for (auto& sample : decoded) {
+            sample = static_cast<uint64_t>(sign_extend(sample, bit_width));
+          }
+        }
+        payload.channels.push_back({.channel_id = static_cast<uint32_t>(payload.channels.size()), .channel_data = decoded});
+      }
+
+      NDTPMessage message{
+        .header = NDTPHeader{
+          .data_type = synapse::DataType::kBroadband | NDTP_DATA_TYPE_COMPRESSED, .timestamp = 99, .seq_number = 3
+        },
+        .payload = payload
+      };
+      auto packed = message.pack();
+      EXPECT_EQ(packed.size(), message.encoded_size());
+      auto unpacked = NDTPMessage::unpack(packed);
+      ASSERT_TRUE(std::holds_alternative<NDTPPayloadBroadbandDelta>(unpacked.payload));
+      EXPECT_EQ(std::get<NDTPPayloadBroadbandDelta>(unpacked.payload), payload)
+          << "bit width " << static_cast<int>(bit_width) << (is_signed ? " signed" : " unsigned");
+      EXPECT_EQ(ElectricalBroadbandData::unpack(unpacked).channels[0].channel_data, payload.channels[0].channel_data);
+    }
+  }
+}
+
+TEST(NDTPTest, NDTPPayloadBroadbandDeltaCompressesSlowSignals) {
+  NDTPPayloadBroadband plain{.is_signed = true, .bit_width = 16, .sample_rate = 30000};
+  for (uint32_t c = 0; c < 8; c++) {
+    std::vector<uint64_t> samples(200);
+    for (size_t i = 0; i < samples.size(); i++) {
+      samples[i] = static_cast<uint64_t>(static_cast<int64_t>(1000 * std::sin((i + c * 10) * 0.05) + (i * 7919 % 13)));
+    }
+    plain.channels.push_back({.channel_id = c, .channel_data = samples});
+  }
+  NDTPPayloadBroadbandDelta delta{
+    .is_signed = plain.is_signed, .bit_width = plain.bit_width, .sample_rate = plain.sample_rate, .channels = plain.channels
+  };
+  EXPECT_LT(delta.encoded_size(), plain.encoded_size() * 6 / 10);
+  auto packed = delta.pack();
+  EXPECT_EQ(NDTPPayloadBroadbandDelta::unpack(packed), delta);
+
+  // a buffer large enough for uncompressed blocks skips sizing the payload up front
+  ByteArray buffer(plain.encoded_size() * 2, 0xEE);
+  ASSERT_EQ(delta.pack_into(buffer.data(), buffer.size()), packed.size());
+  EXPECT_EQ(ByteArray(buffer.begin(), buffer.begin() + packed.size()), packed);
+  // and leaves the rest of the buffer alone
+  EXPECT_EQ(static_cast<size_t>(std::count(buffer.begin() + packed.size(), buffer.end(), 0xEE)), buffer.size() - packed.size());
+  EXPECT_THROW(delta.pack_into(buffer.data(), packed.size() - 1), std::runtime_error);
+
+  // a block wider than the samples is malformed
+  auto bytes = NDTPPayloadBroadbandDelta{
+    .is_signed = false, .bit_width = 4, .sample_rate = 1, .channels = {{.channel_id = 1, .channel_data = {1, 2}}}
+  }.pack();
+  // after the 7 fixed bytes: 3 byte id, 2 byte count, 1 byte first sample, then the block width
+  ASSERT_EQ(bytes.size(), 15);
+  EXPECT_EQ(bytes[13], 2);  // the difference 1 has zigzag code 2
+  bytes[13] = 5;
+  EXPECT_THROW(NDTPPayloadBroadbandDelta::unpack(bytes), std::runtime_error);
+  bytes[13] = 2;
+  EXPECT_THROW(NDTPPayloadBroadbandDelta::unpack(bytes.data(), bytes.size() - 1), std::runtime_error);
+
+  // the header has to announce the compressed encoding
+  NDTPMessage message{.header = NDTPHeader{.data_type = synapse::DataType::kBroadband}, .payload = delta};
+  EXPECT_THROW(message.pack(), std::invalid_argument);
+}
+
+TEST(NDTPTest, NDTPMessageUnpackBatchReportsEachDatagram) {
+  std::vector<ByteArray> datagrams;
+  for (uint16_t seq = 0; seq < 20; seq++) {
+    NDTPMessage message{.header = NDTPHeader{.data_type = synapse::DataType::kSpiketrain, .timestamp = seq, .seq_number = seq}};
+    message.payload = NDTPPayloadSpiketrain{.bin_size_ms = 1, .spike_counts = std::vector<uint8_t>(seq, seq % 16)};
+    datagrams.push_back(message.pack());
+  }
+  datagrams[3].resize(10);
+  datagrams[9][NDTPHeader::NDTP_HEADER_SIZE + 4] ^= 1;
+  datagrams[10][0] = 2;
+  datagrams[11][1] = 0x42;
+  // a spike count longer than the payload, behind a valid CRC
+  datagrams[17][NDTPHeader::NDTP_HEADER_SIZE] = 0x10;
+  auto crc = crc16(datagrams[17].data(), datagrams[17].size() - 2);
+  datagrams[17][datagrams[17].size() - 2] = crc >> 8;
+  datagrams[17][datagrams[17].size() - 1] = crc & 0xFF;
+
+  std::vector<ByteSpan> spans;
+  for (const auto& datagram : datagrams) {
+    spans.push_back(ByteSpan{datagram.data(), datagram.size()});
+  }
+  std::vector<NDTPMessage> messages(spans.size());
+  std::vector<NDTPUnpackStatus> statuses(spans.size());
+  EXPECT_EQ(NDTPMessage::unpack_batch(spans.data(), spans.size(), messages.data(), statuses.data()), 15);
+
+  EXPECT_EQ(statuses[3], NDTPUnpackStatus::kTooShort);
+  EXPECT_EQ(statuses[9], NDTPUnpackStatus::kCrcMismatch);
+  EXPECT_EQ(statuses[10], NDTPUnpackStatus::kUnsupportedHeader);
+  EXPECT_EQ(statuses[11], NDTPUnpackStatus::kUnsupportedHeader);
+  EXPECT_EQ(statuses[17], NDTPUnpackStatus::kMalformedPayload);
+  for (size_t i : {0, 1, 2, 4, 5, 6, 7, 8, 12, 13, 14, 15, 16, 18, 19}) {
+    ASSERT_EQ(statuses[i], NDTPUnpackStatus::kOk) << "datagram " << i;
+    EXPECT_EQ(messages[i].header.seq_number, i);
+    EXPECT_EQ(std::get<NDTPPayloadSpiketrain>(messages[i].payload).spike_counts.size(), i);
+  }
+
+  // skipping the CRC check lets the corrupted datagram through
+  EXPECT_EQ(NDTPMessage::unpack_batch(spans.data() + 9, 1, messages.data(), statuses.data(), true), 1);
+  EXPECT_EQ(statuses[0], NDTPUnpackStatus::kOk);
+  EXPECT_EQ(NDTPMessage::unpack_batch(spans.data(), 0, messages.data(), statuses.data()), 0);
+}
+
+TEST(NDTPTest, NDTPMessageUnpackIntoReusesCapacity) {
+  auto make_broadband = [](uint8_t data_type, uint64_t offset) {
+    NDTPPayloadBroadband payload{.is_signed = true, .bit_width = 12, .sample_rate = 30000};
+    for (uint32_t c = 0; c < 3; c++) {
+      std::vector<uint64_t> samples(40 - c * 10);
+      for (size_t i = 0; i < samples.size(); i++) {
+        samples[i] = static_cast<uint64_t>(static_cast<int64_t>((i * 13 + c + offset) % 2000) - 1000);
+      }
+      payload.channels.push_back({.channel_id = c, .channel_data = samples});
+    }
+    NDTPMessage message{.header = NDTPHeader{.data_type = data_type, .timestamp = offset, .seq_number = 1}};
+    if (data_type & NDTP_DATA_TYPE_COMPRESSED) {
+      message.payload = NDTPPayloadBroadbandDelta{
+        .is_signed = true, .bit_width = 12, .sample_rate = 30000, .channels = payload.channels
+      };
+    } else {
+      message.payload = payload;
+    }
+    return message.pack();
+  };
+
+  // where the channel list and the first channel's samples live
+  auto storage = [](const NDTPMessage& message) -> std::pair<const void*, const void*> {
+    if (const auto* plain = std::get_if<NDTPPayloadBroadband>(&message.payload)) {
+      return {plain->channels.data(), plain->channels[0].channel_data.data()};
+    }
+    const auto& delta = std::get<NDTPPayloadBroadbandDelta>(message.payload);
+    return {delta.channels.data(), delta.channels[0].channel_data.data()};
+  };
+
+  for (bool compressed : {false, true}) {
+    uint8_t data_type = synapse::DataType::kBroadband | (compressed ? NDTP_DATA_TYPE_COMPRESSED : 0);
+    auto first = make_broadband(data_type, 0);
+    auto second = make_broadband(data_type, 500);
+    NDTPMessage message;
+    NDTPMessage::unpack_into(first.data(), first.size(), message);
+    EXPECT_EQ(message.payload, NDTPMessage::unpack(first).payload);
+
+    // a packet of the same shape decodes into the same storage
+    auto before = storage(message);
+    NDTPMessage::unpack_into(second.data(), second.size(), message);
+    EXPECT_EQ(message.header.timestamp, 500);
+    EXPECT_EQ(message.payload, NDTPMessage::unpack(second).payload);
+    EXPECT_EQ(storage(message), before);
+  }
+
+  // a new data type switches the payload alternative
+  NDTPMessage message;
+  auto broadband = make_broadband(synapse::DataType::kBroadband, 0);
+  NDTPMessage::unpack_into(broadband.data(), broadband.size(), message);
+  for (bool sparse : {false, true, false}) {
+    NDTPMessage spiketrain{.header = NDTPHeader{.data_type = synapse::DataType::kSpiketrain}};
+    std::vector<uint8_t> counts(64);
+    counts[sparse ? 5 : 0] = 3;
+    if (sparse) {
+      spiketrain.header.data_type |= NDTP_DATA_TYPE_COMPRESSED;
+      spiketrain.payload = NDTPPayloadSpiketrainSparse{.bin_size_ms = 2, .spike_counts = counts};
+    } else {
+      std::fill(counts.begin(), counts.end(), 1);
+      spiketrain.payload = NDTPPayloadSpiketrain{.bin_size_ms = 1, .spike_counts = counts};
+    }
+    auto packed = spiketrain.pack();
+    NDTPMessage::unpack_into(packed.data(), packed.size(), message);
+    EXPECT_EQ(message.header.data_type, spiketrain.header.data_type);
+    EXPECT_EQ(message.payload, spiketrain.payload);
+  }
+
+  broadband[NDTPHeader::NDTP_HEADER_SIZE] ^= 1;
+  EXPECT_THROW(NDTPMessage::unpack_into(broadband.data(), broadband.size(), message), std::runtime_error);
+}
+
 }  // namespace science::libndtp
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include <science/libndtp/packet_batch.h>
+#include <science/libndtp/types.h>
+
+namespace science::libndtp {
+
+TEST(PacketBatchTest, PacketsAreLaidOutBackToBack) {
+  PacketBatch batch;
+  NDTPMessage message{
+    .header = NDTPHeader{.data_type = synapse::DataType::kSpiketrain, .timestamp = 1, .seq_number = 0},
+    .payload = NDTPPayloadSpiketrain{.bin_size_ms = 1, .spike_counts = {1, 2, 3}}
+  };
+  std::vector<ByteArray> expected;
+  for (uint16_t seq = 0; seq < 3; seq++) {
+    message.header.seq_number = seq;
+    std::get<NDTPPayloadSpiketrain>(message.payload).spike_counts.push_back(seq);
+    expected.push_back(message.pack());
+    EXPECT_EQ(batch.append(message), expected.back().size());
+  }
+  ByteArray raw = {0x01, 0x02, 0x03};
+  batch.append(raw.data(), raw.size());
+  expected.push_back(raw);
+
+  ASSERT_EQ(batch.size(), 4);
+  ByteArray concatenated;
+  for (size_t i = 0; i < batch.size(); i++) {
+    EXPECT_EQ(ByteArray(batch[i].begin(), batch[i].end()), expected[i]) << "packet " << i;
+    EXPECT_EQ(batch[i].data, batch.data() + batch.offsets()[i]);
+    concatenated.insert(concatenated.end(), expected[i].begin(), expected[i].end());
+  }
+  EXPECT_EQ(ByteArray(batch.data(), batch.data() + batch.bytes()), concatenated);
+  EXPECT_THROW(batch.at(4), std::out_of_range);
+
+#ifdef __linux__
+  iovec iov[8];
+  ASSERT_EQ(batch.to_iovecs(iov, 8, 1), 3);
+  EXPECT_EQ(iov[0].iov_base, batch[1].data);
+  EXPECT_EQ(iov[2].iov_len, raw.size());
+#endif
+
+  // a cleared batch reuses its slab
+  const uint8_t* slab = batch.data();
+  batch.clear();
+  EXPECT_TRUE(batch.empty());
+  message.header.seq_number = 9;
+  batch.append(message);
+  EXPECT_EQ(batch.data(), slab);
+  EXPECT_EQ(ByteArray(batch[0].begin(), batch[0].end()), message.pack());
+}
+
+TEST(PacketBatchTest, ElectricalBroadbandDataPacksIntoBatch) {
+  ElectricalBroadbandData data{
+    .is_signed = false,
+    .bit_width = 16,
+    .sample_rate = 30000,
+    .t0 = 1234,
+    .channels = {
+      {.channel_id = 1, .channel_data = std::vector<uint64_t>(3000, 7)},
+      {.channel_id = 2, .channel_data = {1, 2, 3}},
+      {.channel_id = 3, .channel_data = {}}
+    }
+  };
+
+  PacketBatch batch;
+  size_t n_packets = data.pack(100, batch);
+  auto packets = data.pack(100);
+  ASSERT_EQ(n_packets, packets.size());
+  ASSERT_EQ(batch.size(), packets.size());
+
+  // each packet carries its own chunk, and the chunks add back up to the channel
+  std::vector<std::vector<uint64_t>> samples(4);
+  for (size_t i = 0; i < batch.size(); i++) {
+    EXPECT_EQ(ByteArray(batch[i].begin(), batch[i].end()), packets[i]) << "packet " << i;
+    auto message = NDTPMessage::unpack(batch[i].data, batch[i].size);
+    EXPECT_EQ(message.header.seq_number, 100 + i);
+    for (const auto& channel : std::get<NDTPPayloadBroadband>(message.payload).channels) {
+      samples[channel.channel_id].insert(
+        samples[channel.channel_id].end(), channel.channel_data.begin(), channel.channel_data.end()
+      );
+    }
+  }
+  for (const auto& channel : data.channels) {
+    EXPECT_EQ(samples[channel.channel_id], channel.channel_data) << "channel " << channel.channel_id;
+  }
+}
+
+}  // namespace science::libndtp
@@ -0,0 +1,211 @@
+#include <gtest/gtest.h>
+#include <science/libndtp/pipeline.h>
+#include <science/libndtp/spsc_ring.h>
+#include "test_helpers.h"
+
+#include <condition_variable>
+#include <numeric>
+
+namespace science::libndtp {
+
+static ByteArray make_pipeline_datagram(uint8_t data_type, uint16_t seq_number) {
+  return make_test_datagram(data_type, seq_number, seq_number, seq_number % 40);
+}
+
+TEST(PipelineTest, SpscRingPassesElementsInOrder) {
+  SpscRing<int> ring(3);
+  EXPECT_EQ(ring.capacity(), 4);
+  EXPECT_EQ(ring.front(), nullptr);
+
+  std::thread producer([&] {
+    for (int i = 0; i < 100000; i++) {
+      int* slot;
+      while (!(slot = ring.claim())) {
+        std::this_thread::yield();
+      }
+      *slot = i;
+      ring.publish();
+    }
+  });
+  for (int i = 0; i < 100000; i++) {
+    int* value;
+    while (!(value = ring.front())) {
+      std::this_thread::yield();
+    }
+    ASSERT_EQ(*value, i);
+    ring.pop();
+  }
+  producer.join();
+  EXPECT_EQ(ring.size(), 0);
+}
+
+TEST(PipelineTest, DeliversEachStreamInSequenceOrder) {
+  std::vector<uint16_t> broadband_seqs;
+  std::vector<uint16_t> spiketrain_seqs;
+  NDTPDecodePipeline pipeline(
+    [&](NDTPMessage&& message) {
+      auto& seqs = message.header.data_type == synapse::DataType::kBroadband ? broadband_seqs : spiketrain_seqs;
+      seqs.push_back(message.header.seq_number);
+      size_t n_values = std::holds_alternative<NDTPPayloadBroadband>(message.payload)
+                          ? std::get<NDTPPayloadBroadband>(message.payload).channels[0].channel_data.size()
+                          : std::get<NDTPPayloadSpiketrain>(message.payload).spike_counts.size();
+      EXPECT_EQ(n_values, message.header.seq_number % 40);
+    },
+    NDTPPipelineOptions{.n_workers = 4, .queue_capacity = 16, .reorder_window = 8}
+  );
+  EXPECT_EQ(pipeline.n_workers(), 4);
+
+  // two interleaved streams with swapped neighbours (after the first pair, which sets the start), sequence numbers
+  // wrapping around, and one corrupted datagram
+  for (uint32_t i = 0; i < 2000; i++) {
+    auto seq_number = static_cast<uint16_t>(65000 + (i < 2 ? i : i ^ 1));
+    auto datagram = make_pipeline_datagram(synapse::DataType::kBroadband, seq_number);
+    if (i == 1000) {
+      datagram[NDTPHeader::NDTP_HEADER_SIZE] ^= 0xFF;
+    }
+    pipeline.submit(datagram.data(), datagram.size());
+    datagram = make_pipeline_datagram(synapse::DataType::kSpiketrain, seq_number);
+    pipeline.submit(datagram.data(), datagram.size());
+  }
+  pipeline.stop();
+
+  ASSERT_EQ(spiketrain_seqs.size(), 2000);
+  ASSERT_EQ(broadband_seqs.size(), 1999);
+  for (uint32_t i = 0; i < 2000; i++) {
+    EXPECT_EQ(spiketrain_seqs[i], static_cast<uint16_t>(65000 + i));
+  }
+  EXPECT_EQ(broadband_seqs[1000], static_cast<uint16_t>(66000));
+  EXPECT_EQ(broadband_seqs[1001], static_cast<uint16_t>(66002));
+
+  auto stats = pipeline.stats();
+  EXPECT_EQ(stats.received, 4000);
+  EXPECT_EQ(stats.queued, 4000);
+  EXPECT_EQ(stats.dropped, 0);
+  EXPECT_EQ(stats.invalid, 1);
+  EXPECT_EQ(stats.delivered, 3999);
+  for (size_t i = 0; i < pipeline.n_workers(); i++) {
+    EXPECT_EQ(pipeline.queue_depth(i), 0);
+    EXPECT_GT(pipeline.max_queue_depth(i), 0);
+    EXPECT_LE(pipeline.max_queue_depth(i), 16);
+  }
+  EXPECT_THROW(pipeline.submit(nullptr, 0), std::runtime_error);
+}
+
+TEST(PipelineTest, KeepsOneSequenceAcrossEncodingsOfAStream) {
+  std::vector<uint16_t> broadband_seqs;
+  std::vector<uint16_t> spiketrain_seqs;
+  NDTPDecodePipeline pipeline(
+    [&](NDTPMessage&& message) {
+      auto data_type = stream_data_type(message.header.data_type);
+      auto& seqs = data_type == synapse::DataType::kBroadband ? broadband_seqs : spiketrain_seqs;
+      seqs.push_back(message.header.seq_number);
+    },
+    NDTPPipelineOptions{.n_workers = 2, .reorder_window = 4}
+  );
+
+  // each stream alternates between its plain and compressed encoding
+  for (uint16_t seq = 0; seq < 12; seq++) {
+    bool compressed = seq % 2;
+    NDTPMessage broadband{
+      .header = NDTPHeader{
+        .data_type = static_cast<uint8_t>(synapse::DataType::kBroadband | (compressed ? NDTP_DATA_TYPE_COMPRESSED : 0)),
+        .timestamp = seq,
+        .seq_number = seq
+      }
+    };
+    std::vector<NDTPPayloadBroadband::ChannelData> channels{{.channel_id = 1, .channel_data = {seq, seq, seq}}};
+    if (compressed) {
+      broadband.payload = NDTPPayloadBroadbandDelta{.is_signed = false, .bit_width = 12, .sample_rate = 30000, .channels = channels};
+    } else {
+      broadband.payload = NDTPPayloadBroadband{.is_signed = false, .bit_width = 12, .sample_rate = 30000, .channels = channels};
+    }
+    auto datagram = broadband.pack();
+    pipeline.submit(datagram.data(), datagram.size());
+
+    NDTPMessage spiketrain{
+      .header = NDTPHeader{
+        .data_type = static_cast<uint8_t>(synapse::DataType::kSpiketrain | (compressed ? NDTP_DATA_TYPE_COMPRESSED : 0)),
+        .timestamp = seq,
+        .seq_number = seq
+      }
+    };
+    std::vector<uint8_t> spike_counts(64, 0);
+    spike_counts[seq] = 1;
+    if (compressed) {
+      spiketrain.payload = NDTPPayloadSpiketrainSparse{.bin_size_ms = 1, .spike_counts = spike_counts};
+    } else {
+      spiketrain.payload = NDTPPayloadSpiketrain{.bin_size_ms = 1, .spike_counts = spike_counts};
+    }
+    datagram = spiketrain.pack();
+    pipeline.submit(datagram.data(), datagram.size());
+  }
+  pipeline.stop();
+
+  std::vector<uint16_t> expected(12);
+  std::iota(expected.begin(), expected.end(), 0);
+  EXPECT_EQ(broadband_seqs, expected);
+  EXPECT_EQ(spiketrain_seqs, expected);
+  EXPECT_EQ(pipeline.stats().delivered, 24);
+}
+
+TEST(PipelineTest, DropsOrBlocksWhenQueuesAreFull) {
+  // the consumer stalls on the first message until everything has been submitted
+  std::mutex mutex;
+  std::condition_variable submitted_cv;
+  bool submitted = false;
+  auto stalling_consumer = [&](NDTPMessage&&) {
+    std::unique_lock<std::mutex> lock(mutex);
+    submitted_cv.wait(lock, [&] { return submitted; });
+  };
+  auto submit_all = [&](NDTPDecodePipeline& pipeline) {
+    for (uint16_t seq = 0; seq < 200; seq++) {
+      auto datagram = make_pipeline_datagram(synapse::DataType::kSpiketrain, seq);
+      pipeline.submit(datagram.data(), datagram.size());
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    submitted = true;
+    submitted_cv.notify_all();
+  };
+
+  NDTPDecodePipeline dropping(
+    stalling_consumer, NDTPPipelineOptions{.queue_capacity = 4, .overflow = NDTPPipelineOptions::Overflow::kDrop}
+  );
+  submit_all(dropping);
+  dropping.stop();
+  auto stats = dropping.stats();
+  EXPECT_GT(stats.dropped, 0);
+  EXPECT_EQ(stats.queued + stats.dropped, 200);
+  EXPECT_EQ(stats.delivered, stats.queued);
+  EXPECT_EQ(dropping.max_queue_depth(0), 4);
+
+  // with backpressure the producer waits for the workers instead
+  size_t n_delivered = 0;
+  NDTPDecodePipeline blocking([&](NDTPMessage&&) { n_delivered++; }, NDTPPipelineOptions{.queue_capacity = 4});
+  submit_all(blocking);
+  blocking.stop();
+  EXPECT_EQ(n_delivered, 200);
+  EXPECT_EQ(blocking.stats().dropped, 0);
+  EXPECT_LE(blocking.max_queue_depth(0), 4);
+}
+
+TEST(PipelineTest, PinsThreadsAndReportsConsumerErrors) {
+#ifdef __linux__
+  NDTPDecodePipeline pipeline(
+    [](NDTPMessage&& message) {
+      if (message.header.seq_number == 3) {
+        throw std::runtime_error("consumer failed");
+      }
+    },
+    NDTPPipelineOptions{.n_workers = 2, .worker_cores = {0}, .sequencer_core = 0}
+  );
+  for (uint16_t seq = 0; seq < 10; seq++) {
+    auto datagram = make_pipeline_datagram(synapse::DataType::kSpiketrain, seq);
+    pipeline.submit(datagram.data(), datagram.size());
+  }
+  EXPECT_THROW(pipeline.stop(), std::runtime_error);
+  EXPECT_EQ(pipeline.stats().delivered, 10);
+#endif
+  EXPECT_THROW(NDTPDecodePipeline([](NDTPMessage&&) {}, NDTPPipelineOptions{.n_workers = 0}), std::invalid_argument);
+}
+
+}  // namespace science::libndtp
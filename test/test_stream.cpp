@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include <science/libndtp/stream.h>
+#include "test_helpers.h"
+
+namespace science::libndtp {
+
+static ByteArray make_datagram(uint16_t seq_number) {
+  return make_test_datagram(synapse::DataType::kSpiketrain, seq_number, seq_number, 1);
+}
+
+// Pushes datagrams with the given sequence numbers and returns the extended sequence numbers delivered.
+static std::vector<uint64_t> feed(NDTPStreamDecoder& decoder, const std::vector<uint16_t>& seq_numbers) {
+  std::vector<uint64_t> delivered;
+  auto deliver = [&](const NDTPStreamPacket& packet) {
+    EXPECT_EQ(packet.header.seq_number, static_cast<uint16_t>(packet.seq));
+    EXPECT_EQ(packet.decode().header, packet.header);
+    delivered.push_back(packet.seq);
+  };
+  for (auto seq_number : seq_numbers) {
+    auto datagram = make_datagram(seq_number);
+    decoder.push(datagram.data(), datagram.size(), deliver);
+  }
+  decoder.flush(deliver);
+  return delivered;
+}
+
+TEST(StreamTest, NDTPStreamDecoderExtendsSequenceNumbers) {
+  NDTPStreamDecoder decoder;
+  EXPECT_EQ(
+    feed(decoder, {65533, 65534, 65535, 0, 1, 3}),
+    std::vector<uint64_t>({65533, 65534, 65535, 65536, 65537, 65539})
+  );
+  EXPECT_EQ(decoder.stats().delivered, 6);
+  EXPECT_EQ(decoder.stats().dropped, 1);
+
+  // without a reorder window, late packets and duplicates are discarded
+  EXPECT_EQ(feed(decoder, {2, 3, 5, 4, 6}), std::vector<uint64_t>({65541, 65542}));
+  EXPECT_EQ(decoder.stats().late, 2);
+  EXPECT_EQ(decoder.stats().duplicates, 1);
+  EXPECT_EQ(decoder.stats().reordered, 2);
+  EXPECT_EQ(decoder.stats().dropped, 2);
+  EXPECT_EQ(decoder.next_seq(), 65543);
+}
+
+TEST(StreamTest, NDTPStreamDecoderReordersWithinWindow) {
+  NDTPStreamDecoder decoder(4);
+  EXPECT_EQ(feed(decoder, {10, 12, 13, 11, 12, 14}), std::vector<uint64_t>({10, 11, 12, 13, 14}));
+  EXPECT_EQ(decoder.stats().reordered, 2);
+  EXPECT_EQ(decoder.stats().duplicates, 1);
+  EXPECT_EQ(decoder.stats().dropped, 0);
+
+  // a packet beyond the window gives up on the gap; flushing delivers what is left
+  EXPECT_EQ(feed(decoder, {17, 16, 22, 18, 25}), std::vector<uint64_t>({16, 17, 18, 22, 25}));
+  EXPECT_EQ(decoder.stats().dropped, 1 + 3 + 2);
+  EXPECT_EQ(decoder.stats().late, 0);
+
+  auto corrupt = make_datagram(26);
+  corrupt[NDTPHeader::NDTP_HEADER_SIZE] ^= 0xFF;
+  decoder.push(corrupt.data(), corrupt.size(), [](const NDTPStreamPacket&) { FAIL(); });
+  EXPECT_EQ(decoder.stats().invalid, 1);
+  EXPECT_EQ(decoder.stats().received, 12);
+
+  decoder.reset();
+  EXPECT_EQ(feed(decoder, {3}), std::vector<uint64_t>({3}));
+  EXPECT_EQ(decoder.stats().received, 1);
+}
+
+}  // namespace science::libndtp
@@ -0,0 +1,223 @@
+#include <gtest/gtest.h>
+#include <map>
+#include <science/libndtp/types.h>
+
+namespace science::libndtp {
+
+// Decodes `packets` and checks that together they carry exactly the samples of `data`.
+static void expect_packets_carry(const std::vector<ByteArray>& packets, const ElectricalBroadbandData& data, size_t max_packet_size) {
+  std::map<uint32_t, std::vector<uint64_t>> samples;
+  for (const auto& packet : packets) {
+    EXPECT_LE(packet.size(), max_packet_size);
+    auto message = NDTPMessage::unpack(packet);
+    const auto& payload = std::get<NDTPPayloadBroadband>(message.payload);
+    EXPECT_EQ(payload.bit_width, data.bit_width);
+    for (const auto& channel : payload.channels) {
+      auto& channel_samples = samples[channel.channel_id];
+      // every run in a packet starts at the sample the header timestamp points to
+      EXPECT_EQ(message.header.timestamp, data.t0 + channel_samples.size() * NDTP_TIMESTAMP_TICKS_PER_SECOND / data.sample_rate);
+      channel_samples.insert(channel_samples.end(), channel.channel_data.begin(), channel.channel_data.end());
+    }
+  }
+  for (const auto& channel : data.channels) {
+    EXPECT_EQ(samples[channel.channel_id], channel.channel_data) << "channel " << channel.channel_id;
+  }
+}
+
+TEST(TypesTest, ElectricalBroadbandDataPacksChannelsUpToMaxPacketSize) {
+  ElectricalBroadbandData data{.is_signed = false, .bit_width = 12, .sample_rate = 1000, .t0 = 5000};
+  for (uint32_t c = 0; c < 256; c++) {
+    std::vector<uint64_t> samples(4);
+    for (size_t i = 0; i < samples.size(); i++) {
+      samples[i] = (c * 7 + i) & 0xFFF;
+    }
+    data.channels.push_back({.channel_id = c, .channel_data = samples});
+  }
+
+  // 256 runs of 4 x 12-bit samples take 11 bytes each, so ~125 fit into a 1400 byte packet
+  auto packets = data.pack(0);
+  EXPECT_EQ(packets.size(), 3);
+  expect_packets_carry(packets, data, NDTP_DEFAULT_MAX_PACKET_SIZE);
+
+  for (size_t max_packet_size : {64, 200, 9000}) {
+    expect_packets_carry(data.pack(0, max_packet_size), data, max_packet_size);
+  }
+}
+
+TEST(TypesTest, ElectricalBroadbandDataSplitsLongChannels) {
+  ElectricalBroadbandData data{.is_signed = true, .bit_width = 16, .sample_rate = 30000, .t0 = 0};
+  for (uint32_t c = 0; c < 3; c++) {
+    std::vector<uint64_t> samples(5000 + c * 1000);
+    for (size_t i = 0; i < samples.size(); i++) {
+      samples[i] = static_cast<uint64_t>(-static_cast<int64_t>(i % 1000));
+    }
+    data.channels.push_back({.channel_id = c, .channel_data = samples});
+  }
+  data.channels.push_back({.channel_id = 10, .channel_data = {}});
+
+  auto packets = data.pack(65530);
+  expect_packets_carry(packets, data, NDTP_DEFAULT_MAX_PACKET_SIZE);
+  for (size_t i = 0; i < packets.size(); i++) {
+    EXPECT_EQ(NDTPMessage::unpack(packets[i]).header.seq_number, static_cast<uint16_t>(65530 + i));
+  }
+
+  // a large enough packet still caps each run at 65535 samples
+  data.channels = {{.channel_id = 1, .channel_data = std::vector<uint64_t>(70000, 1)}};
+  packets = data.pack(0, 1 << 20);
+  ASSERT_EQ(packets.size(), 2);
+  expect_packets_carry(packets, data, 1 << 20);
+
+  EXPECT_THROW(data.pack(0, 24), std::invalid_argument);
+}
+
+TEST(TypesTest, ElectricalBroadbandDataPackParallelMatchesSerial) {
+  // enough channels and samples that the packets are split across threads
+  ElectricalBroadbandData data{.is_signed = false, .bit_width = 12, .sample_rate = 30000, .t0 = 123};
+  for (uint32_t c = 0; c < 1000; c++) {
+    std::vector<uint64_t> samples(300 + c % 7);
+    for (size_t i = 0; i < samples.size(); i++) {
+      samples[i] = (c * 31 + i * 7) & 0xFFF;
+    }
+    data.channels.push_back({.channel_id = c, .channel_data = samples});
+  }
+
+  PacketBatch serial;
+  size_t n_packets = data.pack(65000, serial);
+  ASSERT_GT(serial.bytes(), 4 * 64 * 1024);
+  for (size_t n_threads : {0, 1, 3, 4}) {
+    PacketBatch parallel;
+    parallel.append(serial[0].data, serial[0].size);
+    EXPECT_EQ(data.pack_parallel(65000, parallel, n_threads), n_packets);
+    ASSERT_EQ(parallel.size(), n_packets + 1);
+    EXPECT_EQ(ByteArray(parallel.data() + parallel.offsets()[1], parallel.data() + parallel.bytes()),
+              ByteArray(serial.data(), serial.data() + serial.bytes())) << n_threads << " threads";
+  }
+  EXPECT_THROW(data.pack_parallel(0, serial, 4, 24), std::invalid_argument);
+}
+
+TEST(TypesTest, ElectricalBroadbandDataDecodesIntoNarrowTypes) {
+  GenericElectricalBroadbandData<int16_t> narrow{.is_signed = true, .bit_width = 12, .sample_rate = 30000, .t0 = 77};
+  ElectricalBroadbandData wide{.is_signed = true, .bit_width = 12, .sample_rate = 30000, .t0 = 77};
+  for (uint32_t c = 0; c < 4; c++) {
+    std::vector<int16_t> samples(500);
+    for (size_t i = 0; i < samples.size(); i++) {
+      samples[i] = static_cast<int16_t>(static_cast<int>((c * 131 + i * 17) % 4096) - 2048);
+    }
+    narrow.channels.push_back({.channel_id = c, .channel_data = samples});
+    wide.channels.push_back({.channel_id = c, .channel_data = std::vector<uint64_t>(samples.begin(), samples.end())});
+  }
+
+  // narrow samples encode exactly like their sign extended 64-bit form
+  auto packets = narrow.pack(3);
+  EXPECT_EQ(packets, wide.pack(3));
+
+  std::map<uint32_t, std::vector<int16_t>> decoded;
+  for (const auto& packet : packets) {
+    auto data = GenericElectricalBroadbandData<int16_t>::unpack(packet.data(), packet.size());
+    EXPECT_TRUE(data.is_signed);
+    EXPECT_EQ(data.bit_width, 12);
+    auto from_message = GenericElectricalBroadbandData<int16_t>::unpack(NDTPMessage::unpack(packet));
+    for (size_t c = 0; c < data.channels.size(); c++) {
+      EXPECT_EQ(from_message.channels[c].channel_data, data.channels[c].channel_data);
+      auto& samples = decoded[data.channels[c].channel_id];
+      samples.insert(samples.end(), data.channels[c].channel_data.begin(), data.channels[c].channel_data.end());
+    }
+  }
+  for (const auto& channel : narrow.channels) {
+    EXPECT_EQ(decoded[channel.channel_id], channel.channel_data);
+  }
+
+  // the sample type has to hold the bit width, and the sign bit of unsigned samples in a signed type
+  auto payload = NDTPPayloadBroadband{
+    .is_signed = false, .bit_width = 16, .sample_rate = 1000, .channels = {{.channel_id = 1, .channel_data = {65535}}}
+  }.pack();
+  EXPECT_EQ(GenericNDTPPayloadBroadband<uint16_t>::unpack(payload).channels[0].channel_data, std::vector<uint16_t>{65535});
+  EXPECT_EQ(GenericNDTPPayloadBroadband<int32_t>::unpack(payload).channels[0].channel_data, std::vector<int32_t>{65535});
+  EXPECT_THROW(GenericNDTPPayloadBroadband<int16_t>::unpack(payload), std::runtime_error);
+  EXPECT_THROW(GenericNDTPPayloadBroadband<uint8_t>::unpack(payload), std::runtime_error);
+
+  // the same holds for a message that was already decoded to 64-bit samples, in either encoding
+  ElectricalBroadbandData wide_24{.is_signed = true, .bit_width = 24, .sample_rate = 30000, .t0 = 1};
+  wide_24.channels.push_back({.channel_id = 1, .channel_data = {static_cast<uint64_t>(-100000), 100000}});
+  auto message = NDTPMessage::unpack(wide_24.pack(0)[0]);
+  EXPECT_THROW(GenericElectricalBroadbandData<int16_t>::unpack(message), std::runtime_error);
+  EXPECT_EQ(GenericElectricalBroadbandData<int32_t>::unpack(message).channels[0].channel_data, std::vector<int32_t>({-100000, 100000}));
+  const auto& plain = std::get<NDTPPayloadBroadband>(message.payload);
+  message.payload = NDTPPayloadBroadbandDelta{
+    .is_signed = plain.is_signed, .bit_width = plain.bit_width, .sample_rate = plain.sample_rate, .channels = plain.channels
+  };
+  message.header.data_type |= NDTP_DATA_TYPE_COMPRESSED;
+  EXPECT_THROW(GenericElectricalBroadbandData<int16_t>::unpack(message), std::runtime_error);
+
+  // encoded delta messages decode from the raw bytes too
+  auto delta_packet = message.pack();
+  auto from_bytes = GenericElectricalBroadbandData<int32_t>::unpack(delta_packet.data(), delta_packet.size());
+  EXPECT_EQ(from_bytes.channels[0].channel_data, std::vector<int32_t>({-100000, 100000}));
+  EXPECT_EQ(from_bytes.bit_width, 24);
+  EXPECT_EQ(from_bytes.t0, 1);
+  EXPECT_THROW(GenericElectricalBroadbandData<int16_t>::unpack(delta_packet.data(), delta_packet.size()), std::runtime_error);
+}
+
+TEST(TypesTest, BinnedSpiketrainDataPicksTheSmallerEncoding) {
+  BinnedSpiketrainData data{.t0 = 1234567, .bin_size_ms = 1, .spike_counts = std::vector<uint8_t>(4096)};
+  data.spike_counts[10] = 2;
+  data.spike_counts[4000] = 1;
+
+  // a few spikes in many bins go out as a sparse list
+  auto packets = data.pack(1);
+  ASSERT_EQ(packets.size(), 1);
+  EXPECT_EQ(packets[0][1], synapse::DataType::kSpiketrain | NDTP_DATA_TYPE_COMPRESSED);
+  EXPECT_LT(packets[0].size(), 30);
+  auto unpacked = BinnedSpiketrainData::unpack(NDTPMessage::unpack(packets[0]));
+  EXPECT_EQ(unpacked.spike_counts, data.spike_counts);
+  EXPECT_EQ(unpacked.bin_size_ms, 1);
+  EXPECT_EQ(unpacked.t0, data.t0);
+
+  // busy bins stay dense
+  std::fill(data.spike_counts.begin(), data.spike_counts.end(), 1);
+  packets = data.pack(2);
+  EXPECT_EQ(packets[0][1], synapse::DataType::kSpiketrain);
+  unpacked = BinnedSpiketrainData::unpack(NDTPMessage::unpack(packets[0]));
+  EXPECT_EQ(unpacked.spike_counts, data.spike_counts);
+  EXPECT_EQ(unpacked.t0, data.t0);
+}
+
+TEST(TypesTest, UnpackIntoReusesCapacity) {
+  ElectricalBroadbandData data{.is_signed = false, .bit_width = 12, .sample_rate = 30000, .t0 = 9};
+  for (uint32_t c = 0; c < 4; c++) {
+    data.channels.push_back({.channel_id = c, .channel_data = std::vector<uint64_t>(50, c * 100)});
+  }
+  auto packets = data.pack(0);
+  ASSERT_EQ(packets.size(), 1);
+
+  GenericElectricalBroadbandData<uint16_t> narrow{};
+  GenericElectricalBroadbandData<uint16_t>::unpack_into(packets[0].data(), packets[0].size(), narrow);
+  auto samples = narrow.channels[3].channel_data.data();
+  data.channels[3].channel_data[10] = 7;
+  packets = data.pack(1);
+  GenericElectricalBroadbandData<uint16_t>::unpack_into(packets[0].data(), packets[0].size(), narrow);
+  EXPECT_EQ(narrow.channels[3].channel_data.data(), samples);
+  EXPECT_EQ(narrow.channels[3].channel_data[10], 7);
+  EXPECT_EQ(narrow.t0, 9);
+
+  ElectricalBroadbandData wide{};
+  ElectricalBroadbandData::unpack_into(NDTPMessage::unpack(packets[0]), wide);
+  EXPECT_EQ(wide.channels.size(), 4);
+  EXPECT_EQ(wide.channels[3].channel_data, data.channels[3].channel_data);
+
+  // a failed decode leaves the channels in place
+  packets[0][NDTPHeader::NDTP_HEADER_SIZE + 3] = 0xFF;
+  EXPECT_THROW(GenericElectricalBroadbandData<uint16_t>::unpack_into(packets[0].data(), packets[0].size(), narrow, true), std::runtime_error);
+  EXPECT_EQ(narrow.channels[3].channel_data.data(), samples);
+
+  BinnedSpiketrainData spikes{.t0 = 0, .bin_size_ms = 1, .spike_counts = std::vector<uint8_t>(100, 2)};
+  BinnedSpiketrainData unpacked{};
+  BinnedSpiketrainData::unpack_into(NDTPMessage::unpack(spikes.pack(0)[0]), unpacked);
+  auto counts = unpacked.spike_counts.data();
+  spikes.spike_counts[0] = 1;
+  BinnedSpiketrainData::unpack_into(NDTPMessage::unpack(spikes.pack(1)[0]), unpacked);
+  EXPECT_EQ(unpacked.spike_counts, spikes.spike_counts);
+  EXPECT_EQ(unpacked.spike_counts.data(), counts);
+}
+
+}  // namespace science::libndtp
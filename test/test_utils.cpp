@@ -139,5 +139,274 @@ TEST(UtilsTest, ToIntsErrorCases) {
   EXPECT_THROW(to_ints<uint64_t>({0x01, 0x02}, 3), std::invalid_argument);
 }
 
+TEST(UtilsTest, BitReaderReadsFields) {
+  ByteArray data = {0x00, 0x70, 0x05, 0x00, 0x30, 0x01};
+  BitReader reader(data.data(), data.size());
+  EXPECT_EQ(reader.read(12), 7);
+  EXPECT_EQ(reader.read(12), 5);
+  EXPECT_EQ(reader.bit_offset(), 24);
+  EXPECT_EQ(reader.read(12), 3);
+  EXPECT_EQ(reader.read(12), 1);
+  EXPECT_EQ(reader.bits_remaining(), 0);
+  EXPECT_THROW(reader.read(1), std::runtime_error);
+
+  ByteArray signed_data = {0xFF, 0xF9, 0xFF, 0xBF, 0xFD};
+  BitReader signed_reader(signed_data.data(), signed_data.size(), 4);
+  std::vector<int64_t> values(3);
+  signed_reader.read(values.data(), values.size(), 12, true);
+  EXPECT_EQ(values, std::vector<int64_t>({-7, -5, -3}));
+
+  ByteArray wide = {0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xC0};
+  BitReader wide_reader(wide.data(), wide.size());
+  EXPECT_EQ(wide_reader.read(64), 0x8000000000000001ULL);
+  EXPECT_EQ(wide_reader.read_signed(2), -1);
+}
+
+TEST(UtilsTest, BitReaderMatchesToBytesAcrossRefills) {
+  for (uint8_t bit_width : {1, 3, 7, 12, 13, 24, 31, 33, 57, 64}) {
+    std::vector<uint64_t> values;
+    for (uint64_t i = 0; i < 200; i++) {
+      uint64_t value = i * 0x9E3779B97F4A7C15ULL;
+      values.push_back(bit_width == 64 ? value : value & ((1ULL << bit_width) - 1));
+    }
+    ByteArray packed = {0xA5};
+    to_bytes<uint64_t>(values, bit_width, packed, 8);
+
+    BitReader reader(packed.data(), packed.size(), 8);
+    std::vector<uint64_t> unpacked(values.size());
+    reader.read(unpacked.data(), unpacked.size(), bit_width);
+    EXPECT_EQ(unpacked, values) << "bit width " << static_cast<int>(bit_width);
+    EXPECT_EQ(reader.bit_offset(), 8 + values.size() * bit_width);
+  }
+}
+
+TEST(UtilsTest, BitWriterMatchesToBytes) {
+  for (uint8_t bit_width : {1, 4, 7, 12, 13, 16, 24, 33, 57, 64}) {
+    std::vector<uint64_t> values;
+    for (uint64_t i = 0; i < 200; i++) {
+      uint64_t value = i * 0x9E3779B97F4A7C15ULL;
+      values.push_back(bit_width == 64 ? value : value & ((1ULL << bit_width) - 1));
+    }
+    ByteArray expected = {0xA5};
+    to_bytes<uint64_t>({0x3}, 2, expected, 8);
+    to_bytes<uint64_t>(values, bit_width, expected, 2);
+
+    // a prefix field leaves the writer unaligned before the bulk write
+    ByteArray written(expected.size() + 4, 0xEE);
+    written[0] = 0xA5;
+    BitWriter writer(written.data() + 1, expected.size() - 1);
+    writer.write(0x3, 2);
+    writer.write(values.data(), values.size(), bit_width);
+    EXPECT_EQ(writer.bit_offset(), 2 + values.size() * bit_width);
+    EXPECT_EQ(writer.finish(), expected.size() - 1);
+    EXPECT_EQ(ByteArray(written.begin(), written.begin() + expected.size()), expected)
+        << "bit width " << static_cast<int>(bit_width);
+    EXPECT_EQ(written.back(), 0xEE) << "bit width " << static_cast<int>(bit_width);
+  }
+
+  uint8_t small[2];
+  BitWriter writer(small, sizeof(small));
+  writer.write(0xABC, 12);
+  EXPECT_THROW(writer.write(0xABC, 12), std::runtime_error);
+}
+
+TEST(UtilsTest, WideBitWidthsRoundTrip) {
+  for (uint8_t bit_width : {31, 32, 33, 48, 63, 64}) {
+    for (bool is_signed : {false, true}) {
+      // the extremes of the range plus a spread of values in between
+      int64_t max = is_signed ? static_cast<int64_t>(low_bits_mask(bit_width - 1)) : static_cast<int64_t>(low_bits_mask(bit_width));
+      std::vector<int64_t> values = {0, 1, max};
+      if (is_signed) {
+        values.push_back(-1);
+        values.push_back(-max - 1);
+      }
+      for (uint64_t i = 0; i < 100; i++) {
+        uint64_t bits = (i * 0x9E3779B97F4A7C15ULL) & low_bits_mask(bit_width);
+        values.push_back(is_signed ? sign_extend(bits, bit_width) : static_cast<int64_t>(bits));
+      }
+
+      for (size_t start_bit : {0, 3, 8}) {
+        ByteArray bytes(start_bit > 0 ? 1 : 0, 0);
+        auto [_, offset, in_range] = to_bytes<int64_t>(values, bit_width, bytes, start_bit, is_signed);
+        EXPECT_TRUE(in_range);
+        EXPECT_EQ(bytes.size(), (start_bit + values.size() * bit_width + 7) / 8);
+
+        // BitWriter takes its aligned fast path at 32 and 64 bits
+        ByteArray written(bytes.size(), 0);
+        BitWriter writer(written.data(), written.size());
+        if (start_bit > 0) {
+          writer.write(0, start_bit);
+        }
+        writer.write(values.data(), values.size(), bit_width);
+        writer.finish();
+        EXPECT_EQ(written, bytes) << "bit width " << static_cast<int>(bit_width) << ", start bit " << start_bit;
+
+        std::vector<int64_t> unpacked(values.size());
+        BitReader(bytes.data(), bytes.size(), start_bit).read(unpacked.data(), unpacked.size(), bit_width, is_signed);
+        EXPECT_EQ(unpacked, values) << "bit width " << static_cast<int>(bit_width) << ", start bit " << start_bit;
+        auto [ints, end_bit] = to_ints<int64_t>(bytes.data(), bytes.size(), bit_width, values.size(), start_bit, is_signed);
+        EXPECT_EQ(ints, values);
+        EXPECT_EQ(end_bit, start_bit + values.size() * bit_width);
+      }
+    }
+  }
+
+  // one past either end of the range is reported, at every width up to 64
+  EXPECT_FALSE(std::get<2>(to_bytes<uint64_t>({1ULL << 32}, 32)));
+  EXPECT_TRUE(std::get<2>(to_bytes<uint64_t>({~0ULL}, 64)));
+  EXPECT_FALSE(std::get<2>(to_bytes<int64_t>({1LL << 31}, 32, 0, true)));
+  EXPECT_FALSE(std::get<2>(to_bytes<int64_t>({-(1LL << 31) - 1}, 32, 0, true)));
+  EXPECT_TRUE(std::get<2>(to_bytes<int64_t>({INT64_MIN, INT64_MAX}, 64, 0, true)));
+  EXPECT_FALSE(std::get<2>(to_bytes<int64_t>({-2}, 1, 0, true)));
+  EXPECT_TRUE(std::get<2>(to_bytes<int64_t>({-1, 0}, 1, 0, true)));
+  EXPECT_FALSE(fits_bit_width(std::vector<uint64_t>(1000, 7).data(), 1000, 2, false));
+
+  EXPECT_THROW(to_bytes<uint64_t>({1}, 65), std::invalid_argument);
+  EXPECT_THROW(to_ints<uint64_t>(ByteArray(16, 0), 65), std::invalid_argument);
+}
+
+template <typename T>
+static void expect_kernels_match_scalar(uint8_t bit_width, bool is_signed) {
+  std::vector<T> values;
+  for (uint64_t i = 0; i < 301; i++) {
+    uint64_t bits = (i * 0x9E3779B97F4A7C15ULL) >> 17;
+    int64_t value = is_signed ? static_cast<int64_t>(bits << (64 - bit_width)) >> (64 - bit_width)
+                              : static_cast<int64_t>(bits & ((1ULL << bit_width) - 1));
+    values.push_back(static_cast<T>(value));
+  }
+
+  simd::ScopedIsa restore_isa;
+  for (size_t start_bit : {0, 2, 4, 6, 8}) {
+    // a partially written leading byte, whose free low bits must be zero
+    ByteArray prefix;
+    if (start_bit > 0) {
+      prefix.push_back(start_bit % 8 > 0 ? static_cast<uint8_t>(0xFF << (8 - start_bit % 8)) : 0xA5);
+    }
+
+    simd::set_isa(simd::Isa::kScalar);
+    ByteArray expected_bytes = prefix;
+    to_bytes<T>(values, bit_width, expected_bytes, start_bit, is_signed);
+    std::vector<T> expected_values(values.size());
+    BitReader(expected_bytes.data(), expected_bytes.size(), start_bit)
+        .read(expected_values.data(), expected_values.size(), bit_width, is_signed);
+    EXPECT_EQ(expected_values, values);
+
+    for (auto isa : {simd::Isa::kSse41, simd::Isa::kAvx2}) {
+      if (!simd::set_isa(isa)) {
+        continue;
+      }
+      ByteArray bytes = prefix;
+      to_bytes<T>(values, bit_width, bytes, start_bit, is_signed);
+      EXPECT_EQ(bytes, expected_bytes) << "bit width " << static_cast<int>(bit_width) << ", start bit " << start_bit;
+
+      std::vector<T> unpacked(values.size());
+      BitReader(bytes.data(), bytes.size(), start_bit).read(unpacked.data(), unpacked.size(), bit_width, is_signed);
+      EXPECT_EQ(unpacked, values) << "bit width " << static_cast<int>(bit_width) << ", start bit " << start_bit;
+    }
+  }
+}
+
+TEST(UtilsTest, SimdKernelsMatchScalarCodec) {
+  auto isa = simd::active_isa();
+  for (uint8_t bit_width : {10, 12, 16, 24}) {
+    expect_kernels_match_scalar<uint64_t>(bit_width, false);
+    expect_kernels_match_scalar<int64_t>(bit_width, true);
+    expect_kernels_match_scalar<uint32_t>(bit_width, false);
+    expect_kernels_match_scalar<int32_t>(bit_width, true);
+  }
+  for (uint8_t bit_width : {10, 12, 16}) {
+    expect_kernels_match_scalar<uint16_t>(bit_width, false);
+    expect_kernels_match_scalar<int16_t>(bit_width, true);
+  }
+  EXPECT_EQ(simd::active_isa(), isa);
+}
+
+TEST(UtilsTest, SimdNibbleCodecMatchesBitWriter) {
+  simd::ScopedIsa restore_isa;
+  std::vector<uint8_t> counts(301);
+  for (size_t i = 0; i < counts.size(); i++) {
+    counts[i] = static_cast<uint8_t>(i * 37);  // includes counts above 15, which saturate
+  }
+
+  for (size_t count : {0, 1, 31, 32, 33, 64, 127, 301}) {
+    ByteArray expected((count + 1) / 2);
+    BitWriter writer(expected.data(), expected.size());
+    for (size_t i = 0; i < count; i++) {
+      writer.write(std::min<uint8_t>(counts[i], 15), 4);
+    }
+    writer.finish();
+
+    for (auto isa : {simd::Isa::kScalar, simd::Isa::kSse41, simd::Isa::kAvx2}) {
+      if (!simd::set_isa(isa)) {
+        continue;
+      }
+      ByteArray bytes(expected.size() + 1, 0xEE);
+      simd::pack_nibbles(counts.data(), count, bytes.data());
+      EXPECT_EQ(ByteArray(bytes.begin(), bytes.end() - 1), expected) << count << " counts";
+      EXPECT_EQ(bytes.back(), 0xEE) << count << " counts";
+
+      std::vector<uint8_t> unpacked(count + 1, 0xEE);
+      simd::unpack_nibbles(bytes.data(), count, unpacked.data());
+      for (size_t i = 0; i < count; i++) {
+        ASSERT_EQ(unpacked[i], std::min<uint8_t>(counts[i], 15)) << count << " counts, index " << i;
+      }
+      EXPECT_EQ(unpacked.back(), 0xEE) << count << " counts";
+    }
+  }
+}
+
+// Bit-at-a-time CRC-16/ARC, as a reference for the table and carry-less multiply paths.
+static uint16_t reference_crc16(const uint8_t* data, size_t size, uint16_t crc = 0) {
+  for (size_t i = 0; i < size; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+  }
+  return crc;
+}
+
+TEST(UtilsTest, Crc16MatchesReference) {
+  EXPECT_EQ(crc16(reinterpret_cast<const uint8_t*>("123456789"), 9), 0xBB3D);
+
+  ByteArray data(2048 + 3);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<uint8_t>((i * 0x9E3779B1u) >> 13);
+  }
+  for (size_t offset : {0, 1, 3}) {
+    for (size_t size = 0; size + offset <= data.size(); size += (size < 300 ? 1 : 97)) {
+      EXPECT_EQ(crc16(data.data() + offset, size), reference_crc16(data.data() + offset, size)) << "size " << size;
+    }
+  }
+}
+
+TEST(UtilsTest, Crc16StateIsIncremental) {
+  ByteArray data(1500);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<uint8_t>(i * 31 + 7);
+  }
+  uint16_t expected = reference_crc16(data.data(), data.size());
+  for (size_t split : {0, 1, 12, 63, 64, 65, 200, 1499}) {
+    Crc16State state;
+    state.update(data.data(), split);
+    state.update(data.data() + split, data.size() - split);
+    EXPECT_EQ(state.value(), expected) << "split " << split;
+  }
+
+  Crc16State state;
+  for (size_t i = 0; i < data.size(); i += 100) {
+    state.update(data.data() + i, std::min<size_t>(100, data.size() - i));
+  }
+  EXPECT_EQ(state.value(), expected);
+
+  ByteArray framed(data.begin(), data.begin() + 100);
+  uint16_t crc = crc16(framed);
+  framed.push_back(crc >> 8);
+  framed.push_back(crc & 0xFF);
+  EXPECT_TRUE(crc16_verify(framed.data(), framed.size()));
+  framed[5] ^= 0x10;
+  EXPECT_FALSE(crc16_verify(framed.data(), framed.size()));
+}
+
 }  // namespace science::libndtp
 
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include <science/libndtp/transport/udp.h>
+
+namespace science::libndtp {
+
+TEST(UdpTransportTest, SendsAndReceivesBatchesOverLoopback) {
+  NDTPUdpReceiver receiver("127.0.0.1", 0, 16, 2048, 1 << 20);
+  NDTPUdpSender sender("127.0.0.1", receiver.port(), 8);
+
+  PacketBatch batch;
+  for (uint16_t seq = 0; seq < 40; seq++) {
+    NDTPMessage message{
+      .header = NDTPHeader{.data_type = synapse::DataType::kSpiketrain, .timestamp = seq, .seq_number = seq},
+      .payload = NDTPPayloadSpiketrain{.bin_size_ms = 1, .spike_counts = std::vector<uint8_t>(seq + 1, seq & 0xF)}
+    };
+    batch.append(message);
+  }
+  EXPECT_EQ(sender.send(batch), 40);
+  EXPECT_EQ(sender.stats().batches, 5);
+
+  std::vector<ByteArray> received;
+  while (received.size() < 40) {
+    size_t n = receiver.receive(1000);
+    ASSERT_GT(n, 0);
+    EXPECT_LE(n, 16);
+    for (size_t i = 0; i < n; i++) {
+      received.emplace_back(receiver.datagram(i).begin(), receiver.datagram(i).end());
+    }
+  }
+  for (size_t i = 0; i < batch.size(); i++) {
+    EXPECT_EQ(received[i], ByteArray(batch[i].begin(), batch[i].end())) << "packet " << i;
+  }
+  EXPECT_EQ(receiver.receive(0), 0);
+  EXPECT_EQ(receiver.stats().datagrams, 40);
+}
+
+TEST(UdpTransportTest, SendsElectricalBroadbandDataAsMessages) {
+  NDTPUdpReceiver receiver("127.0.0.1", 0, 64, 1400, 1 << 20);
+  NDTPUdpSender sender("127.0.0.1", receiver.port());
+
+  ElectricalBroadbandData data{.is_signed = false, .bit_width = 12, .sample_rate = 30000, .t0 = 0};
+  for (uint32_t c = 0; c < 8; c++) {
+    data.channels.push_back({.channel_id = c, .channel_data = std::vector<uint64_t>(600, c)});
+  }
+  size_t n_packets = sender.send(data);
+  EXPECT_EQ(sender.seq_number(), n_packets);
+
+  std::vector<NDTPMessage> messages;
+  while (messages.size() < n_packets) {
+    ASSERT_GT(receiver.receive_messages([&](NDTPMessage&& message) { messages.push_back(std::move(message)); }, 1000), 0);
+  }
+  std::vector<size_t> n_samples(8);
+  for (size_t i = 0; i < messages.size(); i++) {
+    EXPECT_EQ(messages[i].header.seq_number, i);
+    for (const auto& channel : std::get<NDTPPayloadBroadband>(messages[i].payload).channels) {
+      EXPECT_EQ(channel.channel_data, std::vector<uint64_t>(channel.channel_data.size(), channel.channel_id));
+      n_samples[channel.channel_id] += channel.channel_data.size();
+    }
+  }
+  EXPECT_EQ(n_samples, std::vector<size_t>(8, 600));
+
+  // datagrams that do not fit a slot are dropped, not decoded
+  NDTPUdpReceiver small_receiver("127.0.0.1", 0, 4, 32);
+  NDTPUdpSender small_sender("127.0.0.1", small_receiver.port());
+  small_sender.send(data);
+  EXPECT_EQ(small_receiver.receive(1000), 0);
+  EXPECT_GT(small_receiver.stats().truncated, 0);
+}
+
+TEST(UdpTransportTest, AccountsForEveryDatagramWhenNobodyListens) {
+  uint16_t port;
+  {
+    NDTPUdpReceiver closed("127.0.0.1", 0, 1, 64);
+    port = closed.port();
+  }
+  NDTPUdpSender sender("127.0.0.1", port, 1);
+  PacketBatch batch;
+  for (uint16_t seq = 0; seq < 20; seq++) {
+    NDTPMessage message{
+      .header = NDTPHeader{.data_type = synapse::DataType::kSpiketrain, .timestamp = seq, .seq_number = seq},
+      .payload = NDTPPayloadSpiketrain{.bin_size_ms = 1, .spike_counts = {1, 2}}
+    };
+    batch.append(message);
+  }
+
+  // refusals of earlier datagrams are retried, not taken for the datagram being sent
+  size_t n_sent = sender.send(batch);
+  EXPECT_EQ(n_sent, sender.stats().datagrams);
+  EXPECT_EQ(sender.stats().datagrams + sender.stats().dropped, 20);
+  EXPECT_GT(sender.stats().refused, 0);
+}
+
+}  // namespace science::libndtp
@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+#include <science/libndtp/stream.h>
+#include <science/libndtp/transport/uring.h>
+
+namespace science::libndtp {
+
+// Sends 300 spiketrain messages to `receiver` and checks that they all come back in order through a stream decoder.
+static void expect_receives_stream(NDTPUringReceiver& receiver) {
+  NDTPUdpSender sender("127.0.0.1", receiver.port(), 32);
+  PacketBatch batch;
+  for (uint16_t seq = 0; seq < 300; seq++) {
+    NDTPMessage message{
+      .header = NDTPHeader{.data_type = synapse::DataType::kSpiketrain, .timestamp = seq, .seq_number = seq},
+      .payload = NDTPPayloadSpiketrain{.bin_size_ms = 1, .spike_counts = std::vector<uint8_t>(seq % 50, seq & 0xF)}
+    };
+    batch.append(message);
+  }
+  ASSERT_EQ(sender.send(batch), 300);
+
+  NDTPStreamDecoder decoder;
+  std::vector<uint64_t> delivered;
+  while (delivered.size() < 300) {
+    size_t n = receiver.receive(1000);
+    ASSERT_GT(n, 0);
+    for (size_t i = 0; i < n; i++) {
+      auto datagram = receiver.datagram(i);
+      decoder.push(datagram.data, datagram.size, [&](const NDTPStreamPacket& packet) {
+        auto message = packet.decode();
+        EXPECT_EQ(std::get<NDTPPayloadSpiketrain>(message.payload).spike_counts.size(), packet.seq % 50);
+        delivered.push_back(packet.seq);
+      });
+    }
+  }
+  EXPECT_EQ(decoder.stats().dropped, 0);
+  EXPECT_EQ(delivered.back(), 299);
+  EXPECT_EQ(receiver.stats().datagrams, 300);
+  EXPECT_EQ(receiver.receive(0), 0);
+}
+
+TEST(UringTransportTest, ReceivesOverLoopback) {
+  // 64 buffers for 300 datagrams: the multishot receive runs out of buffers and is re-armed
+  NDTPUringReceiver receiver("127.0.0.1", 0, 16, 2048, 64, 1 << 20);
+  if (receiver.backend() != NDTPUringReceiver::Backend::kIoUring) {
+    GTEST_SKIP() << "io_uring is not available";
+  }
+  expect_receives_stream(receiver);
+}
+
+TEST(UringTransportTest, FallsBackToRecvmmsg) {
+  NDTPUringReceiver receiver("127.0.0.1", 0, 16, 2048, 64, 1 << 20, NDTPUringReceiver::Backend::kRecvmmsg);
+  EXPECT_EQ(receiver.backend(), NDTPUringReceiver::Backend::kRecvmmsg);
+  expect_receives_stream(receiver);
+}
+
+}  // namespace science::libndtp
@@ -0,0 +1,341 @@
+// ndtp_loadgen: sends NDTP traffic over UDP at a controlled rate, either synthesized broadband and
+// spiketrain streams or a replayed capture file, and reports the load it achieved.
+#include <science/libndtp/capture.h>
+#include <science/libndtp/packet_batch.h>
+#include <science/libndtp/transport/udp.h>
+#include <science/libndtp/types.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace science::libndtp {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr double PI = 3.14159265358979323846;
+
+struct LoadgenOptions {
+  std::string address = "127.0.0.1";
+  uint16_t port = 5000;
+  size_t channels = 256;
+  uint32_t sample_rate = 30000;
+  uint32_t bit_width = 16;
+  bool is_signed = true;
+  double block_ms = 1.0;           // synthetic data sent per block
+  bool spiketrain = false;         // also send one spike count per channel and block
+  size_t max_packet_size = NDTP_DEFAULT_MAX_PACKET_SIZE;
+  double duration_s = 10.0;        // of synthetic traffic; 0 runs until interrupted
+  std::string replay;              // capture file to replay instead
+  double speed = 1.0;              // replay speed; 0 sends as fast as possible
+  double report_s = 1.0;
+  int send_buffer_bytes = 4 << 20;
+};
+
+void print_usage() {
+  std::fprintf(stderr,
+    "usage: ndtp_loadgen [options]\n"
+    "  --address ADDR          destination IPv4 address (default 127.0.0.1)\n"
+    "  --port PORT             destination UDP port (default 5000)\n"
+    "  --channels N            broadband channels (default 256)\n"
+    "  --sample-rate HZ        samples per second per channel (default 30000)\n"
+    "  --bit-width BITS        sample bit width, 1-64 (default 16)\n"
+    "  --unsigned              send unsigned samples (default signed)\n"
+    "  --block-ms MS           synthetic data per send (default 1)\n"
+    "  --spiketrain            also send binned spike counts, one per channel and block;\n"
+    "                          the block is the bin, so it must be whole milliseconds\n"
+    "  --max-packet-size N     bytes per datagram (default %zu)\n"
+    "  --duration S            seconds of synthetic traffic, 0 for no limit (default 10)\n"
+    "  --replay FILE           replay an NDTP capture file instead of synthesizing traffic\n"
+    "  --speed X               replay speed, 0 for as fast as possible (default 1)\n"
+    "  --report S              seconds between progress reports, 0 for none (default 1)\n",
+    NDTP_DEFAULT_MAX_PACKET_SIZE
+  );
+}
+
+LoadgenOptions parse_options(int argc, char** argv) {
+  LoadgenOptions options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto value = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        throw std::invalid_argument(arg + " needs a value");
+      }
+      return argv[++i];
+    };
+    if (arg == "--address") {
+      options.address = value();
+    } else if (arg == "--port") {
+      options.port = static_cast<uint16_t>(std::stoul(value()));
+    } else if (arg == "--channels") {
+      options.channels = std::stoul(value());
+    } else if (arg == "--sample-rate") {
+      options.sample_rate = std::stoul(value());
+    } else if (arg == "--bit-width") {
+      options.bit_width = std::stoul(value());
+    } else if (arg == "--unsigned") {
+      options.is_signed = false;
+    } else if (arg == "--block-ms") {
+      options.block_ms = std::stod(value());
+    } else if (arg == "--spiketrain") {
+      options.spiketrain = true;
+    } else if (arg == "--max-packet-size") {
+      options.max_packet_size = std::stoul(value());
+    } else if (arg == "--duration") {
+      options.duration_s = std::stod(value());
+    } else if (arg == "--replay") {
+      options.replay = value();
+    } else if (arg == "--speed") {
+      options.speed = std::stod(value());
+    } else if (arg == "--report") {
+      options.report_s = std::stod(value());
+    } else if (arg == "--help" || arg == "-h") {
+      print_usage();
+      std::exit(0);
+    } else {
+      throw std::invalid_argument("unknown option " + arg);
+    }
+  }
+  if (options.channels == 0 || options.sample_rate == 0 || options.bit_width < 1 || options.bit_width > 64 ||
+      options.block_ms <= 0 || options.speed < 0) {
+    throw std::invalid_argument("channels, sample rate, bit width, block size and speed must be positive");
+  }
+  // one spike count per channel and block, so a block is one bin
+  if (options.spiketrain && (options.block_ms != std::floor(options.block_ms) || options.block_ms > 255)) {
+    throw std::invalid_argument("--spiketrain needs a block of a whole number of milliseconds, at most 255");
+  }
+  return options;
+}
+
+/**
+ * Counts what was sent and how far each send started after its scheduled time.
+ */
+class LoadReport {
+ public:
+  explicit LoadReport(double report_s) : report_s_(report_s), start_(Clock::now()), last_report_(start_) {}
+
+  void sent(size_t packets, size_t bytes, Clock::time_point scheduled, Clock::time_point started) {
+    packets_ += packets;
+    bytes_ += bytes;
+    double late_us = std::chrono::duration<double, std::micro>(started - scheduled).count();
+    late_us = std::max(late_us, 0.0);
+    sends_++;
+    late_sum_us_ += late_us;
+    late_max_us_ = std::max(late_max_us_, late_us);
+    interval_late_max_us_ = std::max(interval_late_max_us_, late_us);
+
+    auto now = Clock::now();
+    if (report_s_ > 0 && now - last_report_ >= std::chrono::duration<double>(report_s_)) {
+      double seconds = std::chrono::duration<double>(now - last_report_).count();
+      std::printf(
+        "%8.1f s  %10.0f packets/s  %9.2f MB/s  max pacing error %8.1f us\n",
+        std::chrono::duration<double>(now - start_).count(), (packets_ - last_packets_) / seconds,
+        (bytes_ - last_bytes_) / seconds / 1e6, interval_late_max_us_
+      );
+      std::fflush(stdout);
+      last_report_ = now;
+      last_packets_ = packets_;
+      last_bytes_ = bytes_;
+      interval_late_max_us_ = 0;
+    }
+  }
+
+  void summary(const NDTPUdpStats& stats) const {
+    double seconds = std::chrono::duration<double>(Clock::now() - start_).count();
+    std::printf(
+      "sent %llu packets, %llu bytes in %.3f s: %.0f packets/s, %.2f MB/s (%.1f Mbit/s)\n"
+      "pacing error: mean %.1f us, max %.1f us over %llu sends; %llu sends refused, %llu datagrams dropped\n",
+      static_cast<unsigned long long>(packets_), static_cast<unsigned long long>(bytes_), seconds, packets_ / seconds,
+      bytes_ / seconds / 1e6, bytes_ * 8 / seconds / 1e6, sends_ ? late_sum_us_ / sends_ : 0.0, late_max_us_,
+      static_cast<unsigned long long>(sends_), static_cast<unsigned long long>(stats.refused),
+      static_cast<unsigned long long>(stats.dropped)
+    );
+  }
+
+ private:
+  double report_s_;
+  Clock::time_point start_;
+  Clock::time_point last_report_;
+  uint64_t packets_ = 0;
+  uint64_t bytes_ = 0;
+  uint64_t last_packets_ = 0;
+  uint64_t last_bytes_ = 0;
+  uint64_t sends_ = 0;
+  double late_sum_us_ = 0;
+  double late_max_us_ = 0;
+  double interval_late_max_us_ = 0;
+};
+
+// Waits until `deadline`: sleeps while it is far off and spins for the last stretch, since a
+// sleep can overshoot by tens of microseconds.
+void wait_until(Clock::time_point deadline) {
+  constexpr auto spin = std::chrono::microseconds(100);
+  auto now = Clock::now();
+  if (deadline - now > spin) {
+    std::this_thread::sleep_until(deadline - spin);
+  }
+  while (Clock::now() < deadline) {
+  }
+}
+
+// A few blocks of band-limited noise around a per-channel sine, sent in rotation so that packing
+// and sending, not sample generation, set the pace.
+std::vector<ElectricalBroadbandData> synthesize_blocks(const LoadgenOptions& options, size_t samples_per_block) {
+  constexpr size_t N_BLOCKS = 16;
+  double amplitude = std::ldexp(1.0, std::min<int>(options.bit_width, 62) - (options.is_signed ? 2 : 1));
+  uint64_t mask = options.bit_width == 64 ? ~0ULL : (1ULL << options.bit_width) - 1;
+  uint64_t noise = 0x9E3779B97F4A7C15ULL;
+
+  std::vector<ElectricalBroadbandData> blocks(N_BLOCKS);
+  for (size_t b = 0; b < N_BLOCKS; b++) {
+    auto& block = blocks[b];
+    block = ElectricalBroadbandData{
+      .is_signed = options.is_signed, .bit_width = options.bit_width, .sample_rate = options.sample_rate, .t0 = 0
+    };
+    for (size_t c = 0; c < options.channels; c++) {
+      std::vector<uint64_t> samples(samples_per_block);
+      double frequency = 2 * PI * (5 + c % 200) / options.sample_rate;
+      for (size_t i = 0; i < samples_per_block; i++) {
+        noise = noise * 6364136223846793005ULL + 1442695040888963407ULL;
+        double jitter = static_cast<double>(noise >> 40) / (1ULL << 24) - 0.5;
+        double value = amplitude * (0.8 * std::sin(frequency * (b * samples_per_block + i)) + 0.1 * jitter);
+        if (options.is_signed) {
+          samples[i] = static_cast<uint64_t>(static_cast<int64_t>(value));
+        } else {
+          samples[i] = static_cast<uint64_t>(value + amplitude) & mask;
+        }
+      }
+      block.channels.push_back({.channel_id = static_cast<uint32_t>(c), .channel_data = std::move(samples)});
+    }
+  }
+  return blocks;
+}
+
+int run_synthetic(const LoadgenOptions& options) {
+  auto samples_per_block = std::max<size_t>(1, std::llround(options.sample_rate * options.block_ms / 1000));
+  auto blocks = synthesize_blocks(options, samples_per_block);
+  // the block period follows from the whole number of samples it holds
+  auto period = std::chrono::duration<double>(static_cast<double>(samples_per_block) / options.sample_rate);
+  uint64_t period_us = samples_per_block * NDTP_TIMESTAMP_TICKS_PER_SECOND / options.sample_rate;
+
+  NDTPUdpSender sender(options.address, options.port, 64, options.send_buffer_bytes);
+  PacketBatch batch;
+  BinnedSpiketrainData spikes{.t0 = 0, .bin_size_ms = static_cast<uint8_t>(options.block_ms), .spike_counts = std::vector<uint8_t>(options.channels)};
+  uint64_t broadband_seq = 0;
+  uint64_t spiketrain_seq = 0;
+  uint64_t noise = 1;
+
+  std::printf(
+    "sending %zu channels x %u Hz x %u bits to %s:%u in blocks of %zu samples (%.0f samples/s offered)\n",
+    options.channels, options.sample_rate, options.bit_width, options.address.c_str(), options.port, samples_per_block,
+    static_cast<double>(options.channels) * options.sample_rate
+  );
+  LoadReport report(options.report_s);
+  auto start = Clock::now();
+  for (uint64_t k = 0; options.duration_s <= 0 || k * period.count() < options.duration_s; k++) {
+    auto scheduled = start + std::chrono::duration_cast<Clock::duration>(period * k);
+    wait_until(scheduled);
+    auto started = Clock::now();
+
+    batch.clear();
+    auto& block = blocks[k % blocks.size()];
+    block.t0 = k * period_us;
+    broadband_seq += block.pack(broadband_seq, batch, options.max_packet_size);
+    if (options.spiketrain) {
+      for (auto& count : spikes.spike_counts) {
+        noise = noise * 6364136223846793005ULL + 1442695040888963407ULL;
+        count = (noise >> 60) < 2 ? 1 + (noise >> 58 & 1) : 0;
+      }
+      spikes.t0 = block.t0;
+      spiketrain_seq += spikes.pack(spiketrain_seq, batch);
+    }
+    sender.send(batch);
+    report.sent(batch.size(), batch.bytes(), scheduled, started);
+  }
+  report.summary(sender.stats());
+  return 0;
+}
+
+int run_replay(const LoadgenOptions& options) {
+  NDTPCaptureReader reader(options.replay);
+  NDTPUdpSender sender(options.address, options.port, 64, options.send_buffer_bytes);
+  char speed[32] = "full speed";
+  if (options.speed > 0) {
+    std::snprintf(speed, sizeof(speed), "%gx speed", options.speed);
+  }
+  std::printf(
+    "replaying %s%s to %s:%u at %s\n", options.replay.c_str(), reader.complete() ? "" : " (not closed)",
+    options.address.c_str(), options.port, speed
+  );
+
+  // datagrams due at the same time go out together, up to one sendmmsg batch
+  constexpr size_t MAX_BATCH = 64;
+  PacketBatch batch;
+  LoadReport report(options.report_s);
+  Clock::time_point batch_due;
+  auto flush = [&]() {
+    if (batch.empty()) {
+      return;
+    }
+    auto started = Clock::now();
+    sender.send(batch);
+    report.sent(batch.size(), batch.bytes(), options.speed > 0 ? batch_due : started, started);
+    batch.clear();
+  };
+
+  auto start = Clock::now();
+  uint64_t first_receive_ns = 0;
+  NDTPCaptureRecord record;
+  for (uint64_t pos = reader.begin(); reader.next(pos, record);) {
+    if (record.offset == reader.begin()) {
+      first_receive_ns = record.receive_time_ns;
+    }
+    if (options.speed > 0) {
+      // capture time deltas, scaled; a receive clock that stepped backwards sends right away
+      double offset_ns = record.receive_time_ns > first_receive_ns ? record.receive_time_ns - first_receive_ns : 0;
+      auto due = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::nano>(offset_ns / options.speed));
+      if (!batch.empty() && due > batch_due) {
+        flush();
+      }
+      if (batch.empty()) {
+        batch_due = due;
+        wait_until(due);
+      }
+    }
+    batch.append(record.datagram.data, record.datagram.size);
+    if (batch.size() == MAX_BATCH) {
+      flush();
+    }
+  }
+  flush();
+  report.summary(sender.stats());
+  return 0;
+}
+
+}  // namespace
+}  // namespace science::libndtp
+
+int main(int argc, char** argv) {
+  using namespace science::libndtp;
+  LoadgenOptions options;
+  try {
+    options = parse_options(argc, argv);
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "ndtp_loadgen: %s\n", e.what());
+    print_usage();
+    return 2;
+  }
+  try {
+    return options.replay.empty() ? run_synthetic(options) : run_replay(options);
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "ndtp_loadgen: %s\n", e.what());
+    return 1;
+  }
+}